@@ -0,0 +1,381 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "rs.h"
+#include "rs.c"
+#include "rs_slab.h"
+#include "rs_slab.c"
+#include "rs_pool.h"
+#include "rs_pool.c"
+#include "rs16.h"
+#include "rs16.c"
+
+/*
+ * rsbench [-f json|csv] [-q] [-w warmup] [-r min_reps] [-t max_threads] [-M max_mb]
+ *
+ * Sweeps encode and reconstruct over geometry and block size (64 B to
+ * 16 MB), erasure counts, coding kernels, pool thread counts and the
+ * GF(2^16) wide-stripe codec.  Every case is warmed up, then repeated
+ * until it has run for about RSB_CASE_US or at least min_reps times;
+ * one row per case reports throughput over the data shards and the
+ * p50/p99 latency of a single call.  Rows go to stdout as JSON or CSV,
+ * cases that do not fit in max_mb are skipped.  -q runs a reduced sweep.
+ */
+
+#ifndef RSB_CASE_US
+#define RSB_CASE_US (200 * 1000)
+#endif
+
+#define RSB_MAX_REPS (10000)
+
+#define OP_ENCODE       0
+#define OP_RECONSTRUCT  1
+#define OP_ENCODE_MT    2
+#define OP_ENCODE16     3
+#define OP_REBUILD16    4
+
+static const char* op_names[] = { "encode", "reconstruct", "encode_mt", "encode16", "rebuild16" };
+
+typedef struct {
+    int op;
+    int matrix;
+    int kernel;
+    int data_shards;
+    int parity_shards;
+    int block_size;
+    int erasures;
+    int threads;
+} rsb_case;
+
+typedef struct {
+    int format_csv;
+    int quick;
+    int warmup;
+    int min_reps;
+    int max_threads;
+    long long max_bytes;
+    int rows;
+    double* lat;
+} rsb_config;
+
+static void fill_random(unsigned char* p, size_t len) {
+    static uint64_t x = 0x9e3779b97f4a7c15ULL;
+    size_t i;
+    for(i = 0; i < len; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        p[i] = (unsigned char)x;
+    }
+}
+
+static int cmp_double(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+static double percentile(double* sorted, int n, double p) {
+    int i = (int)(p * (n - 1) + 0.5);
+    return sorted[i];
+}
+
+static void print_row(rsb_config* cfg, rsb_case* c, int reps, double gbps,
+        double p50, double p99, double mean) {
+    /* Cauchy codes with the XOR bitmatrix engine, not the GF table kernels */
+    const char* kernel = OP_ENCODE16 == c->op || OP_REBUILD16 == c->op ? "gf16"
+            : RS_MATRIX_CAUCHY == c->matrix ? "xor" : fec_kernel_name(fec_get_kernel());
+    const char* matrix = RS_MATRIX_CAUCHY == c->matrix ? "cauchy"
+            : RS_MATRIX_PQ == c->matrix ? "pq" : "vandermonde";
+
+    if(cfg->format_csv) {
+        if(0 == cfg->rows) {
+            printf("op,matrix,kernel,data_shards,parity_shards,block_size,erasures,threads,"
+                    "reps,gbps,p50_us,p99_us,mean_us\n");
+        }
+        printf("%s,%s,%s,%d,%d,%d,%d,%d,%d,%.3f,%.3f,%.3f,%.3f\n",
+                op_names[c->op], matrix, kernel, c->data_shards, c->parity_shards,
+                c->block_size, c->erasures, c->threads, reps, gbps, p50, p99, mean);
+    } else {
+        printf("%s  {\"op\": \"%s\", \"matrix\": \"%s\", \"kernel\": \"%s\", "
+                "\"data_shards\": %d, \"parity_shards\": %d, \"block_size\": %d, "
+                "\"erasures\": %d, \"threads\": %d, \"reps\": %d, \"gbps\": %.3f, "
+                "\"p50_us\": %.3f, \"p99_us\": %.3f, \"mean_us\": %.3f}",
+                0 == cfg->rows ? "[\n" : ",\n",
+                op_names[c->op], matrix, kernel, c->data_shards, c->parity_shards,
+                c->block_size, c->erasures, c->threads, reps, gbps, p50, p99, mean);
+    }
+    fflush(stdout);
+    cfg->rows++;
+}
+
+/* one timed call of the case, in microseconds */
+static double run_once(rsb_case* c, void* codec, rs_pool* pool,
+        unsigned char** shards, unsigned char* marks, int stripes) {
+    double start = now_us();
+
+    switch(c->op) {
+    case OP_ENCODE:
+        reed_solomon_encode((reed_solomon*)codec, shards, shards + c->data_shards, c->block_size);
+        break;
+    case OP_RECONSTRUCT:
+        reed_solomon_reconstruct((reed_solomon*)codec, shards, marks,
+                c->data_shards + c->parity_shards, c->block_size);
+        break;
+    case OP_ENCODE_MT:
+        reed_solomon_encode2_mt((reed_solomon*)codec, pool, shards,
+                stripes * (c->data_shards + c->parity_shards), c->block_size, NULL);
+        break;
+    case OP_ENCODE16:
+        reed_solomon16_encode((reed_solomon16*)codec, shards, shards + c->data_shards, c->block_size);
+        break;
+    case OP_REBUILD16:
+        reed_solomon16_reconstruct((reed_solomon16*)codec, shards, marks, c->block_size);
+        break;
+    }
+    return now_us() - start;
+}
+
+static int run_case(rsb_config* cfg, rsb_case* c) {
+    int n = c->data_shards + c->parity_shards;
+    int stripes = OP_ENCODE_MT == c->op ? 4 * (c->threads + 1) : 1;
+    int wide = OP_ENCODE16 == c->op || OP_REBUILD16 == c->op;
+    size_t total = (size_t)stripes * n * c->block_size;
+    unsigned char* buf = NULL;
+    unsigned char** shards = NULL;
+    unsigned char* marks = NULL;
+    void* codec = NULL;
+    rs_pool* pool = NULL;
+    double t, elapsed, start;
+    int i, reps, err = -1;
+
+    if((long long)total > cfg->max_bytes) {
+        return 0;
+    }
+    if(!wide && 0 != fec_set_kernel(c->kernel)) {
+        return 0;
+    }
+
+    do {
+        buf = (unsigned char*)malloc(total);
+        shards = (unsigned char**)malloc(stripes * n * sizeof(unsigned char*));
+        marks = (unsigned char*)calloc(stripes * n, 1);
+        if(NULL == buf || NULL == shards || NULL == marks) {
+            break;
+        }
+        codec = wide ? (void*)reed_solomon16_new(c->data_shards, c->parity_shards)
+                : (void*)reed_solomon_new2(c->data_shards, c->parity_shards, c->matrix);
+        if(NULL == codec) {
+            break;
+        }
+        if(OP_ENCODE_MT == c->op) {
+            pool = rs_pool_new(c->threads);
+            if(NULL == pool) {
+                break;
+            }
+        }
+
+        for(i = 0; i < stripes * n; i++) {
+            shards[i] = buf + (size_t)i * c->block_size;
+        }
+        fill_random(buf, total);
+        if(OP_RECONSTRUCT == c->op) {
+            reed_solomon_encode((reed_solomon*)codec, shards, shards + c->data_shards, c->block_size);
+        } else if(OP_REBUILD16 == c->op) {
+            reed_solomon16_encode((reed_solomon16*)codec, shards, shards + c->data_shards, c->block_size);
+        }
+        for(i = 0; i < c->erasures; i++) {
+            /* spread the erasures over the data shards */
+            marks[(int)((long long)i * c->data_shards / c->erasures)] = 1;
+        }
+
+        for(i = 0; i < cfg->warmup; i++) {
+            run_once(c, codec, pool, shards, marks, stripes);
+        }
+        t = run_once(c, codec, pool, shards, marks, stripes);
+        reps = t > 0 ? (int)(RSB_CASE_US / t) : RSB_MAX_REPS;
+        if(reps < cfg->min_reps) {
+            reps = cfg->min_reps;
+        }
+        if(reps > RSB_MAX_REPS) {
+            reps = RSB_MAX_REPS;
+        }
+
+        start = now_us();
+        for(i = 0; i < reps; i++) {
+            cfg->lat[i] = run_once(c, codec, pool, shards, marks, stripes);
+        }
+        elapsed = now_us() - start;
+        qsort(cfg->lat, reps, sizeof(double), cmp_double);
+        print_row(cfg, c, reps,
+                (double)reps * stripes * c->data_shards * c->block_size / elapsed / 1e3,
+                percentile(cfg->lat, reps, 0.50), percentile(cfg->lat, reps, 0.99),
+                elapsed / reps);
+        err = 0;
+    } while(0);
+
+    if(0 != err) {
+        fprintf(stderr, "rsbench: could not set up %s %d+%d/%d\n", op_names[c->op],
+                c->data_shards, c->parity_shards, c->block_size);
+    }
+    rs_pool_release(pool);
+    if(wide) {
+        reed_solomon16_release((reed_solomon16*)codec);
+    } else {
+        reed_solomon_release((reed_solomon*)codec);
+    }
+    free(buf);
+    free(shards);
+    free(marks);
+    return err;
+}
+
+static void usage(void) {
+    fprintf(stderr,
+            "usage: rsbench [-f json|csv] [-q] [-w warmup] [-r min_reps] [-t max_threads] [-M max_mb]\n");
+}
+
+int main(int argc, char** argv) {
+    static const int geometries[][2] = { { 4, 2 }, { 10, 4 }, { 16, 4 }, { 32, 8 }, { 128, 7 }, { 200, 55 } };
+    static const int quick_sizes[] = { 64, 4096, 65536, 1 << 20 };
+    rsb_config cfg;
+    rsb_case c;
+    int sizes[16], erasures[3], nr_sizes = 0, nr_geometries;
+    int i, g, s, k, e, t, err = 0;
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.warmup = 3;
+    cfg.min_reps = 20;
+    cfg.max_threads = 4;
+    cfg.max_bytes = 512LL << 20;
+
+    for(i = 1; i < argc; i++) {
+        if(0 == strcmp(argv[i], "-q")) {
+            cfg.quick = 1;
+        } else if(i + 1 < argc && 0 == strcmp(argv[i], "-f")) {
+            cfg.format_csv = 0 == strcmp(argv[++i], "csv");
+        } else if(i + 1 < argc && 0 == strcmp(argv[i], "-w")) {
+            cfg.warmup = atoi(argv[++i]);
+        } else if(i + 1 < argc && 0 == strcmp(argv[i], "-r")) {
+            cfg.min_reps = atoi(argv[++i]);
+        } else if(i + 1 < argc && 0 == strcmp(argv[i], "-t")) {
+            cfg.max_threads = atoi(argv[++i]);
+        } else if(i + 1 < argc && 0 == strcmp(argv[i], "-M")) {
+            cfg.max_bytes = atoll(argv[++i]) << 20;
+        } else {
+            usage();
+            return 2;
+        }
+    }
+    if(cfg.warmup < 0 || cfg.min_reps <= 0 || cfg.min_reps > RSB_MAX_REPS
+            || cfg.max_threads < 0 || cfg.max_bytes <= 0) {
+        usage();
+        return 2;
+    }
+    cfg.lat = (double*)malloc(RSB_MAX_REPS * sizeof(double));
+    if(NULL == cfg.lat) {
+        return 1;
+    }
+
+    if(cfg.quick) {
+        memcpy(sizes, quick_sizes, sizeof(quick_sizes));
+        nr_sizes = sizeof(quick_sizes) / sizeof(quick_sizes[0]);
+        nr_geometries = 3;
+    } else {
+        for(s = 64; s <= 16 << 20; s *= 4) {
+            sizes[nr_sizes++] = s;
+        }
+        nr_geometries = sizeof(geometries) / sizeof(geometries[0]);
+    }
+
+    /* geometry x block size, every matrix type that fits, fastest kernel */
+    memset(&c, 0, sizeof(c));
+    c.kernel = FEC_KERNEL_AUTO;
+    for(g = 0; g < nr_geometries; g++) {
+        for(s = 0; s < nr_sizes; s++) {
+            c.op = OP_ENCODE;
+            c.data_shards = geometries[g][0];
+            c.parity_shards = geometries[g][1];
+            c.block_size = sizes[s];
+            c.matrix = RS_MATRIX_VANDERMONDE;
+            err |= run_case(&cfg, &c);
+            c.matrix = RS_MATRIX_CAUCHY;
+            err |= run_case(&cfg, &c);
+            if(c.parity_shards <= 2) {
+                c.matrix = RS_MATRIX_PQ;
+                err |= run_case(&cfg, &c);
+            }
+        }
+    }
+
+    /* every supported kernel on 10+4 */
+    c.matrix = RS_MATRIX_VANDERMONDE;
+    c.data_shards = 10;
+    c.parity_shards = 4;
+    for(k = 0; k < FEC_KERNEL_MAX; k++) {
+        if(!fec_kernel_supported(k)) {
+            continue;
+        }
+        c.kernel = k;
+        for(s = 0; s < nr_sizes; s++) {
+            c.block_size = sizes[s];
+            err |= run_case(&cfg, &c);
+        }
+    }
+    c.kernel = FEC_KERNEL_AUTO;
+
+    /* reconstruct with 1, half and all parity worth of lost data shards */
+    c.op = OP_RECONSTRUCT;
+    c.block_size = 64 * 1024;
+    for(g = 0; g < nr_geometries; g++) {
+        c.data_shards = geometries[g][0];
+        c.parity_shards = geometries[g][1];
+        erasures[0] = 1;
+        erasures[1] = c.parity_shards / 2;
+        erasures[2] = c.parity_shards;
+        for(e = 0; e < 3; e++) {
+            if(0 != e && erasures[e] <= erasures[e - 1]) {
+                continue;
+            }
+            c.erasures = erasures[e];
+            err |= run_case(&cfg, &c);
+        }
+    }
+    c.erasures = 0;
+
+    /* pool threads, 1 MB blocks */
+    c.op = OP_ENCODE_MT;
+    c.block_size = 1 << 20;
+    c.data_shards = 10;
+    c.parity_shards = 4;
+    for(t = 0; t <= cfg.max_threads; t = t ? t * 2 : 1) {
+        c.threads = t;
+        err |= run_case(&cfg, &c);
+    }
+    c.threads = 0;
+
+    /* GF(2^16) wide stripes */
+    c.block_size = 4096;
+    for(g = 0; g < 2; g++) {
+        c.data_shards = 0 == g ? 1000 : 4000;
+        c.parity_shards = 0 == g ? 200 : 96;
+        if(cfg.quick && 0 != g) {
+            break;
+        }
+        c.op = OP_ENCODE16;
+        c.erasures = 0;
+        err |= run_case(&cfg, &c);
+        c.op = OP_REBUILD16;
+        c.erasures = c.parity_shards;
+        err |= run_case(&cfg, &c);
+    }
+
+    if(!cfg.format_csv) {
+        printf(0 == cfg.rows ? "[]\n" : "\n]\n");
+    }
+    fec_set_kernel(FEC_KERNEL_AUTO);
+    free(cfg.lat);
+    return 0 != err;
+}
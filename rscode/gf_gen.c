@@ -0,0 +1,352 @@
+/*
+ * Generates gf_tables.h, the GF(2^8) tables rs.c used to build in
+ * fec_init(), and with "16" gf16_tables.h, the GF(2^16) tables of
+ * rs16.c.  Keeping them as static const data puts them in .rodata,
+ * shared between processes and usable without any initialisation.
+ *
+ *   gcc -O2 -Wall gf_gen.c -o gf_gen && ./gf_gen > gf_tables.h
+ *   ./gf_gen 16 > gf16_tables.h
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#define GF_BITS  8
+#define GF_SIZE ((1 << GF_BITS) - 1)
+
+typedef unsigned char gf;
+
+static gf gf_exp[2*GF_SIZE];
+static int gf_log[GF_SIZE + 1];
+static gf inverse[GF_SIZE+1];
+static gf gf_mul_table[(GF_SIZE + 1)*(GF_SIZE + 1)];
+static gf gf_bitrow[GF_SIZE + 1][8];
+static gf gf_mul_lo[GF_SIZE + 1][16];
+static gf gf_mul_hi[GF_SIZE + 1][16];
+static uint64_t gf_affine[GF_SIZE + 1];
+
+/* CRC32C (Castagnoli), reflected */
+#define CRC32C_POLY  0x82f63b78
+#define CRC32C_LONG  8192
+#define CRC32C_SHORT 256
+
+static uint32_t crc32c_table[8][256];
+static uint32_t crc32c_long[4][256];
+static uint32_t crc32c_short[4][256];
+
+/* GF(2^16) of rs16.c, x^16 + x^5 + x^3 + x^2 + 1 */
+#define GF16_BITS  16
+#define GF16_SIZE ((1 << GF16_BITS) - 1)
+#define GF16_POLY (0x1002D)
+
+typedef uint16_t gf16;
+
+static gf16 gf16_log[GF16_SIZE + 1];
+static gf16 gf16_exp[2*GF16_SIZE];
+static gf16 gf16_what[GF16_BITS][GF16_BITS];
+static gf16 gf16_dwhat[GF16_BITS];
+
+#define gf_mul(x,y) gf_mul_table[(x<<8)+y]
+
+static inline gf modnn(int x) {
+    while (x >= GF_SIZE) {
+        x -= GF_SIZE;
+        x = (x >> GF_BITS) + (x & GF_SIZE);
+    }
+    return x;
+}
+
+static void generate_gf(void) {
+    int i;
+    gf mask;
+    char *Pp =  "101110001";
+    mask = 1;
+    gf_exp[GF_BITS] = 0;
+    for (i = 0; i < GF_BITS; i++, mask <<= 1 ) {
+        gf_exp[i] = mask;
+        gf_log[gf_exp[i]] = i;
+        if ( Pp[i] == '1' )
+            gf_exp[GF_BITS] ^= mask;
+    }
+    gf_log[gf_exp[GF_BITS]] = GF_BITS;
+    mask = 1 << (GF_BITS - 1 ) ;
+    for (i = GF_BITS + 1; i < GF_SIZE; i++) {
+        if (gf_exp[i - 1] >= mask)
+            gf_exp[i] = gf_exp[GF_BITS] ^ ((gf_exp[i - 1] ^ mask) << 1);
+        else
+            gf_exp[i] = gf_exp[i - 1] << 1;
+        gf_log[gf_exp[i]] = i;
+    }
+    gf_log[0] = GF_SIZE ;
+    for (i = 0 ; i < GF_SIZE ; i++)
+        gf_exp[i + GF_SIZE] = gf_exp[i];
+    inverse[0] = 0 ;
+    inverse[1] = 1;
+    for (i=2; i<=GF_SIZE; i++)
+        inverse[i] = gf_exp[GF_SIZE-gf_log[i]];
+}
+
+static void init_mul_table(void)
+{
+    int i, j;
+    for (i=0; i< GF_SIZE+1; i++)
+        for (j=0; j< GF_SIZE+1; j++)
+            gf_mul_table[(i<<8)+j] = gf_exp[modnn(gf_log[i] + gf_log[j]) ];
+
+    for (j=0; j< GF_SIZE+1; j++)
+        gf_mul_table[j] = gf_mul_table[j<<8] = 0;
+}
+
+/* bit c of gf_bitrow[e][r] is bit r of e * 2^c: row r of e as an 8x8 bit matrix */
+static void init_bitrow_table(void)
+{
+    int e, r, c;
+    for (e = 0; e < GF_SIZE + 1; e++) {
+        for (r = 0; r < 8; r++) {
+            gf_bitrow[e][r] = 0;
+            for (c = 0; c < 8; c++) {
+                if (gf_mul(e, (1 << c)) & (1 << r))
+                    gf_bitrow[e][r] |= 1 << c;
+            }
+        }
+    }
+}
+
+/* bit i of the product is row 7-i of the matrix, bit j of a row selects x_j */
+static void init_kernel_tables(void) {
+    int c, i, j;
+    for (c = 0; c < GF_SIZE + 1; c++) {
+        for (i = 0; i < 16; i++) {
+            gf_mul_lo[c][i] = gf_mul(c, i);
+            gf_mul_hi[c][i] = gf_mul(c, (i << 4));
+        }
+        gf_affine[c] = 0;
+        for (i = 0; i < 8; i++) {
+            unsigned row = 0;
+            for (j = 0; j < 8; j++) {
+                if (gf_mul(c, (1 << j)) & (1 << i))
+                    row |= 1 << j;
+            }
+            gf_affine[c] |= (uint64_t)row << (8 * (7 - i));
+        }
+    }
+}
+
+/* slicing-by-8: crc32c_table[k][n] is n followed by k zero bytes */
+static void init_crc32c_table(void) {
+    uint32_t crc;
+    int n, k;
+    for (n = 0; n < 256; n++) {
+        crc = n;
+        for (k = 0; k < 8; k++)
+            crc = crc & 1 ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+        crc32c_table[0][n] = crc;
+    }
+    for (n = 0; n < 256; n++) {
+        crc = crc32c_table[0][n];
+        for (k = 1; k < 8; k++) {
+            crc = crc32c_table[0][crc & 0xff] ^ (crc >> 8);
+            crc32c_table[k][n] = crc;
+        }
+    }
+}
+
+/*
+ * The CRC register after len zero bytes is a linear function of the
+ * register before, a 32x32 bit matrix; mat[n] is the image of bit n.
+ * Squaring the one-bit operator doubles the number of zeros it adds.
+ */
+static uint32_t gf2_matrix_times(const uint32_t *mat, uint32_t vec) {
+    uint32_t sum = 0;
+    for (; vec; vec >>= 1, mat++)
+        if (vec & 1)
+            sum ^= *mat;
+    return sum;
+}
+
+static void gf2_matrix_square(uint32_t *square, const uint32_t *mat) {
+    int n;
+    for (n = 0; n < 32; n++)
+        square[n] = gf2_matrix_times(mat, mat[n]);
+}
+
+/* byte-wise tables of the operator that appends len zero bytes, len a power of two */
+static void init_crc32c_zeros(uint32_t zeros[4][256], int len) {
+    uint32_t op[32], sq[32];
+    int n, bits;
+    op[0] = CRC32C_POLY;
+    for (n = 1; n < 32; n++)
+        op[n] = 1u << (n - 1);
+    for (bits = 1; bits < 8 * len; bits <<= 1) {
+        gf2_matrix_square(sq, op);
+        for (n = 0; n < 32; n++)
+            op[n] = sq[n];
+    }
+    for (n = 0; n < 256; n++) {
+        zeros[0][n] = gf2_matrix_times(op, n);
+        zeros[1][n] = gf2_matrix_times(op, (uint32_t)n << 8);
+        zeros[2][n] = gf2_matrix_times(op, (uint32_t)n << 16);
+        zeros[3][n] = gf2_matrix_times(op, (uint32_t)n << 24);
+    }
+}
+
+static gf16 gf16_mul(gf16 a, gf16 b) {
+    if (a == 0 || b == 0)
+        return 0;
+    return gf16_exp[gf16_log[a] + gf16_log[b]];
+}
+
+static gf16 gf16_div(gf16 a, gf16 b) {
+    if (a == 0)
+        return 0;
+    return gf16_exp[gf16_log[a] + GF16_SIZE - gf16_log[b]];
+}
+
+/*
+ * W_0(x) = x, W_{i+1}(x) = W_i(x)^2 + W_i(2^i) W_i(x); gf16_what[i][b]
+ * is W_i(2^b) / W_i(2^i) and gf16_dwhat[i] the derivative of that
+ */
+static void generate_gf16(void) {
+    gf16 w[GF16_BITS], norm, d = 1;
+    unsigned x = 1;
+    int i, b;
+
+    for (i = 0; i < GF16_SIZE; i++) {
+        gf16_exp[i] = gf16_exp[i + GF16_SIZE] = (gf16)x;
+        gf16_log[x] = (gf16)i;
+        x <<= 1;
+        if (x & (1 << GF16_BITS))
+            x ^= GF16_POLY;
+    }
+    gf16_log[0] = 0;
+
+    for (b = 0; b < GF16_BITS; b++)
+        w[b] = (gf16)(1 << b);
+    for (i = 0; i < GF16_BITS; i++) {
+        norm = w[i];
+        for (b = 0; b < GF16_BITS; b++)
+            gf16_what[i][b] = gf16_div(w[b], norm);
+        gf16_dwhat[i] = gf16_div(d, norm);
+        for (b = 0; b < GF16_BITS; b++)
+            w[b] = gf16_mul(w[b], w[b]) ^ gf16_mul(norm, w[b]);
+        d = gf16_mul(d, norm);
+    }
+}
+
+static void print_halves(const char *decl, const gf16 *p, int n, int width) {
+    int i;
+    printf("%s = {", decl);
+    for (i = 0; i < n; i++) {
+        printf("%s0x%04x,", i % width ? " " : "\n    ", p[i]);
+    }
+    printf("\n};\n\n");
+}
+
+static int main16(void) {
+    int r, c;
+
+    generate_gf16();
+
+    printf("/* generated by gf_gen.c 16, do not edit */\n");
+    printf("#ifndef __GF16_TABLES_H_\n#define __GF16_TABLES_H_\n\n");
+    print_halves("static const gf16 gf16_log[GF16_SIZE + 1]", gf16_log, GF16_SIZE + 1, 16);
+    print_halves("static const gf16 gf16_exp[2*GF16_SIZE]", gf16_exp, 2*GF16_SIZE, 16);
+
+    printf("static const gf16 gf16_what[GF16_BITS][GF16_BITS] = {\n");
+    for (r = 0; r < GF16_BITS; r++) {
+        printf("    {");
+        for (c = 0; c < GF16_BITS; c++) {
+            printf("%s0x%04x", c % 8 ? ", " : c ? ",\n     " : "", gf16_what[r][c]);
+        }
+        printf("},\n");
+    }
+    printf("};\n\n");
+    print_halves("static const gf16 gf16_dwhat[GF16_BITS]", gf16_dwhat, GF16_BITS, 8);
+
+    printf("#endif\n");
+    return 0;
+}
+
+static void print_bytes(const char *decl, const gf *p, int n, int width) {
+    int i;
+    printf("%s = {", decl);
+    for (i = 0; i < n; i++) {
+        printf("%s0x%02x,", i % width ? " " : "\n    ", p[i]);
+    }
+    printf("\n};\n\n");
+}
+
+static void print_rows(const char *decl, const gf *p, int rows, int cols) {
+    int r, c;
+    printf("%s = {\n", decl);
+    for (r = 0; r < rows; r++) {
+        printf("    {");
+        for (c = 0; c < cols; c++) {
+            printf("%s0x%02x", c ? ", " : "", p[r*cols + c]);
+        }
+        printf("},\n");
+    }
+    printf("};\n\n");
+}
+
+static void print_words(const char *decl, const uint32_t *p, int rows, int cols) {
+    int r, c;
+    printf("%s = {\n", decl);
+    for (r = 0; r < rows; r++) {
+        printf("    {");
+        for (c = 0; c < cols; c++) {
+            printf("%s0x%08x", c % 8 ? ", " : c ? ",\n     " : "", p[r*cols + c]);
+        }
+        printf("},\n");
+    }
+    printf("};\n\n");
+}
+
+int main(int argc, char **argv) {
+    int i;
+
+    if (argc > 1 && strcmp(argv[1], "16") == 0)
+        return main16();
+
+    generate_gf();
+    init_mul_table();
+    init_bitrow_table();
+    init_kernel_tables();
+    init_crc32c_table();
+    init_crc32c_zeros(crc32c_long, CRC32C_LONG);
+    init_crc32c_zeros(crc32c_short, CRC32C_SHORT);
+
+    printf("/* generated by gf_gen.c, do not edit */\n");
+    printf("#ifndef __GF_TABLES_H_\n#define __GF_TABLES_H_\n\n");
+
+    print_bytes("static const gf gf_exp[2*GF_SIZE]", gf_exp, 2*GF_SIZE, 16);
+
+    printf("static const int gf_log[GF_SIZE + 1] = {");
+    for (i = 0; i < GF_SIZE + 1; i++) {
+        printf("%s%d,", i % 16 ? " " : "\n    ", gf_log[i]);
+    }
+    printf("\n};\n\n");
+
+    print_bytes("static const gf inverse[GF_SIZE+1]", inverse, GF_SIZE + 1, 16);
+    print_bytes("static const gf gf_mul_table[(GF_SIZE + 1)*(GF_SIZE + 1)]\n"
+            "__attribute__((aligned (16)))", gf_mul_table, (GF_SIZE + 1)*(GF_SIZE + 1), 16);
+    print_rows("static const gf gf_bitrow[GF_SIZE + 1][8]", &gf_bitrow[0][0], GF_SIZE + 1, 8);
+    print_rows("static const gf gf_mul_lo[GF_SIZE + 1][16] __attribute__((aligned (16)))",
+            &gf_mul_lo[0][0], GF_SIZE + 1, 16);
+    print_rows("static const gf gf_mul_hi[GF_SIZE + 1][16] __attribute__((aligned (16)))",
+            &gf_mul_hi[0][0], GF_SIZE + 1, 16);
+
+    printf("static const uint64_t gf_affine[GF_SIZE + 1] = {");
+    for (i = 0; i < GF_SIZE + 1; i++) {
+        printf("%s0x%016llxULL,", i % 4 ? " " : "\n    ", (unsigned long long)gf_affine[i]);
+    }
+    printf("\n};\n\n");
+
+    printf("#define CRC32C_LONG  %d\n#define CRC32C_SHORT %d\n\n", CRC32C_LONG, CRC32C_SHORT);
+    print_words("static const uint32_t crc32c_table[8][256]", &crc32c_table[0][0], 8, 256);
+    print_words("static const uint32_t crc32c_long[4][256]", &crc32c_long[0][0], 4, 256);
+    print_words("static const uint32_t crc32c_short[4][256]", &crc32c_short[0][0], 4, 256);
+
+    printf("#endif\n");
+    return 0;
+}
@@ -1,9 +1,24 @@
 #include "rs.h"
 #include "rs.c"
+#include "rs_pool.h"
+#include "rs_pool.c"
+#include "rs16.h"
+#include "rs16.c"
+#include "rs_store.h"
+#include "rs_store.c"
+#include "rs_lrc.h"
+#include "rs_lrc.c"
+#include "rs_fec.h"
+#include "rs_fec.c"
+#include "rs_object.h"
+#include "rs_object.c"
+#include "rs_slab.h"
+#include "rs_slab.c"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <sys/stat.h>
 
 #define DATA_SHARDS 128
 #define PARITY_SHARDS 7
@@ -99,7 +114,7 @@ void test_no_errors() {
     int ret = reed_solomon_encode(rs, data_blocks, fec_blocks, BLOCK_SIZE);
     clock_gettime(CLOCK_MONOTONIC, &end);
     double encode_time = get_time_ms(start, end);
-    printf("Encoding time: %.3f ms\n", encode_time * BLOCK_SIZE);
+    printf("Encoding time: %.3f ms\n", encode_time);
     if (ret != 0) {
         fprintf(stderr, "Encoding failed\n");
         for (int i = 0; i < TOTAL_SHARDS; i++) free(shards[i]);
@@ -114,7 +129,7 @@ void test_no_errors() {
     ret = reed_solomon_reconstruct(rs, shards, zilch, TOTAL_SHARDS, BLOCK_SIZE);
     clock_gettime(CLOCK_MONOTONIC, &end);
     double reconstruct_time = get_time_ms(start, end);
-    printf("Reconstruction time: %.3f ms\n", reconstruct_time * BLOCK_SIZE);
+    printf("Reconstruction time: %.3f ms\n", reconstruct_time);
     if (ret != 0) {
         fprintf(stderr, "Reconstruction failed\n");
     } else {
@@ -180,7 +195,7 @@ void test_erasures() {
     int ret = reed_solomon_encode(rs, data_blocks, fec_blocks, BLOCK_SIZE);
     clock_gettime(CLOCK_MONOTONIC, &end);
     double encode_time = get_time_ms(start, end);
-    printf("Encoding time: %.3f ms\n", encode_time * BLOCK_SIZE);
+    printf("Encoding time: %.3f ms\n", encode_time);
     if (ret != 0) {
         fprintf(stderr, "Encoding failed\n");
         for (int i = 0; i < TOTAL_SHARDS; i++) free(shards[i]);
@@ -204,7 +219,7 @@ void test_erasures() {
     ret = reed_solomon_reconstruct(rs, shards, zilch, TOTAL_SHARDS, BLOCK_SIZE);
     clock_gettime(CLOCK_MONOTONIC, &end);
     double reconstruct_time = get_time_ms(start, end);
-    printf("Reconstruction time: %.3f ms\n", reconstruct_time * BLOCK_SIZE);
+    printf("Reconstruction time: %.3f ms\n", reconstruct_time);
     if (ret != 0) {
         fprintf(stderr, "Reconstruction failed\n");
     } else {
@@ -275,7 +290,7 @@ void test_random_errors() {
     int ret = reed_solomon_encode(rs, data_blocks, fec_blocks, BLOCK_SIZE);
     clock_gettime(CLOCK_MONOTONIC, &end);
     double encode_time = get_time_ms(start, end);
-    printf("Encoding time: %.3f ms\n", encode_time * BLOCK_SIZE);
+    printf("Encoding time: %.3f ms\n", encode_time);
     if (ret != 0) {
         fprintf(stderr, "Encoding failed\n");
         for (int i = 0; i < TOTAL_SHARDS; i++) free(shards[i]);
@@ -305,7 +320,7 @@ void test_random_errors() {
     ret = reed_solomon_reconstruct(rs, shards, zilch, TOTAL_SHARDS, BLOCK_SIZE);
     clock_gettime(CLOCK_MONOTONIC, &end);
     double reconstruct_time = get_time_ms(start, end);
-    printf("Reconstruction time: %.3f ms\n", reconstruct_time * BLOCK_SIZE);
+    printf("Reconstruction time: %.3f ms\n", reconstruct_time);
     if (ret != 0) {
         fprintf(stderr, "Reconstruction failed\n");
     } else {
@@ -333,12 +348,1571 @@ void test_random_errors() {
     reed_solomon_release(rs);
 }
 
-int main() {
-    fec_init();
+void test_kernels() {
+    printf("\n=== Test 4: GF Kernels ===\n");
+
+    int sizes[] = { 1, 15, 31, 33, 63, 64, 65, 1000, 4096 + 13 };
+    int nsizes = sizeof(sizes) / sizeof(sizes[0]);
+    int max_size = 4096 + 13;
+    unsigned char *src = malloc(max_size);
+    unsigned char *expect = malloc(max_size);
+    unsigned char *got = malloc(max_size);
+    if (src == NULL || expect == NULL || got == NULL) {
+        fprintf(stderr, "Failed to allocate memory for kernel buffers\n");
+        free(src);
+        free(expect);
+        free(got);
+        return;
+    }
+
+    int saved = fec_get_kernel();
+    for (int k = 0; k < FEC_KERNEL_MAX; k++) {
+        if (!fec_kernel_supported(k)) {
+            printf("Kernel %s: not supported\n", fec_kernel_name(k));
+            continue;
+        }
+        fec_set_kernel(k);
+        int errors = 0;
+        for (int s = 0; s < nsizes; s++) {
+            int sz = sizes[s];
+            for (int c = 0; c < 256; c++) {
+                for (int j = 0; j < sz; j++) {
+                    src[j] = (unsigned char)rand();
+                    expect[j] = got[j] = (unsigned char)rand();
+                }
+                slow_addmul1(expect, src, (gf)c, sz);
+                gf_kernels[k].addmul1(got, src, (gf)c, sz);
+                errors += memcmp(expect, got, sz) != 0;
+
+                slow_mul1(expect, src, (gf)c, sz);
+                gf_kernels[k].mul1(got, src, (gf)c, sz);
+                errors += memcmp(expect, got, sz) != 0;
+            }
+        }
+        printf("Kernel %s: %s\n", fec_kernel_name(k), errors == 0 ? "matches scalar" : "MISMATCH");
+    }
+    fec_set_kernel(saved);
+    printf("Selected kernel: %s\n", fec_kernel_name(fec_get_kernel()));
+
+    free(src);
+    free(expect);
+    free(got);
+}
+
+void test_decode_cache() {
+    printf("\n=== Test 5: Decode Matrix Cache ===\n");
+
+    int stripes = 16;
+    int nr_shards = stripes * TOTAL_SHARDS;
+    reed_solomon *rs = reed_solomon_new(DATA_SHARDS, PARITY_SHARDS);
+    if (rs == NULL) {
+        fprintf(stderr, "Failed to create reed_solomon\n");
+        return;
+    }
+
+    unsigned char *buf = malloc((size_t)nr_shards * BLOCK_SIZE);
+    unsigned char *original_data = malloc((size_t)nr_shards * BLOCK_SIZE);
+    unsigned char **shards = malloc(nr_shards * sizeof(unsigned char*));
+    unsigned char *marks = calloc(nr_shards, 1);
+    if (buf == NULL || original_data == NULL || shards == NULL || marks == NULL) {
+        fprintf(stderr, "Failed to allocate memory for stripes\n");
+        free(buf);
+        free(original_data);
+        free(shards);
+        free(marks);
+        reed_solomon_release(rs);
+        return;
+    }
+
+    for (int i = 0; i < nr_shards; i++) {
+        shards[i] = buf + (size_t)i * BLOCK_SIZE;
+    }
+    for (int i = 0; i < stripes * DATA_SHARDS * BLOCK_SIZE; i++) {
+        buf[i] = (unsigned char)rand();
+    }
+    reed_solomon_encode2(rs, shards, nr_shards, BLOCK_SIZE);
+    memcpy(original_data, buf, (size_t)nr_shards * BLOCK_SIZE);
+
+    /* same device lost in every stripe: one data shard and one parity shard */
+    for (int s = 0; s < stripes; s++) {
+        memset(shards[s * DATA_SHARDS + 5], 0, BLOCK_SIZE);
+        memset(shards[s * DATA_SHARDS + 77], 0, BLOCK_SIZE);
+        marks[s * DATA_SHARDS + 5] = 1;
+        marks[s * DATA_SHARDS + 77] = 1;
+        marks[stripes * DATA_SHARDS + s * PARITY_SHARDS + 1] = 1;
+    }
+
+    int ret = reed_solomon_reconstruct(rs, shards, marks, nr_shards, BLOCK_SIZE);
+    unsigned long long hits, misses;
+    reed_solomon_cache_stats(rs, &hits, &misses);
+    printf("Cache hits: %llu, misses: %llu\n", hits, misses);
+    if (ret != 0) {
+        fprintf(stderr, "Reconstruction failed\n");
+    } else {
+        int errors = memcmp(buf, original_data, (size_t)stripes * DATA_SHARDS * BLOCK_SIZE) != 0;
+        printf(errors == 0 && misses == 1 ? "All data recovered correctly\n" : "Cache or recovery mismatch\n");
+    }
+
+    free(buf);
+    free(original_data);
+    free(shards);
+    free(marks);
+    reed_solomon_release(rs);
+}
+
+int run_mt_case(rs_pool *pool, int data_shards, int parity_shards, int stripes, int block_size) {
+    int shards_per_stripe = data_shards + parity_shards;
+    int nr_shards = stripes * shards_per_stripe;
+    size_t total = (size_t)nr_shards * block_size;
+    reed_solomon *rs = reed_solomon_new(data_shards, parity_shards);
+    unsigned char *buf = malloc(total);
+    unsigned char *expect = malloc(total);
+    unsigned char **shards = malloc(nr_shards * sizeof(unsigned char*));
+    unsigned char *marks = calloc(nr_shards, 1);
+    int errors = -1;
+
+    if (rs == NULL || buf == NULL || expect == NULL || shards == NULL || marks == NULL) {
+        fprintf(stderr, "Failed to allocate memory for stripes\n");
+        goto out;
+    }
+
+    for (int i = 0; i < nr_shards; i++) {
+        shards[i] = buf + (size_t)i * block_size;
+    }
+    for (size_t i = 0; i < (size_t)stripes * data_shards * block_size; i++) {
+        buf[i] = (unsigned char)rand();
+    }
+    memcpy(expect, buf, total);
+    unsigned char **expect_shards = malloc(nr_shards * sizeof(unsigned char*));
+    if (expect_shards == NULL) {
+        goto out;
+    }
+    for (int i = 0; i < nr_shards; i++) {
+        expect_shards[i] = expect + (size_t)i * block_size;
+    }
+    reed_solomon_encode2(rs, expect_shards, nr_shards, block_size);
+    free(expect_shards);
+
+    rs_pool_stats stats;
+    reed_solomon_encode2_mt(rs, pool, shards, nr_shards, block_size, &stats);
+    printf("%d+%d x %d stripes of %d bytes: encode %d tasks, %d steals, speedup %.2f\n",
+           data_shards, parity_shards, stripes, block_size, stats.tasks, stats.steals, stats.speedup);
+    errors = memcmp(buf, expect, total) != 0;
+
+    /* only every third stripe is degraded */
+    for (int s = 0; s < stripes; s += 3) {
+        for (int e = 0; e < parity_shards; e++) {
+            int i = (s * 7 + e * 3) % data_shards;
+            if (!marks[s * data_shards + i]) {
+                memset(shards[s * data_shards + i], 0, block_size);
+                marks[s * data_shards + i] = 1;
+            }
+        }
+    }
+    if (reed_solomon_reconstruct_mt(rs, pool, shards, marks, nr_shards, block_size, &stats) != 0) {
+        errors++;
+    }
+    printf("%d+%d x %d stripes of %d bytes: reconstruct %d tasks, %d steals, speedup %.2f\n",
+           data_shards, parity_shards, stripes, block_size, stats.tasks, stats.steals, stats.speedup);
+    errors += memcmp(buf, expect, total) != 0;
+
+out:
+    free(buf);
+    free(expect);
+    free(shards);
+    free(marks);
+    reed_solomon_release(rs);
+    return errors;
+}
+
+void test_multithreaded() {
+    printf("\n=== Test 6: Multithreaded Encode/Reconstruct ===\n");
+
+    rs_pool *pool = rs_pool_new(4);
+    if (pool == NULL) {
+        fprintf(stderr, "Failed to create thread pool\n");
+        return;
+    }
+
+    int errors = run_mt_case(pool, DATA_SHARDS, PARITY_SHARDS, 24, BLOCK_SIZE);
+    errors += run_mt_case(pool, 10, 4, 3, RS_POOL_SPLIT_MIN + 100);
+    printf(errors == 0 ? "All data recovered correctly\n" : "Found %d mismatches\n", errors);
+
+    rs_pool_release(pool);
+}
+
+void test_reconstruct_some() {
+    printf("\n=== Test 7: Selective Reconstruction ===\n");
+
+    reed_solomon *rs = reed_solomon_new(DATA_SHARDS, PARITY_SHARDS);
+    if (rs == NULL) {
+        fprintf(stderr, "Failed to create reed_solomon\n");
+        return;
+    }
+
+    size_t dynamic_memory = 0;
+    unsigned char **shards = NULL;
+    unsigned char *original_data = NULL;
+    if (init_shards(&shards, &original_data, &dynamic_memory)) {
+        reed_solomon_release(rs);
+        return;
+    }
+    unsigned char *expect = malloc(TOTAL_SHARDS * BLOCK_SIZE);
+    unsigned char *marks = calloc(TOTAL_SHARDS, 1);
+    unsigned char *wanted = calloc(TOTAL_SHARDS, 1);
+    if (expect == NULL || marks == NULL || wanted == NULL) {
+        fprintf(stderr, "Failed to allocate memory for marks\n");
+        goto out;
+    }
+
+    reed_solomon_encode(rs, shards, &shards[DATA_SHARDS], BLOCK_SIZE);
+    for (int i = 0; i < TOTAL_SHARDS; i++) {
+        memcpy(expect + i * BLOCK_SIZE, shards[i], BLOCK_SIZE);
+    }
+
+    /* lose two data and two parity shards, ask for one of each first */
+    int lost[] = { 4, 90, DATA_SHARDS + 0, DATA_SHARDS + 5 };
+    for (int i = 0; i < 4; i++) {
+        memset(shards[lost[i]], 0, BLOCK_SIZE);
+        marks[lost[i]] = 1;
+    }
+    wanted[90] = 1;
+    wanted[DATA_SHARDS + 5] = 1;
+    int ret = reed_solomon_reconstruct_some(rs, shards, marks, wanted, TOTAL_SHARDS, BLOCK_SIZE);
+    int errors = ret != 0;
+    errors += memcmp(shards[90], expect + 90 * BLOCK_SIZE, BLOCK_SIZE) != 0;
+    errors += memcmp(shards[DATA_SHARDS + 5], expect + (DATA_SHARDS + 5) * BLOCK_SIZE, BLOCK_SIZE) != 0;
+    for (int j = 0; j < BLOCK_SIZE; j++) {
+        errors += shards[4][j] != 0 || shards[DATA_SHARDS][j] != 0;
+    }
+    printf("Wanted shards only: %s\n", errors == 0 ? "ok" : "FAILED");
+
+    memcpy(wanted, marks, TOTAL_SHARDS);
+    ret = reed_solomon_reconstruct_some(rs, shards, marks, wanted, TOTAL_SHARDS, BLOCK_SIZE);
+    errors += ret != 0;
+    for (int i = 0; i < TOTAL_SHARDS; i++) {
+        errors += memcmp(shards[i], expect + i * BLOCK_SIZE, BLOCK_SIZE) != 0;
+    }
+    printf(errors == 0 ? "All data and parity recovered correctly\n" : "Found %d errors in recovered shards\n", errors);
+
+out:
+    for (int i = 0; i < TOTAL_SHARDS; i++) free(shards[i]);
+    free(shards);
+    free(original_data);
+    free(expect);
+    free(marks);
+    free(wanted);
+    reed_solomon_release(rs);
+}
+
+void test_verify() {
+    printf("\n=== Test 8: Parity Verification ===\n");
+
+    reed_solomon *rs = reed_solomon_new(DATA_SHARDS, PARITY_SHARDS);
+    if (rs == NULL) {
+        fprintf(stderr, "Failed to create reed_solomon\n");
+        return;
+    }
+
+    size_t dynamic_memory = 0;
+    unsigned char **shards = NULL;
+    unsigned char *original_data = NULL;
+    if (init_shards(&shards, &original_data, &dynamic_memory)) {
+        reed_solomon_release(rs);
+        return;
+    }
+
+    unsigned char bad_rows[PARITY_SHARDS];
+    reed_solomon_encode(rs, shards, &shards[DATA_SHARDS], BLOCK_SIZE);
+    int ret = reed_solomon_verify(rs, shards, &shards[DATA_SHARDS], BLOCK_SIZE, bad_rows);
+    printf("Clean stripe: %s\n", ret == 0 ? "parity matches" : "MISMATCH");
+    int errors = ret != 0;
+
+    shards[DATA_SHARDS + 3][BLOCK_SIZE - 1] ^= 0x5a;
+    ret = reed_solomon_verify(rs, shards, &shards[DATA_SHARDS], BLOCK_SIZE, bad_rows);
+    printf("Corrupted parity 3: %s, bad rows:", ret == 1 ? "mismatch found" : "NOT DETECTED");
+    for (int i = 0; i < PARITY_SHARDS; i++) {
+        if (bad_rows[i]) printf(" %d", i);
+        errors += bad_rows[i] != (i == 3);
+    }
+    printf("\n");
+    errors += ret != 1;
+
+    shards[DATA_SHARDS + 3][BLOCK_SIZE - 1] ^= 0x5a;
+    shards[17][0] ^= 0x01;
+    ret = reed_solomon_verify(rs, shards, &shards[DATA_SHARDS], BLOCK_SIZE, bad_rows);
+    int nr_bad = 0;
+    for (int i = 0; i < PARITY_SHARDS; i++) nr_bad += bad_rows[i];
+    printf("Corrupted data 17: %d of %d parity rows disagree\n", nr_bad, PARITY_SHARDS);
+    errors += ret != 1 || nr_bad != PARITY_SHARDS;
+    printf(errors == 0 ? "Verification correct\n" : "Found %d verification errors\n", errors);
+
+    for (int i = 0; i < TOTAL_SHARDS; i++) free(shards[i]);
+    free(shards);
+    free(original_data);
+    reed_solomon_release(rs);
+}
+
+void test_update() {
+    printf("\n=== Test 9: Incremental Parity Update ===\n");
+
+    reed_solomon *rs = reed_solomon_new(DATA_SHARDS, PARITY_SHARDS);
+    if (rs == NULL) {
+        fprintf(stderr, "Failed to create reed_solomon\n");
+        return;
+    }
+
+    size_t dynamic_memory = 0;
+    unsigned char **shards = NULL;
+    unsigned char *original_data = NULL;
+    if (init_shards(&shards, &original_data, &dynamic_memory)) {
+        reed_solomon_release(rs);
+        return;
+    }
+
+    unsigned char old_data[BLOCK_SIZE];
+    unsigned char expect[PARITY_SHARDS][BLOCK_SIZE];
+    unsigned char *expect_blocks[PARITY_SHARDS];
+    for (int i = 0; i < PARITY_SHARDS; i++) {
+        expect_blocks[i] = expect[i];
+    }
+    reed_solomon_encode(rs, shards, &shards[DATA_SHARDS], BLOCK_SIZE);
+
+    /* overwrite bytes 5..20 of data shard 42 */
+    memcpy(old_data, shards[42], BLOCK_SIZE);
+    for (int j = 5; j < 21; j++) {
+        shards[42][j] = (unsigned char)rand();
+    }
+    int ret = reed_solomon_update(rs, 42, old_data + 5, shards[42] + 5, &shards[DATA_SHARDS], 5, 16);
+    reed_solomon_encode(rs, shards, expect_blocks, BLOCK_SIZE);
+
+    int errors = ret != 0;
+    for (int i = 0; i < PARITY_SHARDS; i++) {
+        errors += memcmp(shards[DATA_SHARDS + i], expect[i], BLOCK_SIZE) != 0;
+    }
+    printf(errors == 0 ? "Updated parity matches full re-encode\n" : "Found %d mismatching parity blocks\n", errors);
+
+    for (int i = 0; i < TOTAL_SHARDS; i++) free(shards[i]);
+    free(shards);
+    free(original_data);
+    reed_solomon_release(rs);
+}
+
+double time_encode(reed_solomon *rs, unsigned char **shards, int block_size, int rounds) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int r = 0; r < rounds; r++) {
+        reed_solomon_encode(rs, shards, &shards[rs->data_shards], block_size);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return get_time_ms(start, end);
+}
+
+void test_cauchy() {
+    printf("\n=== Test 10: Cauchy XOR Codec ===\n");
+
+    int ds = 10, ps = 4, n = ds + ps, block_size = 64 * 1024, rounds = 200;
+    reed_solomon *rs = reed_solomon_new2(ds, ps, RS_MATRIX_CAUCHY);
+    reed_solomon *vm = reed_solomon_new2(ds, ps, RS_MATRIX_VANDERMONDE);
+    unsigned char *buf = malloc((size_t)n * block_size);
+    unsigned char *expect = malloc((size_t)n * block_size);
+    unsigned char *shards[n], marks[n], bad_rows[ps];
+    if (rs == NULL || vm == NULL || buf == NULL || expect == NULL) {
+        fprintf(stderr, "Failed to set up Cauchy codec\n");
+        goto out;
+    }
+
+    for (int i = 0; i < n; i++) {
+        shards[i] = buf + (size_t)i * block_size;
+    }
+    for (int i = 0; i < ds * block_size; i++) {
+        buf[i] = (unsigned char)rand();
+    }
+    int errors = reed_solomon_encode(rs, shards, &shards[ds], block_size) != 0;
+    errors += reed_solomon_verify(rs, shards, &shards[ds], block_size, bad_rows) != 0;
+    memcpy(expect, buf, (size_t)n * block_size);
+
+    memset(marks, 0, sizeof(marks));
+    int lost[] = { 0, 7, ds + 1, ds + 3 };
+    for (int i = 0; i < 4; i++) {
+        memset(shards[lost[i]], 0, block_size);
+        marks[lost[i]] = 1;
+    }
+    errors += reed_solomon_reconstruct_some(rs, shards, marks, marks, n, block_size) != 0;
+    errors += memcmp(buf, expect, (size_t)n * block_size) != 0;
+
+    shards[ds + 2][block_size - 1] ^= 1;
+    errors += reed_solomon_verify(rs, shards, &shards[ds], block_size, bad_rows) != 1 || !bad_rows[2];
+    printf(errors == 0 ? "All data and parity recovered correctly\n" : "Found %d errors\n", errors);
+
+    double xor_ms = time_encode(rs, shards, block_size, rounds);
+    double table_ms = time_encode(vm, shards, block_size, rounds);
+    double bytes = (double)rounds * ds * block_size;
+    printf("%d+%d encode, %d byte blocks: xor %.2f GB/s, table (%s) %.2f GB/s\n", ds, ps, block_size,
+           bytes / xor_ms / 1e6, fec_kernel_name(fec_get_kernel()), bytes / table_ms / 1e6);
+
+out:
+    free(buf);
+    free(expect);
+    reed_solomon_release(rs);
+    reed_solomon_release(vm);
+}
+
+/* the construction reed_solomon_new used to do: V * inverse(top of V) */
+gf *vandermonde_reference(int ds, int ps) {
+    int n = ds + ps;
+    gf *vm = malloc((size_t)n * ds), *top = malloc((size_t)ds * ds), *m = calloc((size_t)n, ds);
+    if (vm == NULL || top == NULL || m == NULL) {
+        free(vm);
+        free(top);
+        free(m);
+        return NULL;
+    }
+    for (int r = 0; r < n; r++) {
+        gf x = 1;
+        for (int c = 0; c < ds; c++) {
+            vm[r * ds + c] = c == 0 ? 1 : (x = galMultiply(x, (gf)r));
+        }
+    }
+    memcpy(top, vm, (size_t)ds * ds);
+    invert_mat(top, ds);
+    for (int r = 0; r < n; r++) {
+        for (int c = 0; c < ds; c++) {
+            for (int i = 0; i < ds; i++) {
+                m[r * ds + c] ^= galMultiply(vm[r * ds + i], top[i * ds + c]);
+            }
+        }
+    }
+    free(vm);
+    free(top);
+    return m;
+}
+
+void test_registry() {
+    printf("\n=== Test 11: Codec Construction and Registry ===\n");
+
+    int geometries[][2] = { { 4, 2 }, { 10, 4 }, { DATA_SHARDS, PARITY_SHARDS }, { 200, 55 } };
+    int errors = 0;
+    for (int g = 0; g < 4; g++) {
+        int ds = geometries[g][0], ps = geometries[g][1];
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        gf *expect = vandermonde_reference(ds, ps);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double old_ms = get_time_ms(start, end);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        reed_solomon *rs = reed_solomon_new2(ds, ps, RS_MATRIX_VANDERMONDE);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        if (rs == NULL || expect == NULL) {
+            fprintf(stderr, "Failed to create %d+%d codec\n", ds, ps);
+            errors++;
+        } else {
+            errors += memcmp(rs->m, expect, (size_t)(ds + ps) * ds) != 0;
+            errors += rs->parity != rs->m + ds * ds;
+            printf("%d+%d: built in %.3f ms, inversion %.3f ms\n", ds, ps, get_time_ms(start, end), old_ms);
+        }
+        free(expect);
+        reed_solomon_release(rs);
+    }
+
+    reed_solomon *a = reed_solomon_acquire(DATA_SHARDS, PARITY_SHARDS, RS_MATRIX_VANDERMONDE);
+    reed_solomon *b = reed_solomon_acquire(DATA_SHARDS, PARITY_SHARDS, RS_MATRIX_VANDERMONDE);
+    reed_solomon *c = reed_solomon_acquire(DATA_SHARDS, PARITY_SHARDS, RS_MATRIX_CAUCHY);
+    errors += a == NULL || a != b || c == NULL || c == a || a->refs != 2;
+    reed_solomon_release(b);
+    reed_solomon_release(c);
+    b = reed_solomon_acquire(DATA_SHARDS, PARITY_SHARDS, RS_MATRIX_VANDERMONDE);
+    errors += b != a;
+    reed_solomon_release(b);
+    reed_solomon_release(a);
+    printf(errors == 0 ? "Closed-form matrices match, codecs shared\n" : "Found %d registry errors\n", errors);
+}
+
+void test_correct() {
+    printf("\n=== Test 12: Locating and Correcting Errors ===\n");
+
+    int block_size = 64 * 1024;
+    reed_solomon *rs = reed_solomon_new(DATA_SHARDS, PARITY_SHARDS);
+    unsigned char *buf = malloc((size_t)TOTAL_SHARDS * block_size);
+    unsigned char *expect = malloc((size_t)TOTAL_SHARDS * block_size);
+    unsigned char *shards[TOTAL_SHARDS], corrupted[TOTAL_SHARDS];
+    if (rs == NULL || buf == NULL || expect == NULL) {
+        fprintf(stderr, "Failed to set up error correction\n");
+        goto out;
+    }
+
+    for (int i = 0; i < TOTAL_SHARDS; i++) {
+        shards[i] = buf + (size_t)i * block_size;
+    }
+    for (int i = 0; i < DATA_SHARDS * block_size; i++) {
+        buf[i] = (unsigned char)rand();
+    }
+    reed_solomon_encode(rs, shards, &shards[DATA_SHARDS], block_size);
+    memcpy(expect, buf, (size_t)TOTAL_SHARDS * block_size);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int errors = reed_solomon_correct(rs, shards, block_size, corrupted) != 0;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    for (int i = 0; i < TOTAL_SHARDS; i++) errors += corrupted[i];
+    printf("Clean stripe checked at %.2f GB/s\n",
+           (double)TOTAL_SHARDS * block_size / get_time_ms(start, end) / 1e6);
+
+    /* up to PARITY_SHARDS / 2 unknown bad shards, including shard 0 and a parity shard */
+    int bad[] = { 0, 77, DATA_SHARDS + 4 };
+    int nr_bad = PARITY_SHARDS / 2;
+    for (int b = 0; b < nr_bad; b++) {
+        for (int e = 0; e < 200; e++) {
+            shards[bad[b]][rand() % block_size] ^= (unsigned char)(1 + rand() % 255);
+        }
+    }
+    int ret = reed_solomon_correct(rs, shards, block_size, corrupted);
+    errors += ret != 0 || memcmp(buf, expect, (size_t)TOTAL_SHARDS * block_size) != 0;
+    printf("Corrupted shards found:");
+    for (int i = 0; i < TOTAL_SHARDS; i++) {
+        if (corrupted[i]) printf(" %d", i);
+        errors += corrupted[i] != (i == bad[0] || i == bad[1] || i == bad[2]);
+    }
+    printf("\n");
+
+    /* one more bad shard than the code can locate must be refused, not miscorrected */
+    for (int b = 0; b <= nr_bad; b++) {
+        shards[b * 3][5] ^= 0x42;
+    }
+    ret = reed_solomon_correct(rs, shards, block_size, corrupted);
+    errors += ret != 1;
+    printf("%d errors in one column: %s\n", nr_bad + 1, ret == 1 ? "refused" : "NOT DETECTED");
+    printf(errors == 0 ? "All corrupted shards corrected\n" : "Found %d errors\n", errors);
+
+out:
+    free(buf);
+    free(expect);
+    reed_solomon_release(rs);
+}
+
+void test_wide_stripe() {
+    printf("\n=== Test 13: GF(2^16) Wide Stripe ===\n");
+
+    int ds = 1000, ps = 200, n = ds + ps, block_size = 4096;
+    reed_solomon16 *rs = reed_solomon16_new(ds, ps);
+    unsigned char *buf = malloc((size_t)n * block_size);
+    unsigned char *expect = malloc((size_t)n * block_size);
+    unsigned char **shards = malloc(n * sizeof(unsigned char *));
+    unsigned char *marks = calloc(n, 1);
+    if (rs == NULL || buf == NULL || expect == NULL || shards == NULL || marks == NULL) {
+        fprintf(stderr, "Failed to set up wide stripe\n");
+        goto out;
+    }
+
+    for (int i = 0; i < n; i++) {
+        shards[i] = buf + (size_t)i * block_size;
+    }
+    for (int i = 0; i < ds * block_size; i++) {
+        buf[i] = (unsigned char)rand();
+    }
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int errors = reed_solomon16_encode(rs, shards, &shards[ds], block_size) != 0;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double encode_ms = get_time_ms(start, end);
+    memcpy(expect, buf, (size_t)n * block_size);
+
+    /* lose as many shards as there is parity, data and parity mixed */
+    for (int lost = 0; lost < ps; ) {
+        int i = rand() % n;
+        if (!marks[i]) {
+            marks[i] = 1;
+            memset(shards[i], 0, block_size);
+            lost++;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    errors += reed_solomon16_reconstruct(rs, shards, marks, block_size) != 0;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    errors += memcmp(buf, expect, (size_t)n * block_size) != 0;
+    printf("%d+%d, %d byte blocks: encode %.2f ms, rebuild of %d shards %.2f ms\n",
+           ds, ps, block_size, encode_ms, ps, get_time_ms(start, end));
+
+    /* one more erasure than there is parity must be refused */
+    int erased = 0;
+    for (int i = 0, more = 1; i < n; i++) {
+        if (!marks[i] && more) {
+            marks[i] = 1;
+            more = 0;
+        }
+        erased += marks[i] != 0;
+    }
+    errors += erased != ps + 1;
+    errors += reed_solomon16_reconstruct(rs, shards, marks, block_size) != -1;
+    printf(errors == 0 ? "All data and parity recovered correctly\n" : "Found %d errors\n", errors);
+
+out:
+    free(buf);
+    free(expect);
+    free(shards);
+    free(marks);
+    reed_solomon16_release(rs);
+}
+
+void test_stats() {
+    printf("\n=== Test 14: Instrumentation Counters ===\n");
+
+    rs_stats st;
+    reed_solomon_stats_reset();
+    reed_solomon *rs = reed_solomon_new(10, 4);
+    unsigned char *buf = malloc(14 * 4096);
+    unsigned char *shards[14], marks[14];
+    if (rs == NULL || buf == NULL) {
+        fprintf(stderr, "Failed to set up instrumentation test\n");
+        goto out;
+    }
+    for (int i = 0; i < 14; i++) {
+        shards[i] = buf + i * 4096;
+    }
+    for (int i = 0; i < 10 * 4096; i++) {
+        buf[i] = (unsigned char)rand();
+    }
+    reed_solomon_encode(rs, shards, &shards[10], 4096);
+    memset(marks, 0, sizeof(marks));
+    marks[1] = marks[3] = marks[11] = 1;
+    reed_solomon_reconstruct_some(rs, shards, marks, marks, 14, 4096);
+    reed_solomon_reconstruct_some(rs, shards, marks, marks, 14, 4096);
+
+    int errors = 0;
+    if (!reed_solomon_stats(&st)) {
+        for (size_t i = 0; i < sizeof(st) / sizeof(unsigned long long); i++) {
+            errors += ((unsigned long long *)&st)[i] != 0;
+        }
+        printf("Compiled out (build with -DRS_STATS)\n");
+    } else {
+        errors += st.matrix_builds != 1 || st.stripes_encoded != 1 || st.stripes_reconstructed != 2;
+        errors += st.inversions != 1 || st.erasures[3] != 2 || st.code_calls != 3;
+        errors += st.code_bytes != 3 * 10 * 4096;
+        printf("matrix %llu cycles, inversion %llu cycles, coding %.2f cycles/byte\n",
+               st.matrix_cycles, st.invert_cycles, (double)st.code_cycles / st.code_bytes);
+
+        /* a stripe split into byte ranges on the pool still counts once */
+        int bs = RS_POOL_SPLIT_MIN + 100;
+        rs_pool *pool = rs_pool_new(2);
+        unsigned char *big = malloc((size_t)14 * bs);
+        if (pool != NULL && big != NULL) {
+            for (int i = 0; i < 14; i++) {
+                shards[i] = big + (size_t)i * bs;
+            }
+            memset(big, 7, (size_t)10 * bs);
+            reed_solomon_stats_reset();
+            errors += reed_solomon_encode2_mt(rs, pool, shards, 14, bs, NULL) != 0;
+            memset(marks, 0, sizeof(marks));
+            marks[2] = marks[5] = 1;
+            errors += reed_solomon_reconstruct_mt(rs, pool, shards, marks, 14, bs, NULL) != 0;
+            reed_solomon_stats(&st);
+            errors += st.stripes_encoded != 1 || st.stripes_reconstructed != 1 || st.erasures[2] != 1;
+            errors += st.code_bytes < 2ULL * 10 * bs;
+        } else {
+            errors++;
+        }
+        free(big);
+        rs_pool_release(pool);
+    }
+    printf(errors == 0 ? "Counters consistent\n" : "Found %d counter errors\n", errors);
+
+out:
+    free(buf);
+    reed_solomon_release(rs);
+}
+
+void test_batch() {
+    printf("\n=== Test 15: Batched Stripe Encode ===\n");
+
+    int ds = 10, ps = 4, nr = 300, max_size = 4096;
+    reed_solomon *rs = reed_solomon_new(ds, ps);
+    rs_pool *pool = rs_pool_new(2);
+    rs_stripe *stripes = malloc(nr * sizeof(rs_stripe));
+    unsigned char **blocks = malloc((size_t)nr * (ds + ps) * sizeof(unsigned char *));
+    unsigned char *buf = malloc((size_t)nr * (ds + ps) * max_size);
+    unsigned char *expect = malloc((size_t)nr * ps * max_size);
+    if (rs == NULL || pool == NULL || stripes == NULL || blocks == NULL || buf == NULL || expect == NULL) {
+        fprintf(stderr, "Failed to set up batch encode\n");
+        goto out;
+    }
+
+    /* objects of random size, each stripe with its own scattered blocks */
+    size_t used = 0;
+    for (int s = 0; s < nr; s++) {
+        stripes[s].block_size = 1 + rand() % max_size;
+        stripes[s].data_blocks = blocks + (size_t)s * (ds + ps);
+        stripes[s].fec_blocks = stripes[s].data_blocks + ds;
+        for (int i = 0; i < ds + ps; i++) {
+            stripes[s].data_blocks[i] = buf + used;
+            used += stripes[s].block_size;
+        }
+    }
+    for (size_t i = 0; i < used; i++) {
+        buf[i] = (unsigned char)rand();
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int s = 0; s < nr; s++) {
+        reed_solomon_encode(rs, stripes[s].data_blocks, stripes[s].fec_blocks, stripes[s].block_size);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double single_ms = get_time_ms(start, end);
+    for (int s = 0; s < nr; s++) {
+        for (int i = 0; i < ps; i++) {
+            memcpy(expect + ((size_t)s * ps + i) * max_size, stripes[s].fec_blocks[i], stripes[s].block_size);
+            memset(stripes[s].fec_blocks[i], 0, stripes[s].block_size);
+        }
+    }
+
+    int errors = 0;
+    for (int round = 0; round < 2; round++) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (round == 0) {
+            errors += reed_solomon_encode_batch(rs, stripes, nr) != 0;
+        } else {
+            errors += reed_solomon_encode_batch_mt(rs, pool, stripes, nr, NULL) != 0;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        int mismatches = 0;
+        for (int s = 0; s < nr; s++) {
+            for (int i = 0; i < ps; i++) {
+                mismatches += memcmp(expect + ((size_t)s * ps + i) * max_size, stripes[s].fec_blocks[i],
+                                     stripes[s].block_size) != 0;
+                memset(stripes[s].fec_blocks[i], 0, stripes[s].block_size);
+            }
+        }
+        printf("%s: %d stripes in %.3f ms (one call each: %.3f ms), %d mismatches\n",
+               round == 0 ? "Batch" : "Batch on pool", nr, get_time_ms(start, end), single_ms, mismatches);
+        errors += mismatches;
+    }
+    printf(errors == 0 ? "Batched parity matches per-stripe encode\n" : "Found %d errors\n", errors);
+
+out:
+    free(stripes);
+    free(blocks);
+    free(buf);
+    free(expect);
+    rs_pool_release(pool);
+    reed_solomon_release(rs);
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+void test_store() {
+    printf("\n=== Test 16: Shard Store, Fastest k of n Reads ===\n");
+
+    int ds = 4, ps = 2, nr_dirs = 6, objects = 200, block_size = 4096, delay_us = 2000;
+    char base[] = "/tmp/rs_store_XXXXXX";
+    char paths[6][64];
+    const char *dirs[6];
+    unsigned char *data[4], *out[4];
+    double lat[2][200];
+    char name[32];
+    int errors = 0, parity_used = 0;
+
+    reed_solomon *rs = reed_solomon_new(ds, ps);
+    if (rs == NULL || mkdtemp(base) == NULL) {
+        fprintf(stderr, "Failed to set up shard store\n");
+        reed_solomon_release(rs);
+        return;
+    }
+    for (int d = 0; d < nr_dirs; d++) {
+        snprintf(paths[d], sizeof(paths[d]), "%s/disk%d", base, d);
+        mkdir(paths[d], 0755);
+        dirs[d] = paths[d];
+    }
+    rs_store *store = rs_store_new(rs, dirs, nr_dirs);
+    for (int i = 0; i < ds; i++) {
+        data[i] = malloc(block_size);
+        out[i] = malloc(block_size);
+        for (int j = 0; j < block_size; j++) {
+            data[i][j] = (unsigned char)rand();
+        }
+    }
+
+    /* the object contents only differ in their first byte */
+    for (int o = 0; o < objects; o++) {
+        snprintf(name, sizeof(name), "obj%d", o);
+        data[0][0] = (unsigned char)o;
+        errors += rs_store_put(store, name, data, block_size) != 0;
+    }
+
+    /* one disk answers every read delay_us late */
+    rs_store_throttle(store, 0, delay_us);
+    for (int mode = 0; mode < 2; mode++) {
+        for (int o = 0; o < objects; o++) {
+            rs_store_stats st;
+            snprintf(name, sizeof(name), "obj%d", o);
+            data[0][0] = (unsigned char)o;
+            if (rs_store_get(store, name, out, block_size, mode == 0 ? RS_STORE_DATA_FIRST : 0, &st) != 0) {
+                errors++;
+                continue;
+            }
+            for (int i = 0; i < ds; i++) {
+                errors += memcmp(out[i], data[i], block_size) != 0;
+            }
+            lat[mode][o] = st.wait_us;
+            parity_used += mode == 1 && st.parity_used > 0;
+        }
+        qsort(lat[mode], objects, sizeof(double), cmp_double);
+        printf("%s: p50 %.0f us, p99 %.0f us\n", mode == 0 ? "Data shards only" : "Any 4 of 6      ",
+               lat[mode][objects / 2], lat[mode][objects * 99 / 100]);
+    }
+    printf("%d of %d k-of-n reads decoded with parity\n", parity_used, objects);
+
+    /* a lost shard file is read around */
+    snprintf(name, sizeof(name), "obj%d", 7);
+    data[0][0] = 7;
+    snprintf(paths[0], sizeof(paths[0]), "%s/disk%d/%s.%d", base, (int)((name_hash(name) + 1) % nr_dirs), name, 1);
+    unlink(paths[0]);
+    rs_store_throttle(store, 0, 0);
+    if (rs_store_get(store, name, out, block_size, RS_STORE_DATA_FIRST, NULL) != 0 ||
+        memcmp(out[1], data[1], block_size) != 0) {
+        errors++;
+    }
+
+    for (int o = 0; o < objects; o++) {
+        snprintf(name, sizeof(name), "obj%d", o);
+        rs_store_remove(store, name);
+    }
+    rs_store_release(store);
+    for (int d = 0; d < nr_dirs; d++) {
+        snprintf(paths[d], sizeof(paths[d]), "%s/disk%d", base, d);
+        rmdir(paths[d]);
+    }
+    rmdir(base);
+    printf(errors == 0 ? "Every object read back correctly\n" : "Found %d errors\n", errors);
+
+    for (int i = 0; i < ds; i++) {
+        free(data[i]);
+        free(out[i]);
+    }
+    reed_solomon_release(rs);
+}
+
+void test_lrc() {
+    printf("\n=== Test 17: Locally Repairable Code ===\n");
 
+    int ds = 128, groups = 8, gps = 7, block_size = 64 * 1024;
+    reed_solomon_lrc *lrc = reed_solomon_lrc_new(ds, groups, gps);
+    int n = lrc->shards;
+    unsigned char *buf = malloc((size_t)n * block_size);
+    unsigned char *orig = malloc((size_t)n * block_size);
+    unsigned char *shards[DATA_SHARDS_MAX], *rs_shards[DATA_SHARDS_MAX];
+    unsigned char marks[DATA_SHARDS_MAX], reads[DATA_SHARDS_MAX];
+    struct timespec start, end;
+    int errors = 0;
+
+    for (int i = 0; i < n; i++) {
+        shards[i] = buf + (size_t)i * block_size;
+    }
+    for (int i = 0; i < ds * block_size; i++) {
+        buf[i] = (unsigned char)rand();
+    }
+    reed_solomon_lrc_encode(lrc, shards, block_size);
+    memcpy(orig, buf, (size_t)n * block_size);
+
+    /* the global parities are plain reed_solomon parity of the data */
+    for (int i = 0; i < ds; i++) {
+        rs_shards[i] = shards[i];
+    }
+    for (int i = 0; i < gps; i++) {
+        rs_shards[ds + i] = shards[ds + groups + i];
+    }
+
+    /* one lost data shard: its group against the whole stripe */
+    memset(marks, 0, n);
+    marks[37] = 1;
+    int local_reads = reed_solomon_lrc_repair_reads(lrc, marks, reads);
+    memset(shards[37], 0, block_size);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    errors += reed_solomon_lrc_reconstruct(lrc, shards, marks, block_size) != 0;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double lrc_ms = get_time_ms(start, end);
+    errors += memcmp(buf, orig, (size_t)n * block_size) != 0;
+
+    memset(shards[37], 0, block_size);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    errors += reed_solomon_reconstruct(lrc->rs, rs_shards, marks, ds + gps, block_size) != 0;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    errors += memcmp(buf, orig, (size_t)n * block_size) != 0;
+    printf("One lost shard: %d reads, %.3f ms (global only: %d reads, %.3f ms)\n",
+           local_reads, lrc_ms, ds, get_time_ms(start, end));
+
+    /* random losses; anything up to gps shards must come back */
+    int patterns = 200, rebuilt = 0;
+    for (int t = 0; t < patterns; t++) {
+        int lost = 1 + rand() % (gps + 2);
+        memset(marks, 0, n);
+        for (int e = 0; e < lost; e++) {
+            int i = rand() % n;
+            marks[i] = 1;
+            memset(shards[i], 0, block_size);
+        }
+        lost = 0;
+        for (int i = 0; i < n; i++) {
+            lost += marks[i];
+        }
+        int planned = reed_solomon_lrc_repair_reads(lrc, marks, reads);
+        int ret = reed_solomon_lrc_reconstruct(lrc, shards, marks, block_size);
+        if (ret == 0) {
+            rebuilt++;
+            errors += memcmp(buf, orig, (size_t)n * block_size) != 0;
+        } else {
+            memcpy(buf, orig, (size_t)n * block_size);
+        }
+        errors += (ret == 0) != (planned >= 0);
+        errors += lost <= gps && ret != 0;
+    }
+    printf("%d of %d loss patterns rebuilt\n", rebuilt, patterns);
+    printf(errors == 0 ? "Local and global repair recovered correctly\n" : "Found %d errors\n", errors);
+
+    free(buf);
+    free(orig);
+    reed_solomon_lrc_release(lrc);
+}
+
+void test_progressive() {
+    printf("\n=== Test 18: Progressive Encoding ===\n");
+
+    int ds = 128, ps = 7, block_size = 64 * 1024;
+    int matrices[2] = {RS_MATRIX_VANDERMONDE, RS_MATRIX_CAUCHY};
+    unsigned char *data[DATA_SHARDS_MAX], *fec[DATA_SHARDS_MAX], *expect[DATA_SHARDS_MAX];
+    int order[DATA_SHARDS_MAX];
+    unsigned char *buf = malloc((size_t)(ds + 2 * ps) * block_size);
+    struct timespec start, end;
+    int errors = 0;
+
+    for (int i = 0; i < ds; i++) {
+        data[i] = buf + (size_t)i * block_size;
+    }
+    for (int i = 0; i < ps; i++) {
+        fec[i] = buf + (size_t)(ds + i) * block_size;
+        expect[i] = buf + (size_t)(ds + ps + i) * block_size;
+    }
+    for (size_t i = 0; i < (size_t)ds * block_size; i++) {
+        buf[i] = (unsigned char)rand();
+    }
+
+    for (int m = 0; m < 2; m++) {
+        reed_solomon *rs = reed_solomon_new2(ds, ps, matrices[m]);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        reed_solomon_encode(rs, data, expect, block_size);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double encode_ms = get_time_ms(start, end);
+
+        /* shards turn up in a random order */
+        for (int i = 0; i < ds; i++) {
+            order[i] = i;
+        }
+        for (int i = ds - 1; i > 0; i--) {
+            int j = rand() % (i + 1);
+            int t = order[i];
+            order[i] = order[j];
+            order[j] = t;
+        }
+        memset(fec[0], 0xa5, (size_t)ps * block_size);
+
+        rs_encoder enc;
+        int ret = reed_solomon_encoder_init(&enc, rs, fec, block_size);
+        for (int i = 0; i < ds - 1 && ret == 0; i++) {
+            ret = reed_solomon_encoder_add(&enc, order[i], data[order[i]]);
+        }
+        errors += ret != 0;
+        errors += reed_solomon_encoder_add(&enc, order[0], data[order[0]]) != -1;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        ret = reed_solomon_encoder_add(&enc, order[ds - 1], data[order[ds - 1]]);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        errors += ret != 1;
+        for (int i = 0; i < ps; i++) {
+            errors += memcmp(fec[i], expect[i], block_size) != 0;
+        }
+        printf("%s: parity ready %.3f ms after the last shard (whole stripe: %.3f ms)\n",
+               m == 0 ? "Vandermonde" : "Cauchy", get_time_ms(start, end), encode_ms);
+        reed_solomon_release(rs);
+    }
+    printf(errors == 0 ? "Progressive parity matches reed_solomon_encode\n" : "Found %d errors\n", errors);
+    free(buf);
+}
+
+typedef struct {
+    rs_fec_decoder *dec;
+    int sent;
+    int got[400];
+} fec_link;
+
+static void fec_link_deliver(void *arg, const unsigned char *buf, int len) {
+    fec_link *link = arg;
+    int id = len >= 2 ? buf[0] + (buf[1] << 8) : -1;
+    if (id < 0 || id >= 400 || len != 20 + id % 50) {
+        return;
+    }
+    for (int i = 2; i < len; i++) {
+        if (buf[i] != (unsigned char)(id * 7 + i)) {
+            return;
+        }
+    }
+    link->got[id]++;
+}
+
+/* drops every 7th packet on the wire and every packet of group 5 after its first */
+static void fec_link_send(void *arg, const unsigned char *pkt, int len) {
+    fec_link *link = arg;
+    int n = link->sent++;
+    if (n % 7 == 3 || (n / 13 == 5 && n % 13 > 0)) {
+        return;
+    }
+    rs_fec_decode(link->dec, pkt, len, fec_link_deliver, link);
+}
+
+void test_fec() {
+    printf("\n=== Test 19: Packet FEC Session ===\n");
+
+    int ds = 10, ps = 3, packets = 400, errors = 0;
+    unsigned char payload[80];
+    fec_link link;
+    rs_fec_stats st;
+
+    memset(&link, 0, sizeof(link));
+    rs_fec_encoder *enc = rs_fec_encoder_new(ds, ps);
+    link.dec = rs_fec_decoder_new(ds, ps, 4);
+
+    for (int id = 0; id < packets; id++) {
+        int len = 20 + id % 50;
+        for (int i = 0; i < len; i++) {
+            payload[i] = (unsigned char)(id * 7 + i);
+        }
+        payload[0] = id & 0xff;
+        payload[1] = id >> 8;
+        errors += rs_fec_encode(enc, payload, len, fec_link_send, &link) != 0;
+    }
+    errors += rs_fec_encode(enc, payload, RS_FEC_PAYLOAD_MAX + 1, fec_link_send, &link) != -1;
+    errors += rs_fec_decode(link.dec, payload, 3, fec_link_deliver, &link) != -1;
+
+    int delivered = 0, dups = 0;
+    for (int id = 0; id < packets; id++) {
+        delivered += link.got[id] > 0;
+        dups += link.got[id] > 1;
+    }
+    rs_fec_decoder_stats(link.dec, &st);
+    printf("%d of %d payloads delivered, %llu rebuilt from parity, %llu groups expired\n", delivered, packets,
+           st.recovered, st.expired);
+    /* everything but the nine lost data packets of group 5 */
+    errors += delivered != packets - (ds - 1) || dups != 0 || st.expired != 1 || st.bad != 1;
+    printf(errors == 0 ? "Lost packets recovered correctly\n" : "Found %d errors\n", errors);
+
+    rs_fec_encoder_release(enc);
+    rs_fec_decoder_release(link.dec);
+}
+
+void test_crc() {
+    printf("\n=== Test 20: Fused Shard CRC32C ===\n");
+
+    int ds = 10, ps = 4, n = ds + ps, block_size = 1 << 20;
+    int matrices[2] = {RS_MATRIX_VANDERMONDE, RS_MATRIX_CAUCHY};
+    unsigned char *shards[DATA_SHARDS_MAX], *saved[DATA_SHARDS_MAX];
+    unsigned char marks[DATA_SHARDS_MAX];
+    unsigned int crcs[DATA_SHARDS_MAX];
+    unsigned char *buf = malloc((size_t)2 * n * block_size);
+    struct timespec start, end;
+    int errors = 0;
+
+    /* check value, chaining, and the three stream path against the tables */
+    errors += reed_solomon_crc32c(0, (const unsigned char *)"123456789", 9) != 0xe3069283;
+    errors += reed_solomon_crc32c(reed_solomon_crc32c(0, (const unsigned char *)"1234", 4),
+                                  (const unsigned char *)"56789", 5) != 0xe3069283;
+    for (int i = 0; i < 100000; i++) {
+        buf[i] = (unsigned char)rand();
+    }
+    for (int len = 0; len < 100000; len = len * 3 + 1 + rand() % 7) {
+        errors += crc32c_raw(~0u, buf + 3, len) != crc32c_sw(~0u, buf + 3, len);
+    }
+
+    for (int i = 0; i < n; i++) {
+        shards[i] = buf + (size_t)i * block_size;
+        saved[i] = buf + (size_t)(n + i) * block_size;
+    }
+    for (size_t i = 0; i < (size_t)ds * block_size; i++) {
+        buf[i] = (unsigned char)rand();
+    }
+
+    for (int m = 0; m < 2; m++) {
+        reed_solomon *rs = reed_solomon_new2(ds, ps, matrices[m]);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        reed_solomon_encode(rs, shards, shards + ds, block_size);
+        for (int i = 0; i < n; i++) {
+            crcs[i] = reed_solomon_crc32c(0, shards[i], block_size);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double separate_ms = get_time_ms(start, end);
+        for (int i = 0; i < n; i++) {
+            memcpy(saved[i], shards[i], block_size);
+        }
+
+        unsigned int fused[DATA_SHARDS_MAX];
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        errors += reed_solomon_encode_crc(rs, shards, shards + ds, block_size, fused) != 0;
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        errors += memcmp(fused, crcs, n * sizeof(unsigned int)) != 0;
+        printf("%s: encode with CRCs %.3f ms, encode then CRC pass %.3f ms\n",
+               m == 0 ? "Vandermonde" : "Cauchy", get_time_ms(start, end), separate_ms);
+
+        /* nothing wrong: one checking pass, nothing marked */
+        memset(marks, 0, n);
+        errors += reed_solomon_reconstruct_crc(rs, shards, marks, crcs, n, block_size) != 0;
+        for (int i = 0; i < n; i++) {
+            errors += marks[i] != 0;
+        }
+
+        /* one shard lost, a data shard read as input and a parity shard silently corrupted */
+        memset(marks, 0, n);
+        marks[7] = 1;
+        memset(shards[7], 0, block_size);
+        shards[3][12345] ^= 0x40;
+        shards[ds + 2][block_size - 1] ^= 1;
+        errors += reed_solomon_reconstruct_crc(rs, shards, marks, crcs, n, block_size) != 0;
+        for (int i = 0; i < n; i++) {
+            errors += marks[i] != (i == 3 || i == 7 || i == ds + 2);
+            errors += memcmp(shards[i], saved[i], block_size) != 0;
+        }
+
+        /* more bad shards than parity */
+        memset(marks, 0, n);
+        for (int i = 0; i < ps + 1; i++) {
+            shards[i * 2][i] ^= 0xff;
+        }
+        errors += reed_solomon_reconstruct_crc(rs, shards, marks, crcs, n, block_size) != -1;
+        for (int i = 0; i < n; i++) {
+            memcpy(shards[i], saved[i], block_size);
+        }
+        reed_solomon_release(rs);
+    }
+    printf(errors == 0 ? "Corrupted shards detected and rebuilt correctly\n" : "Found %d errors\n", errors);
+    free(buf);
+}
+
+void test_pq() {
+    printf("\n=== Test 21: RAID-6 P+Q Codec ===\n");
+
+    int geometries[][2] = { { 4, 2 }, { 10, 2 }, { 10, 1 }, { 250, 2 } };
+    int sizes[] = { 1, 63, 64, 100, 4096 + 17 };
+    unsigned char *data[DATA_SHARDS_MAX], *fec[2], *expect[2], *saved[2];
+    unsigned int erased[2], fec_nos[2];
+    unsigned char *dec_fec[2];
+    int errors = 0;
+
+    for (int g = 0; g < 4; g++) {
+        int ds = geometries[g][0], ps = geometries[g][1], max = 4096 + 17;
+        reed_solomon *rs = reed_solomon_new2(ds, ps, RS_MATRIX_AUTO);
+        reed_solomon *vm = reed_solomon_new(ds, ps);
+        /* two of each even with one parity shard, for the erasures it cannot take */
+        unsigned char *buf = malloc((size_t)(ds + 6) * max);
+        errors += rs == NULL || rs->matrix != RS_MATRIX_PQ;
+        /* P+Q is opt-in, shards already stored came from Vandermonde */
+        errors += vm == NULL || vm->matrix != RS_MATRIX_VANDERMONDE;
+        reed_solomon_release(vm);
+        for (int i = 0; i < ds; i++) {
+            data[i] = buf + (size_t)i * max;
+        }
+        for (int i = 0; i < 2; i++) {
+            fec[i] = buf + (size_t)(ds + i) * max;
+            expect[i] = buf + (size_t)(ds + 2 + i) * max;
+            saved[i] = buf + (size_t)(ds + 4 + i) * max;
+        }
+        for (size_t i = 0; i < (size_t)ds * max; i++) {
+            buf[i] = (unsigned char)rand();
+        }
+
+        for (int z = 0; z < 5; z++) {
+            int bs = sizes[z];
+            /* the generic matrix path is the reference, for both bodies of the engine */
+            code_some_shards(rs->parity, data, expect, ds, ps, bs);
+            for (int k = 0; k < 2; k++) {
+                fec_set_kernel(k == 0 ? FEC_KERNEL_SCALAR : FEC_KERNEL_AUTO);
+                reed_solomon_encode(rs, data, fec, bs);
+                for (int i = 0; i < ps; i++) {
+                    errors += memcmp(fec[i], expect[i], bs) != 0;
+                }
+            }
+
+            /* every single and double erasure */
+            for (int x = 0; x < ds; x += 1 + ds / 16) {
+                for (int y = x; y < ds; y += 1 + ds / 16) {
+                    int n = x == y ? 1 : 2;
+                    for (int f = 0; f < (n == 1 ? ps : 1); f++) {
+                        /* given out of order, decode sorts them */
+                        int lost[2] = { y, x };
+                        for (int i = 0; i < n; i++) {
+                            erased[i] = lost[i];
+                            fec_nos[i] = n == 1 ? f : n - 1 - i;
+                            dec_fec[i] = fec[fec_nos[i]];
+                            memcpy(saved[i], data[lost[i]], bs);
+                            memset(data[lost[i]], 0xa5, bs);
+                        }
+                        int expect_ret = n > ps ? -1 : 0;
+                        errors += reed_solomon_decode(rs, data, bs, dec_fec, fec_nos, erased, n) != expect_ret;
+                        for (int i = 0; i < n; i++) {
+                            errors += expect_ret == 0 && memcmp(data[lost[i]], saved[i], bs) != 0;
+                            memcpy(data[lost[i]], saved[i], bs);
+                        }
+                    }
+                }
+            }
+        }
+        fec_set_kernel(FEC_KERNEL_AUTO);
+        free(buf);
+        reed_solomon_release(rs);
+    }
+
+    reed_solomon *a = reed_solomon_acquire(10, 2, RS_MATRIX_AUTO);
+    reed_solomon *b = reed_solomon_acquire(10, 2, RS_MATRIX_PQ);
+    errors += a == NULL || a != b || reed_solomon_new2(10, 3, RS_MATRIX_PQ) != NULL;
+    reed_solomon_release(a);
+    reed_solomon_release(b);
+
+    /* 10+2 with 1 MB shards against the Vandermonde codec and a plain copy of the data */
+    int ds = 10, ps = 2, bs = 1 << 20;
+    unsigned char *buf = malloc((size_t)(2 * ds + ps) * bs);
+    for (int i = 0; i < ds; i++) {
+        data[i] = buf + (size_t)i * bs;
+    }
+    for (int i = 0; i < ps; i++) {
+        fec[i] = buf + (size_t)(ds + i) * bs;
+    }
+    for (size_t i = 0; i < (size_t)ds * bs; i++) {
+        buf[i] = (unsigned char)rand();
+    }
+    reed_solomon *pq = reed_solomon_new2(ds, ps, RS_MATRIX_PQ);
+    reed_solomon *vm = reed_solomon_new2(ds, ps, RS_MATRIX_VANDERMONDE);
+    double ms[3];
+    for (int t = 0; t < 3; t++) {
+        struct timespec start, end;
+        reed_solomon_encode(t == 0 ? pq : vm, data, fec, bs);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int r = 0; r < 20; r++) {
+            if (t == 2) {
+                memcpy(buf + (size_t)(ds + ps) * bs, buf, (size_t)ds * bs);
+            } else {
+                reed_solomon_encode(t == 0 ? pq : vm, data, fec, bs);
+            }
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        ms[t] = get_time_ms(start, end) / 20;
+    }
+    reed_solomon_encode(pq, data, fec, bs);
+    erased[0] = 3;
+    erased[1] = 7;
+    fec_nos[0] = 0;
+    fec_nos[1] = 1;
+    dec_fec[0] = fec[0];
+    dec_fec[1] = fec[1];
+    memcpy(buf + (size_t)(ds + ps) * bs, data[3], bs);
+    memcpy(buf + (size_t)(ds + ps + 1) * bs, data[7], bs);
+    memset(data[3], 0, bs);
+    memset(data[7], 0, bs);
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    errors += reed_solomon_decode(pq, data, bs, dec_fec, fec_nos, erased, 2) != 0;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    errors += memcmp(buf + (size_t)(ds + ps) * bs, data[3], bs) != 0;
+    errors += memcmp(buf + (size_t)(ds + ps + 1) * bs, data[7], bs) != 0;
+    printf("10+2, 1 MB shards: P+Q encode %.3f ms, Vandermonde %.3f ms, memcpy of the data %.3f ms, "
+           "two lost shards rebuilt in %.3f ms\n", ms[0], ms[1], ms[2], get_time_ms(start, end));
+    reed_solomon_release(pq);
+    reed_solomon_release(vm);
+    free(buf);
+
+    printf(errors == 0 ? "P+Q parity and recovery match the matrix codec\n" : "Found %d errors\n", errors);
+}
+
+/* the object copied into padded shards of its own, as callers had to */
+static int object_copy_encode(reed_solomon *rs, unsigned char *data, long long size, int bs, int stripes,
+                              unsigned char *buf, unsigned char **shards) {
+    int ds = rs->data_shards, ps = rs->parity_shards;
+    for (int k = 0; k < stripes * rs->shards; k++) {
+        shards[k] = buf + (size_t)k * bs;
+    }
+    for (int k = 0; k < stripes * ds; k++) {
+        long long off = (long long)k * bs, n = size - off < bs ? size - off : bs;
+        n = n < 0 ? 0 : n;
+        memcpy(shards[k], data + off, n);
+        memset(shards[k] + n, 0, bs - n);
+    }
+    int err = 0;
+    for (int s = 0; s < stripes; s++) {
+        err |= reed_solomon_encode(rs, shards + s * ds, shards + stripes * ds + s * ps, bs);
+    }
+    return err;
+}
+
+void test_object() {
+    printf("\n=== Test 22: Object Encode and Join ===\n");
+
+    long long sizes[] = { 0, 1, 639, 640, 641, 12345, 1000007, (10LL << 20) + 3 };
+    int block_sizes[] = { 0, 0, 0, 0, 0, 0, 4096, 0 };
+    int matrices[2] = { RS_MATRIX_VANDERMONDE, RS_MATRIX_CAUCHY };
+    int ds = 10, ps = 4, errors = 0;
+
+    for (int m = 0; m < 2; m++) {
+        reed_solomon *rs = reed_solomon_new2(ds, ps, matrices[m]);
+        for (int z = 0; z < 8; z++) {
+            long long size = sizes[z];
+            unsigned char *data = malloc(size + 1);
+            unsigned char *dest = malloc(size + 1);
+            for (long long i = 0; i < size; i++) {
+                data[i] = (unsigned char)rand();
+            }
+
+            struct timespec start, end;
+            rs_object obj, back;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            errors += reed_solomon_object_encode(&obj, rs, data, size, block_sizes[z]) != 0;
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            double object_ms = get_time_ms(start, end);
+            int bs = obj.block_size;
+
+            /* full shards are views, parity is that of copied and padded shards */
+            for (int k = 0; k < obj.stripes * ds; k++) {
+                long long off = (long long)k * bs;
+                errors += off + bs <= size && obj.shards[k] != data + off;
+                errors += off + bs > size && obj.shards[k] >= data && obj.shards[k] < data + size;
+            }
+            unsigned char *copy = malloc((size_t)obj.nr_shards * bs);
+            unsigned char **copy_shards = malloc(obj.nr_shards * sizeof(unsigned char *));
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            errors += object_copy_encode(rs, data, size, bs, obj.stripes, copy, copy_shards) != 0;
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            for (int k = 0; k < obj.nr_shards; k++) {
+                errors += memcmp(obj.shards[k], copy_shards[k], bs) != 0;
+            }
+
+            /* read side: stored shards land in place, up to ps of every stripe lost */
+            unsigned char *marks = calloc(obj.nr_shards, 1);
+            errors += reed_solomon_object_open(&back, rs, dest, size, block_sizes[z]) != 0;
+            for (int s = 0; s < obj.stripes; s++) {
+                for (int i = 0; i < ps; i++) {
+                    marks[s * ds + rand() % ds] = 1;
+                }
+            }
+            for (int k = 0; k < back.nr_shards; k++) {
+                if (!marks[k]) {
+                    memcpy(back.shards[k], obj.shards[k], bs);
+                }
+            }
+            errors += reed_solomon_object_join(&back, marks) != 0;
+            errors += size > 0 && memcmp(dest, data, size) != 0;
+            if (size > (1 << 20)) {
+                printf("%s, %lld bytes in %d byte shards: encoded in place in %.3f ms, "
+                       "copied into shards and encoded in %.3f ms\n",
+                       m == 0 ? "Vandermonde" : "Cauchy", size, bs, object_ms, get_time_ms(start, end));
+            }
+
+            reed_solomon_object_release(&obj);
+            reed_solomon_object_release(&back);
+            free(marks);
+            free(copy);
+            free(copy_shards);
+            free(data);
+            free(dest);
+        }
+        reed_solomon_release(rs);
+    }
+    printf(errors == 0 ? "Objects rebuilt and joined correctly\n" : "Found %d errors\n", errors);
+}
+
+typedef struct {
+    reed_solomon *rs;
+    rs_slab_pool *slabs;
+    int block_size;
+    int errors;
+} slab_job;
+
+static unsigned char slab_byte(int task, int i, int j) {
+    return (unsigned char)(task * 31 + i * 7 + j * 13 + (j >> 8));
+}
+
+/* a stripe in a slab taken on the worker's own node, encoded, two shards lost and rebuilt */
+static void slab_task(void *arg, int task) {
+    slab_job *job = arg;
+    int ds = job->rs->data_shards, n = job->rs->shards, bs = job->block_size;
+    unsigned char *shards[DATA_SHARDS_MAX];
+    unsigned char marks[DATA_SHARDS_MAX] = { 0 };
+    unsigned char *slab = rs_slab_get(job->slabs, RS_SLAB_LOCAL);
+    int errors = slab == NULL || rs_slab_shards(job->slabs, slab, shards, n, bs) != 0;
+
+    if (errors == 0) {
+        errors += ((uintptr_t)slab & (RS_SLAB_HUGE - 1)) != 0;
+        for (int i = 0; i < ds; i++) {
+            errors += ((uintptr_t)shards[i] & 63) != 0;
+            for (int j = 0; j < bs; j++) {
+                shards[i][j] = slab_byte(task, i, j);
+            }
+        }
+        errors += reed_solomon_encode(job->rs, shards, shards + ds, bs) != 0;
+        int lost[2] = { task % ds, (task + 3) % ds };
+        for (int l = 0; l < 2; l++) {
+            memset(shards[lost[l]], 0, bs);
+            marks[lost[l]] = 1;
+        }
+        errors += reed_solomon_reconstruct(job->rs, shards, marks, n, bs) != 0;
+        for (int l = 0; l < 2; l++) {
+            for (int j = 0; j < bs; j++) {
+                errors += shards[lost[l]][j] != slab_byte(task, lost[l], j);
+            }
+        }
+    }
+    rs_slab_put(job->slabs, slab);
+    __sync_fetch_and_add(&job->errors, errors);
+}
+
+/* best of reps encodes, in GB/s of data */
+static double slab_encode_rate(reed_solomon *rs, unsigned char **shards, int bs, int reps) {
+    double best = 0;
+    for (int r = 0; r < reps; r++) {
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        reed_solomon_encode(rs, shards, shards + rs->data_shards, bs);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double rate = (double)rs->data_shards * bs / get_time_ms(start, end) / 1e6;
+        best = rate > best ? rate : best;
+    }
+    return best;
+}
+
+void test_slab() {
+    printf("\n=== Test 23: NUMA Shard Slabs ===\n");
+
+    int ds = 10, ps = 4, bs = 256 * 1024, nr_tasks = 16, errors = 0;
+    reed_solomon *rs = reed_solomon_new(ds, ps);
+    rs_slab_pool *slabs = rs_slab_pool_new((size_t)(ds + ps) * bs);
+    rs_pool *pool = rs_pool_new(2);
+    if (rs == NULL || slabs == NULL || pool == NULL) {
+        fprintf(stderr, "Failed to set up slab pool\n");
+        goto out;
+    }
+
+    /* every worker takes slabs on its node, put back slabs are reused */
+    slab_job job = { rs, slabs, bs, 0 };
+    errors += rs_slab_size(slabs) % RS_SLAB_HUGE != 0 || rs_slab_size(slabs) < (size_t)(ds + ps) * bs;
+    errors += rs_pool_run(pool, nr_tasks, slab_task, &job, NULL) != 0;
+    errors += job.errors;
+    rs_slab_stats st;
+    rs_slab_pool_stats(slabs, &st);
+    errors += st.out != 0 || st.mapped > rs_pool_threads(pool) + 1 || st.mapped + st.reused != nr_tasks;
+    printf("%d node(s), %d slabs of %zu MB mapped for %d stripes (%d on hugetlbfs, %d bound), %d reused\n",
+           rs_slab_nodes(), st.mapped, rs_slab_size(slabs) >> 20, nr_tasks, st.huge, st.bound, st.reused);
+
+    unsigned char *slab = rs_slab_get(slabs, 0);
+    unsigned char *shards[DATA_SHARDS_MAX];
+    errors += slab == NULL;
+    errors += rs_slab_shards(slabs, slab, shards, (int)(rs_slab_size(slabs) / bs) + 1, bs) != -1;
+    rs_slab_put(slabs, slab);
+    errors += rs_slab_get(slabs, RS_SLAB_NODES_MAX) != NULL;
+
+    /* the allocation hooks: small blocks from malloc, large ones mapped, zeroed by calloc */
+    size_t sizes[3] = { 100, RS_SLAB_HOOK_MIN - 1, 3 * RS_SLAB_HOOK_MIN + 5 };
+    for (int z = 0; z < 3; z++) {
+        unsigned char *a = rs_slab_calloc(1, sizes[z]);
+        unsigned char *b = rs_slab_malloc(sizes[z]);
+        errors += a == NULL || b == NULL;
+        if (a != NULL && b != NULL) {
+            errors += ((uintptr_t)a & 63) != 0 || ((uintptr_t)b & 63) != 0;
+            for (size_t i = 0; i < sizes[z]; i++) {
+                errors += a[i] != 0;
+            }
+            memset(b, 0xa5, sizes[z]);
+        }
+        rs_slab_free(a);
+        rs_slab_free(b);
+    }
+    errors += rs_slab_calloc((size_t)-1 / 2, 4) != NULL;
+
+    /* a freed mapping serves the next request of about its size, zeroed again by calloc */
+    unsigned char *first = rs_slab_malloc(3 * RS_SLAB_HOOK_MIN);
+    if (first != NULL) {
+        memset(first, 0x5a, 3 * RS_SLAB_HOOK_MIN);
+    }
+    rs_slab_free(first);
+    unsigned char *again = rs_slab_calloc(3, RS_SLAB_HOOK_MIN - 100);
+    errors += first == NULL || again != first;
+    for (size_t i = 0; again != NULL && i < 3 * (RS_SLAB_HOOK_MIN - 100); i++) {
+        errors += again[i] != 0;
+    }
+    rs_slab_free(again);
+    rs_slab_trim();
+
+    /* one stripe of 1 MB shards, each its own malloc or all in one slab */
+    int big = 1 << 20;
+    rs_slab_pool *big_slabs = rs_slab_pool_new((size_t)(ds + ps) * big);
+    unsigned char *scattered[DATA_SHARDS_MAX] = { NULL };
+    unsigned char *slabbed[DATA_SHARDS_MAX];
+    unsigned char *big_slab = big_slabs != NULL ? rs_slab_get(big_slabs, RS_SLAB_LOCAL) : NULL;
+    if (big_slab != NULL && rs_slab_shards(big_slabs, big_slab, slabbed, ds + ps, big) == 0) {
+        for (int i = 0; i < ds + ps; i++) {
+            scattered[i] = malloc(big);
+            errors += scattered[i] == NULL;
+        }
+        for (int i = 0; i < ds && scattered[i] != NULL; i++) {
+            for (int j = 0; j < big; j++) {
+                scattered[i][j] = slabbed[i][j] = slab_byte(1, i, j);
+            }
+        }
+        if (errors == 0) {
+            double malloc_rate = slab_encode_rate(rs, scattered, big, 10);
+            double slab_rate = slab_encode_rate(rs, slabbed, big, 10);
+            for (int i = ds; i < ds + ps; i++) {
+                errors += memcmp(scattered[i], slabbed[i], big) != 0;
+            }
+            printf("%d+%d, 1 MB shards: %.2f GB/s from scattered mallocs, %.2f GB/s from a slab\n",
+                   ds, ps, malloc_rate, slab_rate);
+        }
+        for (int i = 0; i < ds + ps; i++) {
+            free(scattered[i]);
+        }
+    } else {
+        errors++;
+    }
+    rs_slab_put(big_slabs, big_slab);
+    rs_slab_pool_release(big_slabs);
+
+    printf(errors == 0 ? "Slab stripes encoded and rebuilt correctly\n" : "Found %d errors\n", errors);
+
+out:
+    rs_pool_release(pool);
+    rs_slab_pool_release(slabs);
+    reed_solomon_release(rs);
+}
+
+int main() {
     test_no_errors();
     test_erasures();
     test_random_errors();
+    test_kernels();
+    test_decode_cache();
+    test_multithreaded();
+    test_reconstruct_some();
+    test_verify();
+    test_update();
+    test_cauchy();
+    test_registry();
+    test_correct();
+    test_wide_stripe();
+    test_stats();
+    test_batch();
+    test_store();
+    test_lrc();
+    test_progressive();
+    test_fec();
+    test_crc();
+    test_pq();
+    test_object();
+    test_slab();
 
     return 0;
 }
\ No newline at end of file
@@ -2,6 +2,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <pthread.h>
+#include <stdint.h>
 
 #include "rs.h"
 
@@ -9,14 +11,64 @@
 #define GF_SIZE ((1 << GF_BITS) - 1)
 #define DEB(x)
 #define DDB(x)
+
+/*
+ * Built with -DRS_STATS, TICK/TOCK time a section in cycles, STAT_ADD
+ * bumps a counter of rs_stats_global and STATS(x) keeps x; otherwise
+ * they all compile to nothing.
+ */
+#ifdef RS_STATS
+static rs_stats rs_stats_global;
+
+#if defined(__x86_64__) || defined(__i386__)
+static inline long long rdtsc(void)
+{
+    unsigned long low, hi;
+    asm volatile ("rdtsc" : "=d" (hi), "=a" (low));
+    return ( (((long long)hi) << 32) | ((long long) low));
+}
+#else
+#include <time.h>
+/* no cycle counter everywhere, nanoseconds instead */
+static inline long long rdtsc(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+#endif
+
+#define STATS(x) x
+#define TICK(x) ((x) = rdtsc())
+#define TOCK(x) ((x) = rdtsc() - (x))
+#define STAT_ADD(field, v) __atomic_fetch_add(&rs_stats_global.field, (unsigned long long)(v), __ATOMIC_RELAXED)
+
+/* set by reed_solomon_stats_mute while this thread codes part of a stripe counted elsewhere */
+static __thread int stats_muted;
+
+/* stripe counters, unlike the work counters, skip the muted byte ranges */
+#define STAT_STRIPE(field, v) do{ if(!stats_muted) STAT_ADD(field, v); }while(0)
+
+static void rs_stats_stripe(int erasures) {
+    STAT_STRIPE(stripes_reconstructed, 1);
+    STAT_STRIPE(erasures[erasures < RS_STATS_ERASURES ? erasures : RS_STATS_ERASURES - 1], 1);
+}
+#else
+#define STATS(x)
 #define TICK(x)
 #define TOCK(x)
+#define STAT_ADD(field, v)
+#define STAT_STRIPE(field, v)
+#endif
 
 typedef unsigned char gf;
 
-static gf gf_exp[2*GF_SIZE];
-static int gf_log[GF_SIZE + 1];
-static gf inverse[GF_SIZE+1];
+/*
+ * gf_exp, gf_log, inverse, gf_mul_table and the per-coefficient kernel
+ * tables, all read-only data produced by gf_gen.c.  Bit c of
+ * gf_bitrow[e][r] is bit r of e * 2^c: row r of e as an 8x8 bit matrix.
+ */
+#include "gf_tables.h"
 
 static inline gf modnn(int x) {
     while (x >= GF_SIZE) {
@@ -28,56 +80,12 @@ static inline gf modnn(int x) {
 
 #define SWAP(a,b,t) {t tmp; tmp=a; a=b; b=tmp;}
 
-static gf gf_mul_table[(GF_SIZE + 1)*(GF_SIZE + 1)]
-__attribute__((aligned (16)));
-
 #define gf_mul(x,y) gf_mul_table[(x<<8)+y]
-#define USE_GF_MULC register gf * __gf_mulc_
+#define USE_GF_MULC register const gf * __gf_mulc_
 #define GF_MULC0(c) __gf_mulc_ = &gf_mul_table[(c)<<8]
 #define GF_ADDMULC(dst, x) dst ^= __gf_mulc_[x]
 #define GF_MULC(dst, x) dst = __gf_mulc_[x]
 
-static void init_mul_table(void)
-{
-    int i, j;
-    for (i=0; i< GF_SIZE+1; i++)
-        for (j=0; j< GF_SIZE+1; j++)
-            gf_mul_table[(i<<8)+j] = gf_exp[modnn(gf_log[i] + gf_log[j]) ];
-
-    for (j=0; j< GF_SIZE+1; j++)
-        gf_mul_table[j] = gf_mul_table[j<<8] = 0;
-}
-
-static void generate_gf(void) {
-    int i;
-    gf mask;
-    char *Pp =  "101110001";
-    mask = 1;
-    gf_exp[GF_BITS] = 0;
-    for (i = 0; i < GF_BITS; i++, mask <<= 1 ) {
-        gf_exp[i] = mask;
-        gf_log[gf_exp[i]] = i;
-        if ( Pp[i] == '1' )
-            gf_exp[GF_BITS] ^= mask;
-    }
-    gf_log[gf_exp[GF_BITS]] = GF_BITS;
-    mask = 1 << (GF_BITS - 1 ) ;
-    for (i = GF_BITS + 1; i < GF_SIZE; i++) {
-        if (gf_exp[i - 1] >= mask)
-            gf_exp[i] = gf_exp[GF_BITS] ^ ((gf_exp[i - 1] ^ mask) << 1);
-        else
-            gf_exp[i] = gf_exp[i - 1] << 1;
-        gf_log[gf_exp[i]] = i;
-    }
-    gf_log[0] = GF_SIZE ;
-    for (i = 0 ; i < GF_SIZE ; i++)
-        gf_exp[i + GF_SIZE] = gf_exp[i];
-    inverse[0] = 0 ;
-    inverse[1] = 1;
-    for (i=2; i<=GF_SIZE; i++)
-        inverse[i] = gf_exp[GF_SIZE-gf_log[i]];
-}
-
 #define UNROLL 16 
 static void slow_addmul1(gf *dst1, gf *src1, gf c, int sz) {
     USE_GF_MULC ;
@@ -115,12 +123,6 @@ static void slow_addmul1(gf *dst1, gf *src1, gf c, int sz) {
     GF_ADDMULC( *dst , *src );
 }
 
-#define addmul1 slow_addmul1
-
-static void addmul(gf *dst, gf *src, gf c, int sz) {
-    if (c != 0) addmul1(dst, src, c, sz);
-}
-
 #define UNROLL 16 
 static void slow_mul1(gf *dst1, gf *src1, gf c, int sz) {
     USE_GF_MULC ;
@@ -158,10 +160,324 @@ static void slow_mul1(gf *dst1, gf *src1, gf c, int sz) {
     GF_MULC( *dst , *src );
 }
 
-#define mul1 slow_mul1
+/*
+ * SIMD multiply(-accumulate) kernels.
+ *
+ * The PSHUFB kernels split every source byte into two nibbles and look
+ * both up in 16-entry product tables (c * lo, c * (hi << 4)); the GFNI
+ * kernel multiplies by c directly as an 8x8 bit matrix over GF(2).  All
+ * of them hand the unaligned tail to the scalar code, which also stays
+ * the reference the others are tested against.
+ */
+#if defined(__x86_64__) || defined(__i386__)
+#define GF_X86 1
+#include <immintrin.h>
+
+__attribute__((target("ssse3")))
+static inline void ssse3_code1(gf *dst, gf *src, gf c, int sz, int add) {
+    __m128i tlo, thi, mask, x, p;
+    int i = 0;
+
+    tlo = _mm_loadu_si128((const __m128i*)gf_mul_lo[c]);
+    thi = _mm_loadu_si128((const __m128i*)gf_mul_hi[c]);
+    mask = _mm_set1_epi8(0x0f);
+    for (; i + 16 <= sz; i += 16) {
+        x = _mm_loadu_si128((const __m128i*)(src + i));
+        p = _mm_xor_si128(_mm_shuffle_epi8(tlo, _mm_and_si128(x, mask)),
+                _mm_shuffle_epi8(thi, _mm_and_si128(_mm_srli_epi64(x, 4), mask)));
+        if (add)
+            p = _mm_xor_si128(p, _mm_loadu_si128((const __m128i*)(dst + i)));
+        _mm_storeu_si128((__m128i*)(dst + i), p);
+    }
+    if (i < sz) {
+        if (add) slow_addmul1(dst + i, src + i, c, sz - i);
+        else slow_mul1(dst + i, src + i, c, sz - i);
+    }
+}
+
+__attribute__((target("avx2")))
+static inline void avx2_code1(gf *dst, gf *src, gf c, int sz, int add) {
+    __m256i tlo, thi, mask, x, p;
+    int i = 0;
+
+    tlo = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)gf_mul_lo[c]));
+    thi = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)gf_mul_hi[c]));
+    mask = _mm256_set1_epi8(0x0f);
+    for (; i + 32 <= sz; i += 32) {
+        x = _mm256_loadu_si256((const __m256i*)(src + i));
+        p = _mm256_xor_si256(_mm256_shuffle_epi8(tlo, _mm256_and_si256(x, mask)),
+                _mm256_shuffle_epi8(thi, _mm256_and_si256(_mm256_srli_epi64(x, 4), mask)));
+        if (add)
+            p = _mm256_xor_si256(p, _mm256_loadu_si256((const __m256i*)(dst + i)));
+        _mm256_storeu_si256((__m256i*)(dst + i), p);
+    }
+    if (i < sz) {
+        if (add) slow_addmul1(dst + i, src + i, c, sz - i);
+        else slow_mul1(dst + i, src + i, c, sz - i);
+    }
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static inline void avx512_code1(gf *dst, gf *src, gf c, int sz, int add) {
+    __m512i tlo, thi, mask, x, p;
+    int i = 0;
+
+    tlo = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i*)gf_mul_lo[c]));
+    thi = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i*)gf_mul_hi[c]));
+    mask = _mm512_set1_epi8(0x0f);
+    for (; i + 64 <= sz; i += 64) {
+        x = _mm512_loadu_si512((const void*)(src + i));
+        p = _mm512_xor_si512(_mm512_shuffle_epi8(tlo, _mm512_and_si512(x, mask)),
+                _mm512_shuffle_epi8(thi, _mm512_and_si512(_mm512_srli_epi64(x, 4), mask)));
+        if (add)
+            p = _mm512_xor_si512(p, _mm512_loadu_si512((const void*)(dst + i)));
+        _mm512_storeu_si512((void*)(dst + i), p);
+    }
+    if (i < sz) {
+        if (add) slow_addmul1(dst + i, src + i, c, sz - i);
+        else slow_mul1(dst + i, src + i, c, sz - i);
+    }
+}
+
+__attribute__((target("gfni,avx2")))
+static inline void gfni_code1(gf *dst, gf *src, gf c, int sz, int add) {
+    __m256i a, x, p;
+    int i = 0;
+
+    a = _mm256_set1_epi64x((long long)gf_affine[c]);
+    for (; i + 32 <= sz; i += 32) {
+        x = _mm256_loadu_si256((const __m256i*)(src + i));
+        p = _mm256_gf2p8affine_epi64_epi8(x, a, 0);
+        if (add)
+            p = _mm256_xor_si256(p, _mm256_loadu_si256((const __m256i*)(dst + i)));
+        _mm256_storeu_si256((__m256i*)(dst + i), p);
+    }
+    if (i < sz) {
+        if (add) slow_addmul1(dst + i, src + i, c, sz - i);
+        else slow_mul1(dst + i, src + i, c, sz - i);
+    }
+}
+
+__attribute__((target("ssse3")))
+static void ssse3_addmul1(gf *dst, gf *src, gf c, int sz) { ssse3_code1(dst, src, c, sz, 1); }
+__attribute__((target("ssse3")))
+static void ssse3_mul1(gf *dst, gf *src, gf c, int sz) { ssse3_code1(dst, src, c, sz, 0); }
+__attribute__((target("avx2")))
+static void avx2_addmul1(gf *dst, gf *src, gf c, int sz) { avx2_code1(dst, src, c, sz, 1); }
+__attribute__((target("avx2")))
+static void avx2_mul1(gf *dst, gf *src, gf c, int sz) { avx2_code1(dst, src, c, sz, 0); }
+__attribute__((target("avx512f,avx512bw")))
+static void avx512_addmul1(gf *dst, gf *src, gf c, int sz) { avx512_code1(dst, src, c, sz, 1); }
+__attribute__((target("avx512f,avx512bw")))
+static void avx512_mul1(gf *dst, gf *src, gf c, int sz) { avx512_code1(dst, src, c, sz, 0); }
+__attribute__((target("gfni,avx2")))
+static void gfni_addmul1(gf *dst, gf *src, gf c, int sz) { gfni_code1(dst, src, c, sz, 1); }
+__attribute__((target("gfni,avx2")))
+static void gfni_mul1(gf *dst, gf *src, gf c, int sz) { gfni_code1(dst, src, c, sz, 0); }
+#endif
+
+typedef void (*gf_code_fn)(gf *dst, gf *src, gf c, int sz);
+
+static const struct {
+    const char *name;
+    gf_code_fn addmul1;
+    gf_code_fn mul1;
+} gf_kernels[FEC_KERNEL_MAX] = {
+    { "scalar", slow_addmul1, slow_mul1 },
+#ifdef GF_X86
+    { "ssse3", ssse3_addmul1, ssse3_mul1 },
+    { "avx2", avx2_addmul1, avx2_mul1 },
+    { "avx512", avx512_addmul1, avx512_mul1 },
+    { "gfni", gfni_addmul1, gfni_mul1 },
+#else
+    { "ssse3", NULL, NULL },
+    { "avx2", NULL, NULL },
+    { "avx512", NULL, NULL },
+    { "gfni", NULL, NULL },
+#endif
+};
+
+/*
+ * FEC_KERNEL_AUTO until the first coding call (or fec_get_kernel) picks
+ * the fastest kernel; racing callers all pick the same one.
+ */
+static int gf_kernel = FEC_KERNEL_AUTO;
+
+static int resolve_kernel(void);
+
+static inline int current_kernel(void) {
+    int kernel = __atomic_load_n(&gf_kernel, __ATOMIC_ACQUIRE);
+    return kernel != FEC_KERNEL_AUTO ? kernel : resolve_kernel();
+}
+
+static void addmul(gf *dst, gf *src, gf c, int sz) {
+    if (c != 0) gf_kernels[current_kernel()].addmul1(dst, src, c, sz);
+}
 
 static inline void mul(gf *dst, gf *src, gf c, int sz) {
-    if (c != 0) mul1(dst, src, c, sz); else memset(dst, 0, c);
+    if (c != 0) gf_kernels[current_kernel()].mul1(dst, src, c, sz); else memset(dst, 0, sz);
+}
+
+int fec_kernel_supported(int kernel) {
+    switch (kernel) {
+    case FEC_KERNEL_SCALAR:
+        return 1;
+#ifdef GF_X86
+    case FEC_KERNEL_SSSE3:
+        return __builtin_cpu_supports("ssse3");
+    case FEC_KERNEL_AVX2:
+        return __builtin_cpu_supports("avx2");
+    case FEC_KERNEL_AVX512:
+        return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+    case FEC_KERNEL_GFNI:
+        return __builtin_cpu_supports("gfni") && __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return 0;
+    }
+}
+
+static int auto_kernel(void) {
+    /* GFNI is one instruction per vector, PSHUFB needs five */
+    static const int order[] = { FEC_KERNEL_GFNI, FEC_KERNEL_AVX512,
+            FEC_KERNEL_AVX2, FEC_KERNEL_SSSE3, FEC_KERNEL_SCALAR };
+    int i;
+    for (i = 0; !fec_kernel_supported(order[i]); i++)
+        ;
+    return order[i];
+}
+
+/* an explicit fec_set_kernel that got in first wins */
+static int resolve_kernel(void) {
+    int expected = FEC_KERNEL_AUTO;
+    int kernel = auto_kernel();
+    if (!__atomic_compare_exchange_n(&gf_kernel, &expected, kernel, 0,
+            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        kernel = expected;
+    }
+    return kernel;
+}
+
+int fec_set_kernel(int kernel) {
+    if (kernel == FEC_KERNEL_AUTO) {
+        kernel = auto_kernel();
+    }
+    if (kernel < 0 || kernel >= FEC_KERNEL_MAX || !fec_kernel_supported(kernel)) {
+        return -1;
+    }
+    __atomic_store_n(&gf_kernel, kernel, __ATOMIC_RELEASE);
+    return 0;
+}
+
+int fec_get_kernel(void) {
+    return current_kernel();
+}
+
+const char* fec_kernel_name(int kernel) {
+    if (kernel < 0 || kernel >= FEC_KERNEL_MAX) {
+        return "unknown";
+    }
+    return gf_kernels[kernel].name;
+}
+
+/*
+ * CRC32C of shards.  The crc32 instruction has a latency of three
+ * cycles and a throughput of one, so the hardware path runs three
+ * streams over adjacent thirds of a block and folds them together with
+ * the operators that append CRC32C_LONG or CRC32C_SHORT zero bytes.
+ * All of these work on the raw register, without the pre and post
+ * inversion.
+ */
+static inline unsigned int crc32c_shift(const uint32_t zeros[4][256], unsigned int crc) {
+    return zeros[0][crc & 0xff] ^ zeros[1][(crc >> 8) & 0xff]
+        ^ zeros[2][(crc >> 16) & 0xff] ^ zeros[3][crc >> 24];
+}
+
+static unsigned int crc32c_sw(unsigned int crc, const gf* buf, size_t len) {
+    unsigned int hi;
+
+    for(; len > 0 && 0 != ((uintptr_t)buf & 7); len--) {
+        crc = crc32c_table[0][(crc ^ *buf++) & 0xff] ^ (crc >> 8);
+    }
+    for(; len >= 8; len -= 8, buf += 8) {
+        crc ^= buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((unsigned int)buf[3] << 24);
+        hi = buf[4] | (buf[5] << 8) | (buf[6] << 16) | ((unsigned int)buf[7] << 24);
+        crc = crc32c_table[7][crc & 0xff] ^ crc32c_table[6][(crc >> 8) & 0xff]
+            ^ crc32c_table[5][(crc >> 16) & 0xff] ^ crc32c_table[4][crc >> 24]
+            ^ crc32c_table[3][hi & 0xff] ^ crc32c_table[2][(hi >> 8) & 0xff]
+            ^ crc32c_table[1][(hi >> 16) & 0xff] ^ crc32c_table[0][hi >> 24];
+    }
+    for(; len > 0; len--) {
+        crc = crc32c_table[0][(crc ^ *buf++) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#ifdef GF_X86
+typedef unsigned long long crc_word __attribute__((may_alias));
+
+/* three streams of len bytes each from p, which is left past them */
+#define CRC32C_STREAMS(crc0, p, len, zeros) do{ \
+    unsigned long long c0 = (crc0), c1 = 0, c2 = 0; \
+    const gf* end = (p) + (len); \
+    for(; (p) < end; (p) += 8) { \
+        c0 = _mm_crc32_u64(c0, *(const crc_word*)(p)); \
+        c1 = _mm_crc32_u64(c1, *(const crc_word*)((p) + (len))); \
+        c2 = _mm_crc32_u64(c2, *(const crc_word*)((p) + 2*(len))); \
+    } \
+    c0 = crc32c_shift(zeros, c0) ^ c1; \
+    (crc0) = crc32c_shift(zeros, c0) ^ c2; \
+    (p) += 2*(len); \
+}while(0)
+
+__attribute__((target("sse4.2")))
+static unsigned int crc32c_sse42(unsigned int crc, const gf* buf, size_t len) {
+    unsigned long long c;
+
+    for(; len > 0 && 0 != ((uintptr_t)buf & 7); len--) {
+        crc = _mm_crc32_u8(crc, *buf++);
+    }
+    for(; len >= 3*CRC32C_LONG; len -= 3*CRC32C_LONG) {
+        CRC32C_STREAMS(crc, buf, CRC32C_LONG, crc32c_long);
+    }
+    for(; len >= 3*CRC32C_SHORT; len -= 3*CRC32C_SHORT) {
+        CRC32C_STREAMS(crc, buf, CRC32C_SHORT, crc32c_short);
+    }
+    for(c = crc; len >= 8; len -= 8, buf += 8) {
+        c = _mm_crc32_u64(c, *(const crc_word*)buf);
+    }
+    for(crc = c; len > 0; len--) {
+        crc = _mm_crc32_u8(crc, *buf++);
+    }
+    return crc;
+}
+#endif
+
+/* picked once on first use, like the GF kernel; racing callers store the same one */
+typedef unsigned int (*crc32c_fn)(unsigned int crc, const gf* buf, size_t len);
+static crc32c_fn crc32c_impl = NULL;
+
+static crc32c_fn resolve_crc32c(void) {
+    crc32c_fn fn = crc32c_sw;
+#ifdef GF_X86
+    if(__builtin_cpu_supports("sse4.2")) {
+        fn = crc32c_sse42;
+    }
+#endif
+    __atomic_store_n(&crc32c_impl, fn, __ATOMIC_RELEASE);
+    return fn;
+}
+
+static inline unsigned int crc32c_raw(unsigned int crc, const gf* buf, size_t len) {
+    crc32c_fn fn = __atomic_load_n(&crc32c_impl, __ATOMIC_ACQUIRE);
+    if(NULL == fn) {
+        fn = resolve_crc32c();
+    }
+    return fn(crc, buf, len);
+}
+
+unsigned int reed_solomon_crc32c(unsigned int crc, const unsigned char* buf, int len) {
+    return ~crc32c_raw(~crc, buf, len);
 }
 
 DEB( int pivloops=0; int pivswaps=0 ; )
@@ -260,274 +576,1004 @@ static int invert_mat(gf *src, int k) {
     return error ;
 }
 
-static int fec_initialized = 0 ;
-
+/*
+ * The tables are compiled in and the kernel is picked on first use, so
+ * there is nothing left to set up; kept for existing callers.
+ */
 void fec_init(void) {
-    TICK(ticks[0]);
-    generate_gf();
-    TOCK(ticks[0]);
-    DDB(fprintf(stderr, "generate_gf took %ldus\n", ticks[0]);)
-    TICK(ticks[0]);
-    init_mul_table();
-    TOCK(ticks[0]);
-    DDB(fprintf(stderr, "init_mul_table took %ldus\n", ticks[0]);)
-    fec_initialized = 1 ;
 }
 
 
-static long long rdtsc(void)
-{
-    unsigned long low, hi;
-    asm volatile ("rdtsc" : "=d" (hi), "=a" (low));
-    return ( (((long long)hi) << 32) | ((long long) low));
-}
-
-static gf galExp(gf a, gf n) {
-    int logA;
-    int logResult;
-    if(0 == n) {
-        return 1;
-    }
-    if(0 == a) {
-        return 0;
-    }
-    logA = gf_log[a];
-    logResult = logA * n;
-    while(logResult >= 255) {
-        logResult -= 255;
-    }
-
-    return gf_exp[logResult];
-}
-
 static inline gf galMultiply(gf a, gf b) {
     return gf_mul_table[ ((int)a << 8) + (int)b ];
 }
 
-static gf* vandermonde(int nrows, int ncols) {
-    int row, col, ptr;
-    gf* matrix = (gf*)malloc(nrows * ncols);
-    if(NULL != matrix) {
-        ptr = 0;
-        for(row = 0; row < nrows; row++) {
-            for(col = 0; col < ncols; col++) {
-                matrix[ptr++] = galExp((gf)row, (gf)col);
+/*
+ * Systematic form of the Vandermonde matrix V[r][c] = r^c, i.e. V times
+ * the inverse of its top data_shards rows, without inverting anything.
+ * Row r of that product holds the Lagrange basis polynomials of the
+ * nodes 0..data_shards-1 evaluated at x = r:
+ *
+ *   L_i(x) = prod_{j != i} (x - j) / prod_{j != i} (i - j)
+ *
+ * so the top rows are the identity and each parity row costs O(k) once
+ * the k denominators are known, O(k^2) in total.
+ */
+static gf* vandermonde_systematic(int data_shards, int parity_shards) {
+    int logw[DATA_SHARDS_MAX];
+    gf *m, *p;
+    int i, j, r, x, logp;
+
+    m = (gf*)RS_CALLOC(1, (data_shards + parity_shards) * data_shards);
+    if(NULL == m) {
+        return NULL;
+    }
+    for(i = 0; i < data_shards; i++) {
+        m[i*data_shards + i] = 1;
+        logw[i] = 0;
+        for(j = 0; j < data_shards; j++) {
+            if(j != i) {
+                logw[i] += gf_log[i ^ j];
             }
         }
+        logw[i] %= GF_SIZE;
     }
-    return matrix;
-}
 
-static gf* sub_matrix(gf* matrix, int rmin, int cmin, int rmax, int cmax,  int nrows, int ncols) {
-    int i, j, ptr = 0;
-    gf* new_m = (gf*)malloc( (rmax-rmin) * (cmax-cmin) );
-    if(NULL != new_m) {
-        for(i = rmin; i < rmax; i++) {
-            for(j = cmin; j < cmax; j++) {
-                new_m[ptr++] = matrix[i*ncols + j];
-            }
+    p = m + data_shards*data_shards;
+    for(r = 0; r < parity_shards; r++) {
+        x = data_shards + r;
+        logp = 0;
+        for(j = 0; j < data_shards; j++) {
+            logp += gf_log[x ^ j];
+        }
+        for(i = 0; i < data_shards; i++) {
+            p[r*data_shards + i] = gf_exp[modnn(logp + 2*GF_SIZE - gf_log[x ^ i] - logw[i])];
         }
     }
+    return m;
+}
 
-    return new_m;
+static inline void prefetch_chunk(gf* p, int len) {
+    int i;
+    for(i = 0; i < len; i += 64) {
+        __builtin_prefetch(p + i, 0, 3);
+    }
 }
 
-static gf* multiply1(gf *a, int ar, int ac, gf *b, int br, int bc) {
-    gf *new_m, tg;
-    int r, c, i, ptr = 0;
+/*
+ * Work on column chunks small enough that every output chunk plus the
+ * current input chunk stays in L1: each output is written back to
+ * memory once instead of once per input, and the next input chunk is
+ * prefetched while the current one is multiplied into all outputs.
+ */
+/*
+ * code_some_shards with the kernel resolved by the caller.  in_crcs and
+ * out_crcs (either may be NULL) receive the CRC32C of every input and
+ * output, taken chunk by chunk while the chunk is still in L1.
+ */
+static inline int code_shards_crc(gf_code_fn addmul_fn, gf_code_fn mul_fn,
+        gf* matrixRows, gf** inputs, gf** outputs,
+        int dataShards, int outputCount, int byteCount,
+        unsigned int* in_crcs, unsigned int* out_crcs) {
+    gf* in;
+    gf c;
+    int iRow, col, start, len, chunk;
+
+    if(NULL != in_crcs) {
+        memset(in_crcs, 0xff, dataShards * sizeof(unsigned int));
+    }
+    if(NULL != out_crcs) {
+        memset(out_crcs, 0xff, outputCount * sizeof(unsigned int));
+    }
 
-    assert(ac == br);
-    new_m = (gf*)calloc(1, ar*bc);
-    if(NULL != new_m) {
+    chunk = (RS_CHUNK_SIZE / (outputCount + 1)) & ~63;
+    if(chunk < 256) {
+        chunk = 256;
+    }
 
-        for(r = 0; r < ar; r++) {
-            for(c = 0; c < bc; c++) {
-                tg = 0;
-                for(i = 0; i < ac; i++) {
-                    tg ^= galMultiply(a[r*ac+i], b[i*bc+c]);
+    for(start = 0; start < byteCount; start += chunk) {
+        len = byteCount - start;
+        if(len > chunk) {
+            len = chunk;
+        }
+        for(col = 0; col < dataShards; col++) {
+            in = inputs[col] + start;
+            if(col + 1 < dataShards) {
+                prefetch_chunk(inputs[col+1] + start, len);
+            }
+            for(iRow = 0; iRow < outputCount; iRow++) {
+                c = matrixRows[iRow*dataShards+col];
+                if(0 == col) {
+                    if(0 != c) {
+                        mul_fn(outputs[iRow] + start, in, c, len);
+                    } else {
+                        memset(outputs[iRow] + start, 0, len);
+                    }
+                } else if(0 != c) {
+                    addmul_fn(outputs[iRow] + start, in, c, len);
                 }
-
-                new_m[ptr++] = tg;
+            }
+            if(NULL != in_crcs) {
+                in_crcs[col] = crc32c_raw(in_crcs[col], in, len);
+            }
+        }
+        if(NULL != out_crcs) {
+            for(iRow = 0; iRow < outputCount; iRow++) {
+                out_crcs[iRow] = crc32c_raw(out_crcs[iRow], outputs[iRow] + start, len);
             }
         }
+    }
 
+    for(col = 0; NULL != in_crcs && col < dataShards; col++) {
+        in_crcs[col] = ~in_crcs[col];
     }
+    for(iRow = 0; NULL != out_crcs && iRow < outputCount; iRow++) {
+        out_crcs[iRow] = ~out_crcs[iRow];
+    }
+    return 0;
+}
 
-    return new_m;
+static inline int code_shards_with(gf_code_fn addmul_fn, gf_code_fn mul_fn,
+        gf* matrixRows, gf** inputs, gf** outputs,
+        int dataShards, int outputCount, int byteCount) {
+    return code_shards_crc(addmul_fn, mul_fn, matrixRows, inputs, outputs,
+            dataShards, outputCount, byteCount, NULL, NULL);
 }
 
 static inline int code_some_shards(gf* matrixRows, gf** inputs, gf** outputs,
         int dataShards, int outputCount, int byteCount) {
-    gf* in;
-    int iRow, c;
-    for(c = 0; c < dataShards; c++) {
-        in = inputs[c];
-        for(iRow = 0; iRow < outputCount; iRow++) {
-            if(0 == c) {
-                mul(outputs[iRow], in, matrixRows[iRow*dataShards+c], byteCount);
-            } else {
-                addmul(outputs[iRow], in, matrixRows[iRow*dataShards+c], byteCount);
-            }
+    int kernel = current_kernel();
+    return code_shards_with(gf_kernels[kernel].addmul1, gf_kernels[kernel].mul1,
+            matrixRows, inputs, outputs, dataShards, outputCount, byteCount);
+}
+
+/*
+ * XOR engine for RS_MATRIX_CAUCHY.  A block is viewed as 8 packets and
+ * packet c holds bit c of every byte-sized word, so multiplying by a
+ * coefficient e becomes XORing input packet c into output packet r for
+ * every bit set in the 8x8 bit matrix of e (gf_bitrow).  Only whole
+ * packets are ever XORed, which vectorizes without any tables.
+ */
+typedef unsigned long long xor_vec __attribute__((vector_size (16), aligned (1), may_alias));
+
+/* dst = XOR of the nsrc sources, accumulated in registers */
+static inline void xor_sources(gf* dst, gf** srcs, int nsrc, int n) {
+    xor_vec a0, a1, a2, a3;
+    gf* p;
+    int i = 0, k;
+    gf x;
+
+    if(0 == nsrc) {
+        memset(dst, 0, n);
+        return;
+    }
+    for(; i + 64 <= n; i += 64) {
+        p = srcs[0] + i;
+        a0 = *(xor_vec*)(p);
+        a1 = *(xor_vec*)(p + 16);
+        a2 = *(xor_vec*)(p + 32);
+        a3 = *(xor_vec*)(p + 48);
+        for(k = 1; k < nsrc; k++) {
+            p = srcs[k] + i;
+            a0 ^= *(xor_vec*)(p);
+            a1 ^= *(xor_vec*)(p + 16);
+            a2 ^= *(xor_vec*)(p + 32);
+            a3 ^= *(xor_vec*)(p + 48);
         }
+        p = dst + i;
+        *(xor_vec*)(p) = a0;
+        *(xor_vec*)(p + 16) = a1;
+        *(xor_vec*)(p + 32) = a2;
+        *(xor_vec*)(p + 48) = a3;
+    }
+    for(; i < n; i++) {
+        x = 0;
+        for(k = 0; k < nsrc; k++) {
+            x ^= srcs[k][i];
+        }
+        dst[i] = x;
     }
-
-    return 0;
 }
 
-reed_solomon* reed_solomon_new(int data_shards, int parity_shards) {
-    gf* vm = NULL;
-    gf* top = NULL;
-    int err = 0;
-    reed_solomon* rs = NULL;
+/*
+ * bytes [q, q+len) of every packet; input packets are in_psize apart,
+ * output packets out_psize apart and start at offset 0 of the outputs.
+ * The schedule of each output packet is the list of input packets its
+ * bit matrix row selects.
+ */
+static void xor_code_range(gf* matrixRows, gf** inputs, int in_psize,
+        gf** outputs, int out_psize, int dataShards, int outputCount, int q, int len) {
+    gf* srcs[DATA_SHARDS_MAX * 8];
+    unsigned mask;
+    int iRow, c, r, b, nsrc;
+    gf e;
+
+    for(iRow = 0; iRow < outputCount; iRow++) {
+        for(r = 0; r < 8; r++) {
+            nsrc = 0;
+            for(c = 0; c < dataShards; c++) {
+                e = matrixRows[iRow*dataShards + c];
+                for(mask = gf_bitrow[e][r]; 0 != mask; mask &= mask - 1) {
+                    b = __builtin_ctz(mask);
+                    srcs[nsrc++] = inputs[c] + b*in_psize + q;
+                }
+            }
+            xor_sources(outputs[iRow] + r*out_psize, srcs, nsrc, len);
+        }
+    }
+}
 
-    assert(fec_initialized);
+static int xor_code_shards(gf* matrixRows, gf** inputs, gf** outputs,
+        int dataShards, int outputCount, int byteCount) {
+    gf* dst[DATA_SHARDS_MAX];
+    int i, q, len, chunk, psize = byteCount / 8;
 
-    do {
-        rs = (reed_solomon*) malloc(sizeof(reed_solomon));
-        if(NULL == rs) {
-            return NULL;
+    if(0 != byteCount % 8) {
+        return -1;
+    }
+    chunk = (RS_CHUNK_SIZE / (8 * (outputCount + 1))) & ~63;
+    if(chunk < 64) {
+        chunk = 64;
+    }
+    for(q = 0; q < psize; q += chunk) {
+        len = psize - q;
+        if(len > chunk) {
+            len = chunk;
         }
-        rs->data_shards = data_shards;
-        rs->parity_shards = parity_shards;
-        rs->shards = (data_shards + parity_shards);
-        rs->m = NULL;
-        rs->parity = NULL;
-
-        if(rs->shards > DATA_SHARDS_MAX || data_shards <= 0 || parity_shards <= 0) {
-            err = 1;
-            break;
+        for(i = 0; i < outputCount; i++) {
+            dst[i] = outputs[i] + q;
         }
+        xor_code_range(matrixRows, inputs, psize, dst, psize, dataShards, outputCount, q, len);
+    }
+    return 0;
+}
 
-        vm = vandermonde(rs->shards, rs->data_shards);
-        if(NULL == vm) {
-            err = 2;
-            break;
+/*
+ * P+Q engine for RS_MATRIX_PQ.  P is the XOR of the inputs and Q is
+ * sum 2^c * inputs[c], taken by Horner's rule from the last input down
+ * so the only multiply is by 2: a shift and a conditional XOR of the
+ * field polynomial.  Both stay in registers across all the inputs and
+ * are written once.  NULL inputs count as zero; p_in and q_in (may be
+ * NULL) are added to the results, and p or q may be NULL when not
+ * wanted.  All pointers are at offset off.
+ */
+typedef unsigned char pq_vec __attribute__((vector_size (32), aligned (1), may_alias));
+
+#define PQ_MUL2(q) (((q) + (q)) ^ ((pq_vec)((q) >= 0x80) & 0x1d))
+
+static inline __attribute__((always_inline)) void pq_gen_body(gf** inputs, int n,
+        gf* p, gf* q, gf* p_in, gf* q_in, int off, int len) {
+    pq_vec p0, p1, q0, q1, d;
+    gf* in;
+    gf pb, qb;
+    int i, c, end = off + len;
+
+    for(i = off; i + 64 <= end; i += 64) {
+        p0 = p1 = q0 = q1 = (pq_vec){0};
+        for(c = n - 1; c >= 0; c--) {
+            q0 = PQ_MUL2(q0);
+            q1 = PQ_MUL2(q1);
+            if(NULL != (in = inputs[c])) {
+                d = *(pq_vec*)(in + i);
+                p0 ^= d;
+                q0 ^= d;
+                d = *(pq_vec*)(in + i + 32);
+                p1 ^= d;
+                q1 ^= d;
+            }
         }
-
-        top = sub_matrix(vm, 0, 0, data_shards, data_shards, rs->shards, data_shards);
-        if(NULL == top) {
-            err = 3;
-            break;
+        if(NULL != p) {
+            if(NULL != p_in) {
+                p0 ^= *(pq_vec*)(p_in + i);
+                p1 ^= *(pq_vec*)(p_in + i + 32);
+            }
+            *(pq_vec*)(p + i) = p0;
+            *(pq_vec*)(p + i + 32) = p1;
         }
-
-        err = invert_mat(top, data_shards);
-        assert(0 == err);
-
-        rs->m = multiply1(vm, rs->shards, data_shards, top, data_shards, data_shards);
-        if(NULL == rs->m) {
-            err = 4;
-            break;
+        if(NULL != q) {
+            if(NULL != q_in) {
+                q0 ^= *(pq_vec*)(q_in + i);
+                q1 ^= *(pq_vec*)(q_in + i + 32);
+            }
+            *(pq_vec*)(q + i) = q0;
+            *(pq_vec*)(q + i + 32) = q1;
         }
-
-        rs->parity = sub_matrix(rs->m, data_shards, 0, rs->shards, data_shards, rs->shards, data_shards);
-        if(NULL == rs->parity) {
-            err = 5;
-            break;
+    }
+    for(; i < end; i++) {
+        pb = NULL != p_in ? p_in[i] : 0;
+        qb = 0;
+        for(c = n - 1; c >= 0; c--) {
+            qb = (qb << 1) ^ (qb & 0x80 ? 0x1d : 0);
+            if(NULL != inputs[c]) {
+                pb ^= inputs[c][i];
+                qb ^= inputs[c][i];
+            }
+        }
+        if(NULL != p) {
+            p[i] = pb;
         }
+        if(NULL != q) {
+            q[i] = qb ^ (NULL != q_in ? q_in[i] : 0);
+        }
+    }
+}
 
-        free(vm);
-        free(top);
-        vm = NULL;
-        top = NULL;
-        return rs;
+static void pq_gen_vec(gf** inputs, int n, gf* p, gf* q, gf* p_in, gf* q_in, int off, int len) {
+    pq_gen_body(inputs, n, p, q, p_in, q_in, off, len);
+}
 
-    } while(0);
+#ifdef GF_X86
+__attribute__((target("avx2")))
+static void pq_gen_avx2(gf** inputs, int n, gf* p, gf* q, gf* p_in, gf* q_in, int off, int len) {
+    pq_gen_body(inputs, n, p, q, p_in, q_in, off, len);
+}
+#endif
 
-    fprintf(stderr, "err=%d\n", err);
-    if(NULL != vm) {
-        free(vm);
+/* the AVX2 body whenever the kernel in use implies AVX2 */
+static void pq_gen(gf** inputs, int n, gf* p, gf* q, gf* p_in, gf* q_in, int off, int len) {
+#ifdef GF_X86
+    if(current_kernel() >= FEC_KERNEL_AVX2) {
+        pq_gen_avx2(inputs, n, p, q, p_in, q_in, off, len);
+        return;
+    }
+#endif
+    pq_gen_vec(inputs, n, p, q, p_in, q_in, off, len);
+}
+
+/* encode for RS_MATRIX_PQ, checksummed chunk by chunk when CRCs are wanted */
+static void pq_code_shards(gf** inputs, gf** outputs, int dataShards, int outputCount,
+        int byteCount, unsigned int* in_crcs, unsigned int* out_crcs) {
+    int i, start, len, chunk;
+
+    if(NULL == in_crcs && NULL == out_crcs) {
+        pq_gen(inputs, dataShards, outputs[0], outputCount > 1 ? outputs[1] : NULL,
+                NULL, NULL, 0, byteCount);
+        return;
     }
-    if(NULL != top) {
-        free(top);
+    chunk = (RS_CHUNK_SIZE / (dataShards + outputCount)) & ~63;
+    if(chunk < 256) {
+        chunk = 256;
     }
-    if(NULL != rs) {
-        if(NULL != rs->m) {
-            free(rs->m);
+    for(i = 0; NULL != in_crcs && i < dataShards; i++) {
+        in_crcs[i] = 0xffffffff;
+    }
+    for(i = 0; NULL != out_crcs && i < outputCount; i++) {
+        out_crcs[i] = 0xffffffff;
+    }
+    for(start = 0; start < byteCount; start += chunk) {
+        len = byteCount - start;
+        if(len > chunk) {
+            len = chunk;
         }
-        if(NULL != rs->parity) {
-            free(rs->parity);
+        pq_gen(inputs, dataShards, outputs[0], outputCount > 1 ? outputs[1] : NULL,
+                NULL, NULL, start, len);
+        for(i = 0; NULL != in_crcs && i < dataShards; i++) {
+            in_crcs[i] = crc32c_raw(in_crcs[i], inputs[i] + start, len);
+        }
+        for(i = 0; NULL != out_crcs && i < outputCount; i++) {
+            out_crcs[i] = crc32c_raw(out_crcs[i], outputs[i] + start, len);
         }
-        free(rs);
     }
-
-    return NULL;
+    for(i = 0; NULL != in_crcs && i < dataShards; i++) {
+        in_crcs[i] = ~in_crcs[i];
+    }
+    for(i = 0; NULL != out_crcs && i < outputCount; i++) {
+        out_crcs[i] = ~out_crcs[i];
+    }
 }
 
-void reed_solomon_release(reed_solomon* rs) {
-    if(NULL != rs) {
-        if(NULL != rs->m) {
-            free(rs->m);
+/*
+ * in_crcs and out_crcs as for code_shards_crc; the XOR engine reads
+ * every input eight times over, so Cauchy codecs checksum in a pass of
+ * their own afterwards.
+ */
+static int rs_code_shards(reed_solomon* rs, gf* matrixRows, gf** inputs, gf** outputs,
+        int dataShards, int outputCount, int byteCount,
+        unsigned int* in_crcs, unsigned int* out_crcs) {
+    int i, kernel, ret;
+    STATS(long long ticks;)
+
+    TICK(ticks);
+    if(RS_MATRIX_PQ == rs->matrix && matrixRows == rs->parity) {
+        /* encoding: the parity rows are P and Q, or P alone */
+        pq_code_shards(inputs, outputs, dataShards, outputCount, byteCount, in_crcs, out_crcs);
+        ret = 0;
+    } else if(RS_MATRIX_CAUCHY == rs->matrix) {
+        ret = xor_code_shards(matrixRows, inputs, outputs, dataShards, outputCount, byteCount);
+        for(i = 0; NULL != in_crcs && i < dataShards; i++) {
+            in_crcs[i] = reed_solomon_crc32c(0, inputs[i], byteCount);
         }
-        if(NULL != rs->parity) {
-            free(rs->parity);
+        for(i = 0; NULL != out_crcs && i < outputCount; i++) {
+            out_crcs[i] = reed_solomon_crc32c(0, outputs[i], byteCount);
         }
-        free(rs);
+    } else {
+        kernel = current_kernel();
+        ret = code_shards_crc(gf_kernels[kernel].addmul1, gf_kernels[kernel].mul1,
+                matrixRows, inputs, outputs, dataShards, outputCount, byteCount,
+                in_crcs, out_crcs);
     }
+    TOCK(ticks);
+    STAT_ADD(code_calls, 1);
+    STAT_ADD(code_bytes, (long long)dataShards * byteCount);
+    STAT_ADD(code_cycles, ticks);
+    return ret;
 }
 
-int reed_solomon_encode(reed_solomon* rs,
-        unsigned char** data_blocks,
-        unsigned char** fec_blocks,
-        int block_size) {
-    assert(NULL != rs && NULL != rs->parity);
+#define RS_KEY_WORDS ((DATA_SHARDS_MAX + 63) / 64)
 
-    return code_some_shards(rs->parity, data_blocks, fec_blocks, 
-                            rs->data_shards, rs->parity_shards, block_size);
-}
+typedef struct {
+    unsigned long long key[RS_KEY_WORDS];
+    unsigned long long stamp;
+    gf* inverse;
+} rs_decode_entry;
 
+struct _rs_decode_cache {
+    pthread_mutex_t lock;
+    int nr_entries;
+    unsigned long long clock;
+    rs_decode_entry entries[RS_DECODE_CACHE_SIZE];
+};
 
-int reed_solomon_decode(reed_solomon* rs,
-        unsigned char **data_blocks,
-        int block_size,
-        unsigned char **dec_fec_blocks,
-        unsigned int *fec_block_nos,
-        unsigned int *erased_blocks,
-        int nr_fec_blocks) {
-    gf dataDecodeMatrix[DATA_SHARDS_MAX*DATA_SHARDS_MAX];
-    unsigned char* subShards[DATA_SHARDS_MAX];
-    unsigned char* outputs[DATA_SHARDS_MAX];
-    gf* m = rs->m;
-    int i, j, c, swap, subMatrixRow, dataShards, nos, nshards;
+static void decode_cache_free(struct _rs_decode_cache* cache) {
+    int i;
+    if(NULL != cache) {
+        for(i = 0; i < cache->nr_entries; i++) {
+            RS_FREE(cache->entries[i].inverse);
+        }
+        pthread_mutex_destroy(&cache->lock);
+        RS_FREE(cache);
+    }
+}
 
-    for(i = 0; i < nr_fec_blocks; i++) {
-        swap = 0;
-        for(j = i+1; j < nr_fec_blocks; j++) {
-            if(erased_blocks[i] > erased_blocks[j]) {
-                c = erased_blocks[i];
-                erased_blocks[i] = erased_blocks[j];
-                erased_blocks[j] = c;
+/* copy the cached inverse for key into inverse, return 0 on a hit */
+static int decode_cache_get(reed_solomon* rs, unsigned long long* key, gf* inverse) {
+    struct _rs_decode_cache* cache = rs->cache;
+    rs_decode_entry* e;
+    int i;
 
-                swap = 1;
-            }
+    pthread_mutex_lock(&cache->lock);
+    for(i = 0; i < cache->nr_entries; i++) {
+        e = &cache->entries[i];
+        if(0 == memcmp(e->key, key, sizeof(e->key))) {
+            e->stamp = ++cache->clock;
+            memcpy(inverse, e->inverse, rs->data_shards * rs->data_shards);
+            rs->cache_hits++;
+            pthread_mutex_unlock(&cache->lock);
+            return 0;
         }
-        if(!swap) {
-            break;
+    }
+    rs->cache_misses++;
+    pthread_mutex_unlock(&cache->lock);
+    return -1;
+}
+
+static void decode_cache_put(reed_solomon* rs, unsigned long long* key, gf* inverse) {
+    struct _rs_decode_cache* cache = rs->cache;
+    rs_decode_entry* e;
+    int i, n = rs->data_shards * rs->data_shards;
+
+    pthread_mutex_lock(&cache->lock);
+    for(i = 0; i < cache->nr_entries; i++) {
+        if(0 == memcmp(cache->entries[i].key, key, sizeof(cache->entries[i].key))) {
+            /* another thread inverted the same pattern first */
+            pthread_mutex_unlock(&cache->lock);
+            return;
+        }
+    }
+    if(cache->nr_entries < RS_DECODE_CACHE_SIZE) {
+        e = &cache->entries[cache->nr_entries];
+        e->inverse = (gf*)RS_MALLOC(n);
+        if(NULL == e->inverse) {
+            pthread_mutex_unlock(&cache->lock);
+            return;
+        }
+        cache->nr_entries++;
+    } else {
+        e = &cache->entries[0];
+        for(i = 1; i < cache->nr_entries; i++) {
+            if(cache->entries[i].stamp < e->stamp) {
+                e = &cache->entries[i];
+            }
         }
     }
+    memcpy(e->key, key, sizeof(e->key));
+    memcpy(e->inverse, inverse, n);
+    e->stamp = ++cache->clock;
+    pthread_mutex_unlock(&cache->lock);
+}
 
-    j = 0;
-    subMatrixRow = 0;
-    nos = 0;
-    nshards = 0;
+static int bitmatrix_ones(gf e) {
+    int r, n = 0;
+    for(r = 0; r < 8; r++) {
+        n += __builtin_popcount(gf_bitrow[e][r]);
+    }
+    return n;
+}
+
+/*
+ * Systematic Cauchy matrix: identity on top, 1 / (x_i + y_j) below with
+ * x_i = i and y_j = parity_shards + j.  Columns are scaled so the first
+ * parity row is all ones (plain XOR) and every other row by whichever
+ * factor leaves the fewest ones in its bit matrices; scaling rows and
+ * columns keeps every square submatrix invertible.
+ */
+static gf* cauchy(int data_shards, int parity_shards) {
+    gf *m, *p, s, best_s;
+    int i, j, c, ones, best;
+
+    m = (gf*)RS_CALLOC(1, (data_shards + parity_shards) * data_shards);
+    if(NULL == m) {
+        return NULL;
+    }
+    for(i = 0; i < data_shards; i++) {
+        m[i*data_shards + i] = 1;
+    }
+    p = m + data_shards*data_shards;
+    for(i = 0; i < parity_shards; i++) {
+        for(j = 0; j < data_shards; j++) {
+            p[i*data_shards + j] = inverse[i ^ (parity_shards + j)];
+        }
+    }
+    for(j = 0; j < data_shards; j++) {
+        s = inverse[p[j]];
+        for(i = 0; i < parity_shards; i++) {
+            p[i*data_shards + j] = galMultiply(p[i*data_shards + j], s);
+        }
+    }
+    for(i = 1; i < parity_shards; i++) {
+        best = -1;
+        best_s = 1;
+        for(c = 0; c < data_shards; c++) {
+            s = inverse[p[i*data_shards + c]];
+            ones = 0;
+            for(j = 0; j < data_shards; j++) {
+                ones += bitmatrix_ones(galMultiply(p[i*data_shards + j], s));
+            }
+            if(best < 0 || ones < best) {
+                best = ones;
+                best_s = s;
+            }
+        }
+        for(j = 0; j < data_shards; j++) {
+            p[i*data_shards + j] = galMultiply(p[i*data_shards + j], best_s);
+        }
+    }
+    return m;
+}
+
+/* P+Q: identity on top, then a row of ones and the row 2^i */
+static gf* pq_matrix(int data_shards, int parity_shards) {
+    gf* m;
+    int i;
+
+    m = (gf*)RS_CALLOC((data_shards + parity_shards) * data_shards, 1);
+    if(NULL == m) {
+        return NULL;
+    }
+    for(i = 0; i < data_shards; i++) {
+        m[i*data_shards + i] = 1;
+        m[data_shards*data_shards + i] = 1;
+        if(parity_shards > 1) {
+            m[(data_shards + 1)*data_shards + i] = gf_exp[i];
+        }
+    }
+    return m;
+}
+
+static int resolve_matrix(int parity_shards, int matrix) {
+    if(RS_MATRIX_AUTO == matrix) {
+        return parity_shards <= 2 ? RS_MATRIX_PQ : RS_MATRIX_VANDERMONDE;
+    }
+    return matrix;
+}
+
+reed_solomon* reed_solomon_new(int data_shards, int parity_shards) {
+    return reed_solomon_new2(data_shards, parity_shards, RS_MATRIX_VANDERMONDE);
+}
+
+/*
+ * The systematic Vandermonde codeword is the data polynomial evaluated
+ * at 0..n-1, or equally a polynomial of the same degree evaluated at
+ * X_i = i ^ RS_SYNDROME_SHIFT, which keeps every locator nonzero.  Its
+ * dual code has the rows H[j][i] = v_i * X_i^j with
+ * v_i = 1 / prod_{m != i} (i ^ m), so a clean stripe has all-zero
+ * syndromes and an error e at shard i adds v_i * e * X_i^j to S_j.
+ */
+#define RS_SYNDROME_SHIFT (255)
+
+static gf* syndrome_matrix(int shards, int parity_shards) {
+    gf *h;
+    int i, j, m, logv, logx;
+
+    h = (gf*)RS_MALLOC(parity_shards * shards);
+    if(NULL == h) {
+        return NULL;
+    }
+    for(i = 0; i < shards; i++) {
+        logv = 0;
+        for(m = 0; m < shards; m++) {
+            if(m != i) {
+                logv += gf_log[i ^ m];
+            }
+        }
+        logv = GF_SIZE - logv % GF_SIZE;
+        logx = gf_log[i ^ RS_SYNDROME_SHIFT];
+        for(j = 0; j < parity_shards; j++) {
+            h[j*shards + i] = gf_exp[modnn(logv + j*logx)];
+        }
+    }
+    return h;
+}
+
+reed_solomon* reed_solomon_new2(int data_shards, int parity_shards, int matrix) {
+    int err = 0;
+    reed_solomon* rs = NULL;
+    STATS(long long ticks;)
+
+    matrix = resolve_matrix(parity_shards, matrix);
+    do {
+        rs = (reed_solomon*) RS_MALLOC(sizeof(reed_solomon));
+        if(NULL == rs) {
+            return NULL;
+        }
+        rs->data_shards = data_shards;
+        rs->parity_shards = parity_shards;
+        rs->shards = (data_shards + parity_shards);
+        rs->matrix = matrix;
+        rs->m = NULL;
+        rs->parity = NULL;
+        rs->syndrome = NULL;
+        rs->cache = NULL;
+        rs->cache_hits = 0;
+        rs->cache_misses = 0;
+        rs->refs = 1;
+        rs->shared = 0;
+        rs->next = NULL;
+
+        if(rs->shards > DATA_SHARDS_MAX || data_shards <= 0 || parity_shards <= 0
+                || (RS_MATRIX_VANDERMONDE != matrix && RS_MATRIX_CAUCHY != matrix
+                    && RS_MATRIX_PQ != matrix)
+                || (RS_MATRIX_PQ == matrix && parity_shards > 2)) {
+            err = 1;
+            break;
+        }
+
+        TICK(ticks);
+        if(RS_MATRIX_CAUCHY == matrix) {
+            rs->m = cauchy(data_shards, parity_shards);
+        } else if(RS_MATRIX_PQ == matrix) {
+            rs->m = pq_matrix(data_shards, parity_shards);
+        } else {
+            rs->m = vandermonde_systematic(data_shards, parity_shards);
+        }
+        if(NULL == rs->m) {
+            err = 4;
+            break;
+        }
+        /* the parity rows are the bottom of m, not a copy */
+        rs->parity = rs->m + data_shards*data_shards;
+
+        if(RS_MATRIX_VANDERMONDE == matrix) {
+            rs->syndrome = syndrome_matrix(rs->shards, parity_shards);
+            if(NULL == rs->syndrome) {
+                err = 5;
+                break;
+            }
+        }
+
+        TOCK(ticks);
+        STAT_ADD(matrix_builds, 1);
+        STAT_ADD(matrix_cycles, ticks);
+
+        rs->cache = (struct _rs_decode_cache*)RS_CALLOC(1, sizeof(struct _rs_decode_cache));
+        if(NULL == rs->cache) {
+            err = 6;
+            break;
+        }
+        pthread_mutex_init(&rs->cache->lock, NULL);
+
+        return rs;
+
+    } while(0);
+
+    fprintf(stderr, "err=%d\n", err);
+    if(NULL != rs) {
+        if(NULL != rs->m) {
+            RS_FREE(rs->m);
+        }
+        if(NULL != rs->syndrome) {
+            RS_FREE(rs->syndrome);
+        }
+        decode_cache_free(rs->cache);
+        RS_FREE(rs);
+    }
+
+    return NULL;
+}
+
+/*
+ * Codecs handed out by reed_solomon_acquire, one per geometry and
+ * matrix type.  A codec leaves the list when its last reference is
+ * released, under the same lock, so lookups never see a dying codec.
+ */
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static reed_solomon* registry = NULL;
+
+reed_solomon* reed_solomon_acquire(int data_shards, int parity_shards, int matrix) {
+    reed_solomon* rs;
+
+    matrix = resolve_matrix(parity_shards, matrix);
+    pthread_mutex_lock(&registry_lock);
+    for(rs = registry; NULL != rs; rs = rs->next) {
+        if(rs->data_shards == data_shards && rs->parity_shards == parity_shards
+                && rs->matrix == matrix) {
+            rs->refs++;
+            break;
+        }
+    }
+    if(NULL == rs) {
+        rs = reed_solomon_new2(data_shards, parity_shards, matrix);
+        if(NULL != rs) {
+            rs->shared = 1;
+            rs->next = registry;
+            registry = rs;
+        }
+    }
+    pthread_mutex_unlock(&registry_lock);
+    return rs;
+}
+
+void reed_solomon_release(reed_solomon* rs) {
+    reed_solomon** p;
+
+    if(NULL != rs) {
+        if(rs->shared) {
+            pthread_mutex_lock(&registry_lock);
+            if(0 != --rs->refs) {
+                pthread_mutex_unlock(&registry_lock);
+                return;
+            }
+            for(p = &registry; *p != rs; p = &(*p)->next)
+                ;
+            *p = rs->next;
+            pthread_mutex_unlock(&registry_lock);
+        }
+        if(NULL != rs->m) {
+            RS_FREE(rs->m);
+        }
+        if(NULL != rs->syndrome) {
+            RS_FREE(rs->syndrome);
+        }
+        decode_cache_free(rs->cache);
+        RS_FREE(rs);
+    }
+}
+
+void reed_solomon_cache_stats(reed_solomon* rs, unsigned long long* hits, unsigned long long* misses) {
+    pthread_mutex_lock(&rs->cache->lock);
+    if(NULL != hits) {
+        *hits = rs->cache_hits;
+    }
+    if(NULL != misses) {
+        *misses = rs->cache_misses;
+    }
+    pthread_mutex_unlock(&rs->cache->lock);
+}
+
+int reed_solomon_stats(rs_stats* stats) {
+    memset(stats, 0, sizeof(rs_stats));
+#ifdef RS_STATS
+    {
+        unsigned long long* src = (unsigned long long*)&rs_stats_global;
+        unsigned long long* dst = (unsigned long long*)stats;
+        size_t i;
+        for(i = 0; i < sizeof(rs_stats) / sizeof(unsigned long long); i++) {
+            dst[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+        }
+    }
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+void reed_solomon_stats_mute(int mute) {
+#ifdef RS_STATS
+    stats_muted = mute;
+#else
+    (void)mute;
+#endif
+}
+
+void reed_solomon_stats_reset(void) {
+#ifdef RS_STATS
+    unsigned long long* p = (unsigned long long*)&rs_stats_global;
+    size_t i;
+    for(i = 0; i < sizeof(rs_stats) / sizeof(unsigned long long); i++) {
+        __atomic_store_n(&p[i], 0, __ATOMIC_RELAXED);
+    }
+#endif
+}
+
+int reed_solomon_encode(reed_solomon* rs,
+        unsigned char** data_blocks,
+        unsigned char** fec_blocks,
+        int block_size) {
+    assert(NULL != rs && NULL != rs->parity);
+
+    STAT_STRIPE(stripes_encoded, 1);
+    return rs_code_shards(rs, rs->parity, data_blocks, fec_blocks, 
+                            rs->data_shards, rs->parity_shards, block_size, NULL, NULL);
+}
+
+int reed_solomon_encode_crc(reed_solomon* rs,
+        unsigned char** data_blocks,
+        unsigned char** fec_blocks,
+        int block_size,
+        unsigned int* crcs) {
+    assert(NULL != rs && NULL != rs->parity);
+
+    STAT_STRIPE(stripes_encoded, 1);
+    return rs_code_shards(rs, rs->parity, data_blocks, fec_blocks,
+            rs->data_shards, rs->parity_shards, block_size, crcs, crcs + rs->data_shards);
+}
+
+
+/*
+ * Invert the rows of m listed in rows[0..data_shards), which must be in
+ * ascending order, reusing the cached inverse for the same set of rows.
+ */
+static int decode_matrix(reed_solomon* rs, int* rows, gf* inverse) {
+    unsigned long long key[RS_KEY_WORDS];
+    unsigned int i, ds = rs->data_shards;
+    STATS(long long ticks;)
+
+    memset(key, 0, sizeof(key));
+    for(i = 0; i < ds; i++) {
+        key[rows[i] / 64] |= 1ULL << (rows[i] % 64);
+    }
+    if(0 == decode_cache_get(rs, key, inverse)) {
+        return 0;
+    }
+
+    for(i = 0; i < ds; i++) {
+        memcpy(inverse + i*ds, rs->m + rows[i]*ds, ds);
+    }
+    TICK(ticks);
+    if(0 != invert_mat(inverse, ds)) {
+        return -1;
+    }
+    TOCK(ticks);
+    STAT_ADD(inversions, 1);
+    STAT_ADD(invert_cycles, ticks);
+    decode_cache_put(rs, key, inverse);
+    return 0;
+}
+
+/*
+ * Up to two erased data shards x < y of a P+Q stripe, from the RAID-6
+ * equations rather than an inverse.  The surviving data is folded into
+ * the erased blocks, P into y and Q into x:
+ *
+ *   Pxy = P + sum_{i != x,y} d_i = d_x + d_y
+ *   Qxy = Q + sum_{i != x,y} 2^i d_i = 2^x d_x + 2^y d_y
+ *
+ * so d_x = (2^y Pxy + Qxy) / (2^x + 2^y) and d_y = Pxy + d_x.  With one
+ * shard erased it is P plus the rest, or Q plus the rest over 2^x.
+ */
+static int pq_decode(reed_solomon* rs, unsigned char** data_blocks, int block_size,
+        unsigned char** dec_fec_blocks, unsigned int* fec_block_nos,
+        unsigned int* erased_blocks, int nr_fec_blocks) {
+    gf* inputs[DATA_SHARDS_MAX];
+    gf *bx, *by, *p = NULL, *q = NULL;
+    gf a, b;
+    int i, off, len, chunk, x, y;
+    int ds = rs->data_shards;
+
+    for(i = 0; i < nr_fec_blocks; i++) {
+        if(erased_blocks[i] >= (unsigned int)ds || fec_block_nos[i] >= (unsigned int)rs->parity_shards) {
+            return -1;
+        }
+        if(0 == fec_block_nos[i]) {
+            p = dec_fec_blocks[i];
+        } else {
+            q = dec_fec_blocks[i];
+        }
+    }
+    memcpy(inputs, data_blocks, ds * sizeof(gf*));
+    for(i = 0; i < nr_fec_blocks; i++) {
+        inputs[erased_blocks[i]] = NULL;
+    }
+    STATS(rs_stats_stripe(nr_fec_blocks);)
+
+    x = erased_blocks[0];
+    bx = data_blocks[x];
+    if(1 == nr_fec_blocks) {
+        if(NULL != p) {
+            pq_gen(inputs, ds, bx, NULL, p, NULL, 0, block_size);
+            return 0;
+        }
+        a = inverse[gf_exp[x]];
+        for(off = 0; off < block_size; off += RS_CHUNK_SIZE) {
+            len = block_size - off;
+            if(len > RS_CHUNK_SIZE) {
+                len = RS_CHUNK_SIZE;
+            }
+            pq_gen(inputs, ds, NULL, bx, NULL, q, off, len);
+            mul(bx + off, bx + off, a, len);
+        }
+        return 0;
+    }
+
+    if(NULL == p || NULL == q) {
+        return -1;
+    }
+    y = erased_blocks[1];
+    by = data_blocks[y];
+    b = inverse[gf_exp[x] ^ gf_exp[y]];
+    a = galMultiply(gf_exp[y], b);
+    chunk = RS_CHUNK_SIZE / 2;
+    for(off = 0; off < block_size; off += chunk) {
+        len = block_size - off;
+        if(len > chunk) {
+            len = chunk;
+        }
+        pq_gen(inputs, ds, by, bx, p, q, off, len);
+        mul(bx + off, bx + off, b, len);
+        addmul(bx + off, by + off, a, len);
+        addmul(by + off, bx + off, 1, len);
+    }
+    return 0;
+}
+
+int reed_solomon_decode(reed_solomon* rs,
+        unsigned char **data_blocks,
+        int block_size,
+        unsigned char **dec_fec_blocks,
+        unsigned int *fec_block_nos,
+        unsigned int *erased_blocks,
+        int nr_fec_blocks) {
+    gf dataDecodeMatrix[DATA_SHARDS_MAX*DATA_SHARDS_MAX];
+    unsigned char* subShards[DATA_SHARDS_MAX];
+    unsigned char* outputs[DATA_SHARDS_MAX];
+    int rows[DATA_SHARDS_MAX];
+    int i, j, subMatrixRow, dataShards;
+
+    /*
+     * the inverse only depends on which rows of m are used; taking the
+     * fec blocks in ascending row order keeps the rows sorted so the
+     * cached matrix is the same for every caller.
+     */
+    for(i = 1; i < nr_fec_blocks; i++) {
+        for(j = i; j > 0 && erased_blocks[j-1] > erased_blocks[j]; j--) {
+            SWAP(erased_blocks[j], erased_blocks[j-1], unsigned int);
+        }
+        for(j = i; j > 0 && fec_block_nos[j-1] > fec_block_nos[j]; j--) {
+            SWAP(fec_block_nos[j], fec_block_nos[j-1], unsigned int);
+            SWAP(dec_fec_blocks[j], dec_fec_blocks[j-1], unsigned char*);
+        }
+    }
+    if(RS_MATRIX_PQ == rs->matrix && nr_fec_blocks > 0 && nr_fec_blocks <= 2) {
+        return pq_decode(rs, data_blocks, block_size, dec_fec_blocks, fec_block_nos,
+                erased_blocks, nr_fec_blocks);
+    }
+
+    j = 0;
+    subMatrixRow = 0;
     dataShards = rs->data_shards;
     for(i = 0; i < dataShards; i++) {
         if(j < nr_fec_blocks && i == erased_blocks[j]) {
             j++;
         } else {
-            for(c = 0; c < dataShards; c++) {
-                dataDecodeMatrix[subMatrixRow*dataShards + c] = m[i*dataShards + c];
-            }
+            rows[subMatrixRow] = i;
             subShards[subMatrixRow] = data_blocks[i];
             subMatrixRow++;
         }
     }
 
     for(i = 0; i < nr_fec_blocks && subMatrixRow < dataShards; i++) {
+        rows[subMatrixRow] = dataShards + fec_block_nos[i];
         subShards[subMatrixRow] = dec_fec_blocks[i];
-        j = dataShards + fec_block_nos[i];
-        for(c = 0; c < dataShards; c++) {
-            dataDecodeMatrix[subMatrixRow*dataShards + c] = m[j*dataShards + c];
-        }
         subMatrixRow++;
     }
 
@@ -535,7 +1581,10 @@ int reed_solomon_decode(reed_solomon* rs,
         return -1;
     }
 
-    invert_mat(dataDecodeMatrix, dataShards);
+    if(0 != decode_matrix(rs, rows, dataDecodeMatrix)) {
+        return -1;
+    }
+    STATS(rs_stats_stripe(nr_fec_blocks);)
 
     for(i = 0; i < nr_fec_blocks; i++) {
         j = erased_blocks[i];
@@ -543,8 +1592,429 @@ int reed_solomon_decode(reed_solomon* rs,
         memmove(dataDecodeMatrix+i*dataShards, dataDecodeMatrix+j*dataShards, dataShards);
     }
 
-    return code_some_shards(dataDecodeMatrix, subShards, outputs,
-            dataShards, nr_fec_blocks, block_size);
+    return rs_code_shards(rs, dataDecodeMatrix, subShards, outputs,
+            dataShards, nr_fec_blocks, block_size, NULL, NULL);
+}
+
+int reed_solomon_verify(reed_solomon* rs,
+        unsigned char** data_blocks,
+        unsigned char** fec_blocks,
+        int block_size,
+        unsigned char* bad_rows) {
+    gf scratch[RS_VERIFY_SCRATCH] __attribute__((aligned (64)));
+    unsigned char* inputs[DATA_SHARDS_MAX];
+    unsigned char* outputs[DATA_SHARDS_MAX];
+    int i, r, off, len, chunk, psize, diff, bad = 0;
+    int ds = rs->data_shards, ps = rs->parity_shards;
+
+    if(NULL != bad_rows) {
+        memset(bad_rows, 0, ps);
+    }
+
+    if(RS_MATRIX_CAUCHY == rs->matrix) {
+        /* the same range of all 8 packets, packets chunk apart in scratch */
+        if(0 != block_size % 8) {
+            return -1;
+        }
+        psize = block_size / 8;
+        chunk = RS_VERIFY_SCRATCH / (8 * ps);
+        assert(chunk > 0);
+        for(i = 0; i < ps; i++) {
+            outputs[i] = scratch + i*8*chunk;
+        }
+        for(off = 0; off < psize && !bad; off += chunk) {
+            len = psize - off;
+            if(len > chunk) {
+                len = chunk;
+            }
+            xor_code_range(rs->parity, data_blocks, psize, outputs, chunk, ds, ps, off, len);
+            for(i = 0; i < ps; i++) {
+                diff = 0;
+                for(r = 0; r < 8; r++) {
+                    diff |= 0 != memcmp(outputs[i] + r*chunk, fec_blocks[i] + r*psize + off, len);
+                }
+                bad |= diff;
+                if(NULL != bad_rows) {
+                    bad_rows[i] = diff;
+                }
+            }
+        }
+        return bad;
+    }
+
+    chunk = (RS_VERIFY_SCRATCH / ps) & ~63;
+    assert(chunk > 0);
+    for(i = 0; i < ps; i++) {
+        outputs[i] = scratch + i*chunk;
+    }
+
+    for(off = 0; off < block_size && !bad; off += chunk) {
+        len = block_size - off;
+        if(len > chunk) {
+            len = chunk;
+        }
+        for(i = 0; i < ds; i++) {
+            inputs[i] = data_blocks[i] + off;
+        }
+        code_some_shards(rs->parity, inputs, outputs, ds, ps, len);
+        for(i = 0; i < ps; i++) {
+            diff = 0 != memcmp(outputs[i], fec_blocks[i] + off, len);
+            bad |= diff;
+            if(NULL != bad_rows) {
+                bad_rows[i] = diff;
+            }
+        }
+    }
+    return bad;
+}
+
+/*
+ * Berlekamp-Massey, Chien search and Forney for one byte column with
+ * syndromes s[0..ps-1]; fixes the column in place.  Returns the number
+ * of shards corrected or -1 when there are more errors than ps/2.
+ */
+static int correct_column(reed_solomon* rs, unsigned char** shards, int col,
+        gf* s, unsigned char* corrupted) {
+    gf lambda[DATA_SHARDS_MAX + 1], prev[DATA_SHARDS_MAX + 1], t[DATA_SHARDS_MAX + 1];
+    gf omega[DATA_SHARDS_MAX];
+    gf d, b = 1, coef, xinv, num, den, xp;
+    int n = rs->shards, ps = rs->parity_shards;
+    int i, j, r, len = 0, shift = 1, found = 0;
+    int pos[DATA_SHARDS_MAX];
+    gf val[DATA_SHARDS_MAX];
+
+    memset(lambda, 0, ps + 1);
+    memset(prev, 0, ps + 1);
+    lambda[0] = prev[0] = 1;
+    for(r = 0; r < ps; r++) {
+        d = s[r];
+        for(i = 1; i <= len; i++) {
+            d ^= galMultiply(lambda[i], s[r - i]);
+        }
+        if(0 == d) {
+            shift++;
+            continue;
+        }
+        coef = galMultiply(d, inverse[b]);
+        memcpy(t, lambda, ps + 1);
+        for(i = 0; i + shift <= ps; i++) {
+            lambda[i + shift] ^= galMultiply(coef, prev[i]);
+        }
+        if(2*len <= r) {
+            len = r + 1 - len;
+            memcpy(prev, t, ps + 1);
+            b = d;
+            shift = 1;
+        } else {
+            shift++;
+        }
+    }
+    if(2*len > ps) {
+        return -1;
+    }
+
+    /* omega = S(x) * lambda(x) mod x^ps */
+    for(i = 0; i < ps; i++) {
+        omega[i] = 0;
+        for(j = 0; j <= i && j <= len; j++) {
+            omega[i] ^= galMultiply(lambda[j], s[i - j]);
+        }
+    }
+
+    for(i = 0; i < n && found < len; i++) {
+        xinv = inverse[i ^ RS_SYNDROME_SHIFT];
+        num = 0;
+        for(j = len; j >= 0; j--) {
+            num = galMultiply(num, xinv) ^ lambda[j];
+        }
+        if(0 != num) {
+            continue;
+        }
+        num = 0;
+        for(j = ps - 1; j >= 0; j--) {
+            num = galMultiply(num, xinv) ^ omega[j];
+        }
+        /* lambda'(x) keeps the odd terms only */
+        den = 0;
+        xp = 1;
+        for(j = 1; j <= len; j += 2) {
+            den ^= galMultiply(lambda[j], xp);
+            xp = galMultiply(xp, galMultiply(xinv, xinv));
+        }
+        if(0 == den) {
+            return -1;
+        }
+        /* Y = X * omega(1/X) / lambda'(1/X) = v_i * e */
+        num = galMultiply(galMultiply(num, i ^ RS_SYNDROME_SHIFT), inverse[den]);
+        pos[found] = i;
+        val[found] = galMultiply(num, inverse[rs->syndrome[i]]);
+        found++;
+    }
+    if(found != len) {
+        return -1;
+    }
+
+    for(i = 0; i < found; i++) {
+        shards[pos[i]][col] ^= val[i];
+        if(NULL != corrupted) {
+            corrupted[pos[i]] = 1;
+        }
+    }
+    return found;
+}
+
+int reed_solomon_correct(reed_solomon* rs,
+        unsigned char** shards,
+        int block_size,
+        unsigned char* corrupted) {
+    gf scratch[RS_VERIFY_SCRATCH] __attribute__((aligned (64)));
+    gf s[DATA_SHARDS_MAX];
+    unsigned char* inputs[DATA_SHARDS_MAX];
+    unsigned char* outputs[DATA_SHARDS_MAX];
+    int i, j, off, len, chunk, nonzero, ret = 0;
+    int n = rs->shards, ps = rs->parity_shards;
+
+    if(NULL != corrupted) {
+        memset(corrupted, 0, n);
+    }
+    if(NULL == rs->syndrome) {
+        return -1;
+    }
+
+    chunk = (RS_VERIFY_SCRATCH / ps) & ~63;
+    assert(chunk > 0);
+    for(i = 0; i < ps; i++) {
+        outputs[i] = scratch + i*chunk;
+    }
+
+    for(off = 0; off < block_size; off += chunk) {
+        len = block_size - off;
+        if(len > chunk) {
+            len = chunk;
+        }
+        for(i = 0; i < n; i++) {
+            inputs[i] = shards[i] + off;
+        }
+        code_some_shards(rs->syndrome, inputs, outputs, n, ps, len);
+
+        /* the common case: every syndrome of the chunk is zero */
+        nonzero = 0;
+        for(i = 0; i < ps && !nonzero; i++) {
+            nonzero = 0 != outputs[i][0] || 0 != memcmp(outputs[i], outputs[i] + 1, len - 1);
+        }
+        if(!nonzero) {
+            continue;
+        }
+
+        for(j = 0; j < len; j++) {
+            nonzero = 0;
+            for(i = 0; i < ps; i++) {
+                s[i] = outputs[i][j];
+                nonzero |= s[i];
+            }
+            if(nonzero && correct_column(rs, shards, off + j, s, corrupted) < 0) {
+                ret = 1;
+            }
+        }
+    }
+    return ret;
+}
+
+int reed_solomon_update(reed_solomon* rs,
+        int index,
+        unsigned char* old_data,
+        unsigned char* new_data,
+        unsigned char** fec_blocks,
+        int offset,
+        int len) {
+    gf delta[4096] __attribute__((aligned (64)));
+    int i, r, off, n, ds = rs->data_shards;
+
+    /* packet positions depend on the block size, which is not known here */
+    if(RS_MATRIX_CAUCHY == rs->matrix) {
+        return -1;
+    }
+    if(index < 0 || index >= ds || offset < 0 || len < 0) {
+        return -1;
+    }
+
+    for(off = 0; off < len; off += n) {
+        n = len - off;
+        if(n > (int)sizeof(delta)) {
+            n = sizeof(delta);
+        }
+        for(i = 0; i < n; i++) {
+            delta[i] = old_data[off + i] ^ new_data[off + i];
+        }
+        for(r = 0; r < rs->parity_shards; r++) {
+            addmul(fec_blocks[r] + offset + off, delta, rs->parity[r*ds + index], n);
+        }
+    }
+    return 0;
+}
+
+/*
+ * Progressive encoding: each data shard is multiplied into every parity
+ * block as soon as it is added, a chunk at a time so the parity chunks
+ * and the input chunk stay in L1 together.  The first shard added
+ * overwrites the parity instead of accumulating, so nothing has to be
+ * cleared beforehand.
+ */
+int reed_solomon_encoder_init(rs_encoder* enc, reed_solomon* rs,
+        unsigned char** fec_blocks, int block_size) {
+    if(block_size < 0 || (RS_MATRIX_CAUCHY == rs->matrix && 0 != block_size % 8)) {
+        return -1;
+    }
+    enc->rs = rs;
+    enc->fec_blocks = fec_blocks;
+    enc->block_size = block_size;
+    enc->added = 0;
+    memset(enc->seen, 0, sizeof(enc->seen));
+    return 0;
+}
+
+/* Cauchy: output packet r of row i gets the input packets gf_bitrow selects */
+static void xor_add_shard(gf* column, gf* input, gf** outputs, int outputCount,
+        int byteCount, int first) {
+    gf* srcs[9];
+    unsigned mask;
+    int i, r, q, len, nsrc, chunk, psize = byteCount / 8;
+
+    chunk = (RS_CHUNK_SIZE / (8 * (outputCount + 1))) & ~63;
+    if(chunk < 64) {
+        chunk = 64;
+    }
+    for(q = 0; q < psize; q += chunk) {
+        len = psize - q;
+        if(len > chunk) {
+            len = chunk;
+        }
+        for(i = 0; i < outputCount; i++) {
+            for(r = 0; r < 8; r++) {
+                nsrc = 0;
+                if(!first) {
+                    srcs[nsrc++] = outputs[i] + r*psize + q;
+                }
+                for(mask = gf_bitrow[column[i]][r]; 0 != mask; mask &= mask - 1) {
+                    srcs[nsrc++] = input + __builtin_ctz(mask)*psize + q;
+                }
+                xor_sources(outputs[i] + r*psize + q, srcs, nsrc, len);
+            }
+        }
+    }
+}
+
+int reed_solomon_encoder_add(rs_encoder* enc, int index, unsigned char* data) {
+    reed_solomon* rs = enc->rs;
+    gf column[DATA_SHARDS_MAX];
+    gf_code_fn addmul_fn, mul_fn;
+    int r, start, len, chunk, kernel, first;
+    int ds = rs->data_shards, ps = rs->parity_shards, bs = enc->block_size;
+    STATS(long long ticks;)
+
+    if(index < 0 || index >= ds || enc->seen[index]) {
+        return -1;
+    }
+    TICK(ticks);
+    first = (0 == enc->added);
+    for(r = 0; r < ps; r++) {
+        column[r] = rs->parity[r*ds + index];
+    }
+
+    if(RS_MATRIX_CAUCHY == rs->matrix) {
+        xor_add_shard(column, data, enc->fec_blocks, ps, bs, first);
+    } else {
+        kernel = current_kernel();
+        addmul_fn = gf_kernels[kernel].addmul1;
+        mul_fn = gf_kernels[kernel].mul1;
+        chunk = (RS_CHUNK_SIZE / (ps + 1)) & ~63;
+        if(chunk < 256) {
+            chunk = 256;
+        }
+        for(start = 0; start < bs; start += chunk) {
+            len = bs - start;
+            if(len > chunk) {
+                len = chunk;
+            }
+            for(r = 0; r < ps; r++) {
+                if(first) {
+                    if(0 != column[r]) {
+                        mul_fn(enc->fec_blocks[r] + start, data + start, column[r], len);
+                    } else {
+                        memset(enc->fec_blocks[r] + start, 0, len);
+                    }
+                } else if(0 != column[r]) {
+                    addmul_fn(enc->fec_blocks[r] + start, data + start, column[r], len);
+                }
+            }
+        }
+    }
+    TOCK(ticks);
+    STAT_ADD(code_calls, 1);
+    STAT_ADD(code_bytes, bs);
+    STAT_ADD(code_cycles, ticks);
+
+    enc->seen[index] = 1;
+    if(++enc->added < ds) {
+        return 0;
+    }
+    STAT_STRIPE(stripes_encoded, 1);
+    return 1;
+}
+
+/*
+ * Encode stripes of different sizes in one call.  The kernel is looked
+ * up once for the whole batch, and the head of the next stripe's data
+ * blocks is prefetched while the current one is coded, which is most
+ * of the win for small objects.
+ */
+int reed_solomon_encode_batch(reed_solomon* rs, rs_stripe* stripes, int nr_stripes) {
+    gf_code_fn addmul_fn, mul_fn;
+    rs_stripe* next;
+    int i, c, kernel, ahead, err = 0;
+    int ds = rs->data_shards, ps = rs->parity_shards;
+    STATS(long long ticks; long long bytes = 0;)
+
+    TICK(ticks);
+    kernel = current_kernel();
+    addmul_fn = gf_kernels[kernel].addmul1;
+    mul_fn = gf_kernels[kernel].mul1;
+    /* no more than one coding chunk's worth of prefetch in flight */
+    ahead = (RS_CHUNK_SIZE / ds) & ~63;
+    if(ahead < 64) {
+        ahead = 64;
+    }
+
+    for(i = 0; i < nr_stripes; i++) {
+        if(i + 1 < nr_stripes) {
+            next = &stripes[i + 1];
+            for(c = 0; c < ds; c++) {
+                prefetch_chunk(next->data_blocks[c],
+                        next->block_size < ahead ? next->block_size : ahead);
+            }
+        }
+        if(stripes[i].block_size < 0) {
+            err = -1;
+            continue;
+        }
+        if(RS_MATRIX_PQ == rs->matrix) {
+            pq_code_shards(stripes[i].data_blocks, stripes[i].fec_blocks, ds, ps,
+                    stripes[i].block_size, NULL, NULL);
+        } else if(RS_MATRIX_CAUCHY == rs->matrix) {
+            err |= xor_code_shards(rs->parity, stripes[i].data_blocks, stripes[i].fec_blocks,
+                    ds, ps, stripes[i].block_size);
+        } else {
+            code_shards_with(addmul_fn, mul_fn, rs->parity, stripes[i].data_blocks,
+                    stripes[i].fec_blocks, ds, ps, stripes[i].block_size);
+        }
+        STATS(bytes += (long long)ds * stripes[i].block_size;)
+    }
+    TOCK(ticks);
+    STAT_ADD(stripes_encoded, nr_stripes);
+    STAT_ADD(code_calls, nr_stripes);
+    STAT_ADD(code_bytes, bytes);
+    STAT_ADD(code_cycles, ticks);
+    return err;
 }
 
 int reed_solomon_encode2(reed_solomon* rs, unsigned char** shards, int nr_shards, int block_size) {
@@ -619,3 +2089,257 @@ int reed_solomon_reconstruct(reed_solomon* rs,
     }
     return err;
 }
+
+/*
+ * Recompute the erased shards of one stripe that are also wanted, data
+ * or parity, in a single pass over data_shards survivors.  Parity rows
+ * are folded through the inverse so they are taken from the survivors
+ * directly rather than from recovered data.  The survivors read are the
+ * first data_shards unmarked ones, data before parity; crcs (rs->shards
+ * entries, may be NULL) receives the CRC32C of each of them and of
+ * every rebuilt shard, by position in the stripe.
+ */
+static int reconstruct_stripe(reed_solomon* rs,
+        unsigned char** data_blocks, unsigned char** fec_blocks,
+        unsigned char* marks, unsigned char* fec_marks,
+        unsigned char* wanted, unsigned char* fec_wanted,
+        int block_size, unsigned int* crcs) {
+    gf inverse[DATA_SHARDS_MAX*DATA_SHARDS_MAX];
+    gf matrixRows[DATA_SHARDS_MAX*DATA_SHARDS_MAX];
+    unsigned char* inputs[DATA_SHARDS_MAX];
+    unsigned char* outputs[DATA_SHARDS_MAX];
+    unsigned int in_crcs[DATA_SHARDS_MAX];
+    unsigned int out_crcs[DATA_SHARDS_MAX];
+    int rows[DATA_SHARDS_MAX];
+    int out_rows[DATA_SHARDS_MAX];
+    int i, j, ret, n = 0, nout = 0, erased = 0;
+    int ds = rs->data_shards, ps = rs->parity_shards;
+    gf* row;
+
+    for(i = 0; i < ds; i++) {
+        erased += 0 != marks[i];
+        nout += marks[i] && wanted[i];
+    }
+    for(i = 0; i < ps; i++) {
+        nout += fec_marks[i] && fec_wanted[i];
+    }
+    if(0 == nout) {
+        return 0;
+    }
+
+    for(i = 0; i < ds; i++) {
+        if(!marks[i]) {
+            rows[n] = i;
+            inputs[n++] = data_blocks[i];
+        }
+    }
+    for(i = 0; i < ps && n < ds; i++) {
+        if(!fec_marks[i]) {
+            rows[n] = ds + i;
+            inputs[n++] = fec_blocks[i];
+        }
+    }
+    if(n < ds) {
+        return -1;
+    }
+    if(erased > 0 && 0 != decode_matrix(rs, rows, inverse)) {
+        return -1;
+    }
+    STATS(for(i = 0, j = erased; i < ps; i++) j += 0 != fec_marks[i];)
+    STATS(rs_stats_stripe(j);)
+
+    nout = 0;
+    for(i = 0; i < ds; i++) {
+        if(marks[i] && wanted[i]) {
+            memcpy(matrixRows + nout*ds, inverse + i*ds, ds);
+            out_rows[nout] = i;
+            outputs[nout++] = data_blocks[i];
+        }
+    }
+    for(i = 0; i < ps; i++) {
+        if(fec_marks[i] && fec_wanted[i]) {
+            out_rows[nout] = ds + i;
+            row = matrixRows + nout*ds;
+            if(0 == erased) {
+                memcpy(row, rs->parity + i*ds, ds);
+            } else {
+                memset(row, 0, ds);
+                for(j = 0; j < ds; j++) {
+                    addmul(row, inverse + j*ds, rs->parity[i*ds + j], ds);
+                }
+            }
+            outputs[nout++] = fec_blocks[i];
+        }
+    }
+
+    if(NULL == crcs) {
+        return rs_code_shards(rs, matrixRows, inputs, outputs, ds, nout, block_size, NULL, NULL);
+    }
+    ret = rs_code_shards(rs, matrixRows, inputs, outputs, ds, nout, block_size, in_crcs, out_crcs);
+    for(i = 0; i < ds; i++) {
+        crcs[rows[i]] = in_crcs[i];
+    }
+    for(i = 0; i < nout; i++) {
+        crcs[out_rows[i]] = out_crcs[i];
+    }
+    return ret;
+}
+
+int reed_solomon_reconstruct_some(reed_solomon* rs,
+        unsigned char** shards,
+        unsigned char* marks,
+        unsigned char* wanted,
+        int nr_shards,
+        int block_size) {
+    unsigned char **data_blocks, **fec_blocks;
+    unsigned char *fec_marks, *fec_wanted;
+    int j, n;
+    int ds = rs->data_shards;
+    int ps = rs->parity_shards;
+    int err = 0;
+
+    n = nr_shards / rs->shards;
+    data_blocks = shards;
+    fec_blocks = shards + n*ds;
+    fec_marks = marks + n*ds;
+    fec_wanted = wanted + n*ds;
+
+    for(j = 0; j < n; j++) {
+        if(0 != reconstruct_stripe(rs, data_blocks, fec_blocks, marks, fec_marks,
+                    wanted, fec_wanted, block_size, NULL)) {
+            err = -1;
+        }
+        data_blocks += ds;
+        marks += ds;
+        wanted += ds;
+        fec_blocks += ps;
+        fec_marks += ps;
+        fec_wanted += ps;
+    }
+    return err;
+}
+
+/*
+ * Check one stripe against the CRC32C it was encoded with and rebuild
+ * whatever is erased or does not match.  With nothing erased that is a
+ * single checksum pass.  Otherwise the survivors the rebuild reads are
+ * checked in the same pass and only the parity it leaves out is read
+ * on its own; a survivor that turns out bad is marked and the rebuild
+ * runs again without it.
+ */
+static int reconstruct_stripe_crc(reed_solomon* rs,
+        unsigned char** data_blocks, unsigned char** fec_blocks,
+        unsigned char* marks, unsigned char* fec_marks,
+        const unsigned int* expect, const unsigned int* fec_expect,
+        int block_size) {
+    unsigned char wanted[DATA_SHARDS_MAX];
+    unsigned char checked[DATA_SHARDS_MAX];     /* survivors whose CRC already matched */
+    unsigned char* shards[DATA_SHARDS_MAX];
+    unsigned char* mark[DATA_SHARDS_MAX];
+    unsigned int want[DATA_SHARDS_MAX];
+    unsigned int crcs[DATA_SHARDS_MAX];
+    int i, n, bad, erased;
+    int ds = rs->data_shards, ps = rs->parity_shards;
+
+    for(i = 0; i < ds; i++) {
+        shards[i] = data_blocks[i];
+        mark[i] = &marks[i];
+        want[i] = expect[i];
+    }
+    for(i = 0; i < ps; i++) {
+        shards[ds + i] = fec_blocks[i];
+        mark[ds + i] = &fec_marks[i];
+        want[ds + i] = fec_expect[i];
+    }
+    memset(wanted, 1, rs->shards);
+    memset(checked, 0, rs->shards);
+
+    for(;;) {
+        erased = 0;
+        for(i = 0; i < rs->shards; i++) {
+            erased += 0 != *mark[i];
+        }
+        if(erased > ps) {
+            return -1;
+        }
+
+        /* every shard when nothing is erased, else the ones past the first data_shards survivors */
+        bad = 0;
+        for(i = 0, n = 0; i < rs->shards; i++) {
+            if(*mark[i] || (0 != erased && n++ < ds) || checked[i]) {
+                continue;
+            }
+            if(reed_solomon_crc32c(0, shards[i], block_size) != want[i]) {
+                *mark[i] = 1;
+                bad++;
+            } else {
+                checked[i] = 1;
+            }
+        }
+        if(0 == erased && 0 == bad) {
+            return 0;
+        }
+        if(bad > 0) {
+            continue;
+        }
+
+        if(0 != reconstruct_stripe(rs, data_blocks, fec_blocks, marks, fec_marks,
+                    wanted, wanted + ds, block_size, crcs)) {
+            return -1;
+        }
+        for(i = 0, n = 0; i < rs->shards; i++) {
+            if(!*mark[i] && n++ < ds) {
+                if(crcs[i] != want[i]) {
+                    *mark[i] = 1;
+                    bad++;
+                } else {
+                    checked[i] = 1;
+                }
+            }
+        }
+        if(bad > 0) {
+            continue;
+        }
+        for(i = 0; i < rs->shards; i++) {
+            if(*mark[i] && crcs[i] != want[i]) {
+                return -1;
+            }
+        }
+        return 0;
+    }
+}
+
+int reed_solomon_reconstruct_crc(reed_solomon* rs,
+        unsigned char** shards,
+        unsigned char* marks,
+        const unsigned int* crcs,
+        int nr_shards,
+        int block_size) {
+    unsigned char **data_blocks, **fec_blocks;
+    unsigned char* fec_marks;
+    const unsigned int* fec_crcs;
+    int j, n;
+    int ds = rs->data_shards;
+    int ps = rs->parity_shards;
+    int err = 0;
+
+    n = nr_shards / rs->shards;
+    data_blocks = shards;
+    fec_blocks = shards + n*ds;
+    fec_marks = marks + n*ds;
+    fec_crcs = crcs + n*ds;
+
+    for(j = 0; j < n; j++) {
+        if(0 != reconstruct_stripe_crc(rs, data_blocks, fec_blocks, marks, fec_marks,
+                    crcs, fec_crcs, block_size)) {
+            err = -1;
+        }
+        data_blocks += ds;
+        marks += ds;
+        crcs += ds;
+        fec_blocks += ps;
+        fec_marks += ps;
+        fec_crcs += ps;
+    }
+    return err;
+}
@@ -5,6 +5,17 @@
 #define DATA_SHARDS_MAX (255)
 #endif
 
+/* every allocation of the library goes through these, rs_slab.c has a set */
+#ifdef RS_SLAB_HOOKS
+#include <stddef.h>
+void* rs_slab_malloc(size_t size);
+void* rs_slab_calloc(size_t n, size_t size);
+void rs_slab_free(void* p);
+#define RS_MALLOC(x)    rs_slab_malloc(x)
+#define RS_FREE(x)      rs_slab_free(x)
+#define RS_CALLOC(n, x) rs_slab_calloc(n, x)
+#endif
+
 #ifndef RS_MALLOC
 #define RS_MALLOC(x)    malloc(x)
 #endif
@@ -17,24 +28,143 @@
 #define RS_CALLOC(n, x) calloc(n, x)
 #endif
 
+/* L1 budget shared by the output chunks and one input chunk */
+#ifndef RS_CHUNK_SIZE
+#define RS_CHUNK_SIZE (16 * 1024)
+#endif
+
+/* stack scratch used by reed_solomon_verify and reed_solomon_correct */
+#ifndef RS_VERIFY_SCRATCH
+#define RS_VERIFY_SCRATCH (16 * 1024)
+#endif
+
+#ifndef RS_DECODE_CACHE_SIZE
+#define RS_DECODE_CACHE_SIZE (8)
+#endif
+
+/* parity matrix construction, see reed_solomon_new2 */
+#define RS_MATRIX_AUTO        (-1)
+#define RS_MATRIX_VANDERMONDE (0)
+#define RS_MATRIX_CAUCHY      (1)
+#define RS_MATRIX_PQ          (2)
+
+struct _rs_decode_cache;
+
 typedef struct _reed_solomon {
     int data_shards;
     int parity_shards;
     int shards;
+    int matrix;
     unsigned char* m;
     unsigned char* parity;
+    /* parity-check rows used by reed_solomon_correct, NULL for Cauchy */
+    unsigned char* syndrome;
+    /* inverted decode matrices keyed by the surviving shards used */
+    struct _rs_decode_cache* cache;
+    unsigned long long cache_hits;
+    unsigned long long cache_misses;
+    /* reference count of codecs shared through reed_solomon_acquire */
+    int refs;
+    int shared;
+    struct _reed_solomon* next;
 } reed_solomon;
 
+/* erasure histogram buckets, the last one counts that many or more */
+#ifndef RS_STATS_ERASURES
+#define RS_STATS_ERASURES (16)
+#endif
+
+/*
+ * Process wide counters, only kept when rs.c is built with -DRS_STATS.
+ * Cycles are TSC ticks (nanoseconds where there is no TSC).
+ */
+typedef struct _rs_stats {
+    unsigned long long matrix_builds;       /* reed_solomon_new* */
+    unsigned long long matrix_cycles;
+    unsigned long long inversions;          /* decode matrices not found in the cache */
+    unsigned long long invert_cycles;
+    unsigned long long code_calls;          /* passes of the coding kernels */
+    unsigned long long code_bytes;          /* input bytes of those passes */
+    unsigned long long code_cycles;
+    unsigned long long stripes_encoded;
+    unsigned long long stripes_reconstructed;
+    unsigned long long erasures[RS_STATS_ERASURES]; /* reconstructed stripes by shards lost */
+} rs_stats;
+
+#define FEC_KERNEL_AUTO   (-1)
+#define FEC_KERNEL_SCALAR (0)
+#define FEC_KERNEL_SSSE3  (1)
+#define FEC_KERNEL_AVX2   (2)
+#define FEC_KERNEL_AVX512 (3)
+#define FEC_KERNEL_GFNI   (4)
+#define FEC_KERNEL_MAX    (5)
+
+/* no-op, the tables are static data; kept for source compatibility */
 void fec_init(void);
 
+/* the fastest supported kernel is picked on first use; these override it */
+int fec_kernel_supported(int kernel);
+int fec_set_kernel(int kernel);
+int fec_get_kernel(void);
+const char* fec_kernel_name(int kernel);
+
+/* reed_solomon_new2 with RS_MATRIX_VANDERMONDE */
 reed_solomon* reed_solomon_new(int data_shards, int parity_shards);
+/*
+ * RS_MATRIX_CAUCHY codes through XOR-only 8x8 bit matrices instead of
+ * GF table lookups.  Shards are not compatible with the Vandermonde
+ * codec, block_size must be a multiple of 8 and reed_solomon_update is
+ * not available.
+ *
+ * RS_MATRIX_PQ is the RAID-6 code for at most 2 parity shards: P is the
+ * XOR of the data and Q the sum of 2^i * data[i], both computed in a
+ * single pass, and up to two lost data shards are solved for directly.
+ * Shards are not compatible with the Vandermonde codec and
+ * reed_solomon_correct is not available.
+ *
+ * RS_MATRIX_AUTO is RS_MATRIX_PQ for 1 or 2 parity shards and
+ * RS_MATRIX_VANDERMONDE otherwise.  Nothing in a shard tells which
+ * codec wrote it, so the choice has to be recorded with the data.
+ */
+reed_solomon* reed_solomon_new2(int data_shards, int parity_shards, int matrix);
+/*
+ * shared, reference counted codec for a geometry, built on first use;
+ * safe to call from any thread and dropped with reed_solomon_release
+ */
+reed_solomon* reed_solomon_acquire(int data_shards, int parity_shards, int matrix);
 void reed_solomon_release(reed_solomon* rs);
 
+void reed_solomon_cache_stats(reed_solomon* rs, unsigned long long* hits, unsigned long long* misses);
+
+/* snapshot of the RS_STATS counters; returns 0 (all zero) when compiled out */
+int reed_solomon_stats(rs_stats* stats);
+void reed_solomon_stats_reset(void);
+/*
+ * while mute is set, the calling thread's calls leave the stripe counts
+ * and the erasure histogram alone; for a stripe coded in byte ranges,
+ * counted once by the range that owns it
+ */
+void reed_solomon_stats_mute(int mute);
+
 int reed_solomon_encode(reed_solomon* rs,
         unsigned char** data_blocks,
         unsigned char** fec_blocks,
         int block_size);
 
+/*
+ * reed_solomon_encode that also returns the CRC32C of every shard in
+ * crcs (data then parity, rs->shards entries), computed while each
+ * chunk is in cache rather than in a pass of its own
+ */
+int reed_solomon_encode_crc(reed_solomon* rs,
+        unsigned char** data_blocks,
+        unsigned char** fec_blocks,
+        int block_size,
+        unsigned int* crcs);
+
+/* CRC32C (Castagnoli) of buf continued from crc, 0 to start */
+unsigned int reed_solomon_crc32c(unsigned int crc, const unsigned char* buf, int len);
+
 int reed_solomon_decode(reed_solomon* rs,
         unsigned char **data_blocks,
         int block_size,
@@ -43,7 +173,92 @@ int reed_solomon_decode(reed_solomon* rs,
         unsigned int *erased_blocks,
         int nr_fec_blocks);
 
+/*
+ * recompute parity chunk by chunk and compare it with fec_blocks; returns
+ * 0 when it matches and 1 at the first mismatching chunk, with the rows
+ * that disagree there flagged in bad_rows (may be NULL)
+ */
+int reed_solomon_verify(reed_solomon* rs,
+        unsigned char** data_blocks,
+        unsigned char** fec_blocks,
+        int block_size,
+        unsigned char* bad_rows);
+
+/*
+ * find and repair corrupted shards without knowing which ones they are:
+ * up to parity_shards/2 bad shards in every byte column.  corrupted
+ * (rs->shards entries, may be NULL) flags the shards that were changed.
+ * Returns 0 when the stripe is now consistent, 1 when some column had
+ * too many errors and was left alone, -1 for Cauchy and P+Q codecs.
+ */
+int reed_solomon_correct(reed_solomon* rs,
+        unsigned char** shards,
+        int block_size,
+        unsigned char* corrupted);
+
+/*
+ * data shard index changed from old_data to new_data (len bytes at
+ * offset); fold the difference into every fec block in place
+ */
+int reed_solomon_update(reed_solomon* rs,
+        int index,
+        unsigned char* old_data,
+        unsigned char* new_data,
+        unsigned char** fec_blocks,
+        int offset,
+        int len);
+
+/*
+ * progressive encoding, for data shards that arrive one at a time in
+ * any order: each added shard is folded into fec_blocks right away and
+ * the parity is complete when the last one is added.  fec_blocks (the
+ * array and the blocks) must stay valid until then.
+ */
+typedef struct _rs_encoder {
+    reed_solomon* rs;
+    unsigned char** fec_blocks;
+    int block_size;
+    int added;
+    unsigned char seen[DATA_SHARDS_MAX];
+} rs_encoder;
+
+int reed_solomon_encoder_init(rs_encoder* enc, reed_solomon* rs,
+        unsigned char** fec_blocks, int block_size);
+
+/* returns 1 when that was the last data shard, 0 before, -1 for a bad or repeated index */
+int reed_solomon_encoder_add(rs_encoder* enc, int index, unsigned char* data);
+
 int reed_solomon_encode2(reed_solomon* rs, unsigned char** shards, int nr_shards, int block_size);
 
+/* one stripe of a batch, every stripe has its own buffers and size */
+typedef struct _rs_stripe {
+    unsigned char** data_blocks;
+    unsigned char** fec_blocks;
+    int block_size;
+} rs_stripe;
+
+/*
+ * encode every stripe of the batch; returns -1 if any stripe could not
+ * be encoded (negative size, or not a multiple of 8 for Cauchy)
+ */
+int reed_solomon_encode_batch(reed_solomon* rs, rs_stripe* stripes, int nr_stripes);
+
 int reed_solomon_reconstruct(reed_solomon* rs, unsigned char** shards, unsigned char* marks, int nr_shards, int block_size);
+
+/*
+ * like reed_solomon_reconstruct, but rebuilds exactly the erased shards
+ * flagged in wanted (same layout as marks), parity shards included
+ */
+int reed_solomon_reconstruct_some(reed_solomon* rs, unsigned char** shards, unsigned char* marks,
+        unsigned char* wanted, int nr_shards, int block_size);
+
+/*
+ * like reed_solomon_reconstruct, with crcs (same layout as marks) from
+ * reed_solomon_encode_crc: shards whose CRC32C does not match are
+ * marked as well, and every marked shard, parity included, is rebuilt
+ * and checked.  Survivors are checked in the same pass that reads them.
+ * Returns -1 if some stripe has more bad shards than parity.
+ */
+int reed_solomon_reconstruct_crc(reed_solomon* rs, unsigned char** shards, unsigned char* marks,
+        const unsigned int* crcs, int nr_shards, int block_size);
 #endif
\ No newline at end of file
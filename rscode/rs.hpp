@@ -0,0 +1,336 @@
+#ifndef __RS_HPP_
+#define __RS_HPP_
+
+/*
+ * Reed-Solomon encoding specialised at compile time for a fixed
+ * geometry.  ReedSolomon<K, M> computes the systematic Vandermonde
+ * parity matrix of reed_solomon_new(K, M) as constexpr data and
+ * unrolls the loops over it one group of columns at a time, each group
+ * a noinline function small enough to stay in the instruction cache.
+ * Within a group every coefficient is a constant, zero coefficients
+ * vanish, ones become a plain XOR, the rest are one GF2P8AFFINE or a
+ * pair of nibble table shuffles with the tables baked in.  There is no
+ * coefficient lookup and no branch left in the inner loop.
+ *
+ * The kernel is chosen when the header is compiled (AVX2 with -mavx2,
+ * SSSE3 with -mssse3, either with GFNI when -mgfni is added, scalar
+ * otherwise), while the C codec picks its own at run time.
+ * rscode::encode only takes the template when it has a SIMD kernel no
+ * slower than that one.  Parity is byte for byte that of
+ * reed_solomon_encode, so shards are interchangeable with the C codec,
+ * which stays the fallback for other geometries and for
+ * reconstruction.  Needs C++17 and rs.c linked in.
+ */
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+#if defined(__AVX2__) || defined(__SSSE3__)
+#include <immintrin.h>
+#endif
+
+extern "C" {
+#include "rs.h"
+}
+
+#define RS_HPP_INLINE inline __attribute__((always_inline))
+
+namespace rscode {
+
+namespace detail {
+
+constexpr int gf_size = 255;
+
+struct gf_tables {
+    std::array<uint8_t, 2 * gf_size> exp{};
+    std::array<int, gf_size + 1> log{};
+};
+
+/* the field of rs.c, generator polynomial 101110001 */
+constexpr gf_tables make_gf_tables() {
+    gf_tables t;
+    int x = 1;
+    for(int i = 0; i < gf_size; i++) {
+        t.exp[i] = t.exp[i + gf_size] = static_cast<uint8_t>(x);
+        t.log[x] = i;
+        x <<= 1;
+        if(x & 0x100) {
+            x ^= 0x11d;
+        }
+    }
+    t.log[0] = gf_size;
+    return t;
+}
+
+inline constexpr gf_tables gf = make_gf_tables();
+
+constexpr uint8_t gf_mul(uint8_t a, uint8_t b) {
+    return (0 == a || 0 == b) ? 0 : gf.exp[gf.log[a] + gf.log[b]];
+}
+
+/* same closed form as vandermonde_systematic in rs.c */
+template <int K, int M>
+constexpr std::array<std::array<uint8_t, K>, M> parity_matrix() {
+    std::array<std::array<uint8_t, K>, M> p{};
+    std::array<int, K> logw{};
+    for(int i = 0; i < K; i++) {
+        for(int j = 0; j < K; j++) {
+            if(j != i) {
+                logw[i] += gf.log[i ^ j];
+            }
+        }
+        logw[i] %= gf_size;
+    }
+    for(int r = 0; r < M; r++) {
+        int x = K + r;
+        int logp = 0;
+        for(int j = 0; j < K; j++) {
+            logp += gf.log[x ^ j];
+        }
+        for(int i = 0; i < K; i++) {
+            p[r][i] = gf.exp[(logp + 2 * gf_size - gf.log[x ^ i] - logw[i]) % gf_size];
+        }
+    }
+    return p;
+}
+
+/* c * x is lo[x & 15] ^ hi[x >> 4] */
+struct nibble_table {
+    alignas(16) uint8_t lo[16];
+    alignas(16) uint8_t hi[16];
+};
+
+template <int K, int M>
+constexpr std::array<nibble_table, K * M> nibble_tables(const std::array<std::array<uint8_t, K>, M>& p) {
+    std::array<nibble_table, K * M> t{};
+    for(int r = 0; r < M; r++) {
+        for(int c = 0; c < K; c++) {
+            for(int i = 0; i < 16; i++) {
+                t[r * K + c].lo[i] = gf_mul(p[r][c], static_cast<uint8_t>(i));
+                t[r * K + c].hi[i] = gf_mul(p[r][c], static_cast<uint8_t>(i << 4));
+            }
+        }
+    }
+    return t;
+}
+
+#if defined(__AVX2__)
+struct vec256 {
+    typedef __m256i type;
+    static constexpr size_t width = 32;
+    static RS_HPP_INLINE type zero() { return _mm256_setzero_si256(); }
+    static RS_HPP_INLINE type load(const unsigned char* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+    static RS_HPP_INLINE void store(unsigned char* p, type v) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v); }
+    static RS_HPP_INLINE type xor_(type a, type b) { return _mm256_xor_si256(a, b); }
+    static RS_HPP_INLINE type table(const uint8_t* t) {
+        return _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(t)));
+    }
+    static RS_HPP_INLINE type shuffle(type t, type i) { return _mm256_shuffle_epi8(t, i); }
+    static RS_HPP_INLINE type low(type x) { return _mm256_and_si256(x, _mm256_set1_epi8(0x0f)); }
+    static RS_HPP_INLINE type high(type x) { return _mm256_and_si256(_mm256_srli_epi64(x, 4), _mm256_set1_epi8(0x0f)); }
+#if defined(__GFNI__)
+    static RS_HPP_INLINE type affine(type x, uint64_t a) {
+        return _mm256_gf2p8affine_epi64_epi8(x, _mm256_set1_epi64x(static_cast<long long>(a)), 0);
+    }
+#endif
+};
+typedef vec256 vec;
+#elif defined(__SSSE3__)
+struct vec128 {
+    typedef __m128i type;
+    static constexpr size_t width = 16;
+    static RS_HPP_INLINE type zero() { return _mm_setzero_si128(); }
+    static RS_HPP_INLINE type load(const unsigned char* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+    static RS_HPP_INLINE void store(unsigned char* p, type v) { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v); }
+    static RS_HPP_INLINE type xor_(type a, type b) { return _mm_xor_si128(a, b); }
+    static RS_HPP_INLINE type table(const uint8_t* t) { return _mm_load_si128(reinterpret_cast<const __m128i*>(t)); }
+    static RS_HPP_INLINE type shuffle(type t, type i) { return _mm_shuffle_epi8(t, i); }
+    static RS_HPP_INLINE type low(type x) { return _mm_and_si128(x, _mm_set1_epi8(0x0f)); }
+    static RS_HPP_INLINE type high(type x) { return _mm_and_si128(_mm_srli_epi64(x, 4), _mm_set1_epi8(0x0f)); }
+#if defined(__GFNI__)
+    static RS_HPP_INLINE type affine(type x, uint64_t a) {
+        return _mm_gf2p8affine_epi64_epi8(x, _mm_set1_epi64x(static_cast<long long>(a)), 0);
+    }
+#endif
+};
+typedef vec128 vec;
+#endif
+
+} // namespace detail
+
+template <int K, int M>
+class ReedSolomon {
+public:
+    static_assert(K > 0 && M > 0 && K + M <= DATA_SHARDS_MAX, "unsupported geometry");
+
+    static constexpr int data_shards = K;
+    static constexpr int parity_shards = M;
+    static constexpr int shards = K + M;
+
+    /* the FEC_KERNEL_* this was compiled for, to rank it against fec_get_kernel() */
+#if defined(__AVX2__) && defined(__GFNI__)
+    static constexpr int kernel = FEC_KERNEL_GFNI;
+#elif defined(__AVX2__)
+    static constexpr int kernel = FEC_KERNEL_AVX2;
+#elif defined(__SSSE3__)
+    static constexpr int kernel = FEC_KERNEL_SSSE3;
+#else
+    static constexpr int kernel = FEC_KERNEL_SCALAR;
+#endif
+
+    /* rows of the parity matrix, rs->parity of reed_solomon_new(K, M) */
+    static constexpr std::array<std::array<uint8_t, K>, M> parity = detail::parity_matrix<K, M>();
+
+    static void encode(const unsigned char* const* data_blocks, unsigned char* const* fec_blocks,
+            size_t block_size) {
+        size_t off = 0;
+#if defined(__AVX2__) || defined(__SSSE3__)
+        size_t end, whole = block_size & ~(detail::vec::width - 1);
+        for(; off < whole; off = end) {
+            end = off + chunk < whole ? off + chunk : whole;
+            groups(data_blocks, fec_blocks, off, end, std::make_index_sequence<(K + group - 1) / group>{});
+        }
+#endif
+        for(; off < block_size; off++) {
+            for(int r = 0; r < M; r++) {
+                uint8_t a = 0;
+                for(int c = 0; c < K; c++) {
+                    uint8_t x = data_blocks[c][off];
+                    a ^= tables[r * K + c].lo[x & 15] ^ tables[r * K + c].hi[x >> 4];
+                }
+                fec_blocks[r][off] = a;
+            }
+        }
+    }
+
+    /* the geometry is fixed, decoding goes through the shared C codec */
+    static int reconstruct(unsigned char** shards, unsigned char* marks, int nr_shards, int block_size) {
+        reed_solomon* rs = codec();
+        return NULL == rs ? -1 : reed_solomon_reconstruct(rs, shards, marks, nr_shards, block_size);
+    }
+
+    static reed_solomon* codec() {
+        static reed_solomon* rs = reed_solomon_acquire(K, M, RS_MATRIX_VANDERMONDE);
+        return rs;
+    }
+
+private:
+    static constexpr std::array<detail::nibble_table, K * M> tables = detail::nibble_tables<K, M>(parity);
+
+#if defined(__AVX2__) || defined(__SSSE3__)
+    typedef detail::vec V;
+    typedef typename V::type vtype;
+
+    /*
+     * As in code_some_shards, the parity chunks and one input chunk stay
+     * in L1 while the columns are applied a group at a time; a group is
+     * small enough that its unrolled code stays in the instruction cache.
+     */
+    static constexpr size_t chunk = ((RS_CHUNK_SIZE / (M + 1)) & ~63) < 256 ? 256 : ((RS_CHUNK_SIZE / (M + 1)) & ~63);
+    static constexpr int group = M >= 96 ? 1 : 96 / M;
+
+#if defined(__GFNI__)
+    static constexpr uint64_t affine(uint8_t c) {
+        uint64_t a = 0;
+        for(int i = 0; i < 8; i++) {
+            uint64_t row = 0;
+            for(int j = 0; j < 8; j++) {
+                if(detail::gf_mul(c, static_cast<uint8_t>(1 << j)) & (1 << i)) {
+                    row |= 1u << j;
+                }
+            }
+            a |= row << (8 * (7 - i));
+        }
+        return a;
+    }
+#endif
+
+    template <size_t C, size_t R>
+    static RS_HPP_INLINE void row(vtype& acc, vtype x, vtype lo, vtype hi) {
+        constexpr uint8_t c = parity[R][C];
+        if constexpr (1 == c) {
+            acc = V::xor_(acc, x);
+        } else if constexpr (0 != c) {
+#if defined(__GFNI__)
+            (void)lo;
+            (void)hi;
+            acc = V::xor_(acc, V::affine(x, affine(c)));
+#else
+            acc = V::xor_(acc, V::xor_(V::shuffle(V::table(tables[R * K + C].lo), lo),
+                    V::shuffle(V::table(tables[R * K + C].hi), hi)));
+#endif
+        }
+    }
+
+    template <size_t C, size_t... R>
+    static RS_HPP_INLINE void column(vtype* acc, const unsigned char* p, std::index_sequence<R...>) {
+        const vtype x = V::load(p);
+#if defined(__GFNI__)
+        const vtype lo = x, hi = x;
+#else
+        const vtype lo = V::low(x), hi = V::high(x);
+#endif
+        (row<C, R>(acc[R], x, lo, hi), ...);
+    }
+
+    template <size_t Base, size_t... C>
+    static RS_HPP_INLINE void block(const unsigned char* const* data_blocks, unsigned char* const* fec_blocks,
+            size_t off, std::index_sequence<C...>) {
+        vtype acc[M];
+        for(int r = 0; r < M; r++) {
+            acc[r] = 0 == Base ? V::zero() : V::load(fec_blocks[r] + off);
+        }
+        (column<Base + C>(acc, data_blocks[Base + C] + off, std::make_index_sequence<M>{}), ...);
+        for(int r = 0; r < M; r++) {
+            V::store(fec_blocks[r] + off, acc[r]);
+        }
+    }
+
+    /* columns [Base, Base + group) over one chunk */
+    template <size_t Base>
+    static __attribute__((noinline)) void run_group(const unsigned char* const* data_blocks,
+            unsigned char* const* fec_blocks, size_t start, size_t end) {
+        constexpr size_t n = K - Base < (size_t)group ? K - Base : group;
+        for(size_t off = start; off < end; off += V::width) {
+            block<Base>(data_blocks, fec_blocks, off, std::make_index_sequence<n>{});
+        }
+    }
+
+    template <size_t... G>
+    static RS_HPP_INLINE void groups(const unsigned char* const* data_blocks, unsigned char* const* fec_blocks,
+            size_t start, size_t end, std::index_sequence<G...>) {
+        (run_group<G * group>(data_blocks, fec_blocks, start, end), ...);
+    }
+#endif
+};
+
+/*
+ * encode with the specialised kernel of whichever of Codecs matches
+ * the geometry of rs, with reed_solomon_encode for anything else and
+ * whenever the C codec runs a faster kernel than the template got
+ */
+template <typename... Codecs>
+inline int encode_with(reed_solomon* rs, unsigned char** data_blocks, unsigned char** fec_blocks,
+        int block_size) {
+    bool done = false;
+    if(RS_MATRIX_VANDERMONDE == rs->matrix && block_size >= 0) {
+        const int kernel = fec_get_kernel();
+        done = ((rs->data_shards == Codecs::data_shards && rs->parity_shards == Codecs::parity_shards
+                && FEC_KERNEL_SCALAR != Codecs::kernel && Codecs::kernel >= kernel
+                && (Codecs::encode(data_blocks, fec_blocks, block_size), true)) || ...);
+    }
+    return done ? 0 : reed_solomon_encode(rs, data_blocks, fec_blocks, block_size);
+}
+
+/* the geometries in use: 10+4, 12+3 and 128+7 */
+inline int encode(reed_solomon* rs, unsigned char** data_blocks, unsigned char** fec_blocks, int block_size) {
+    return encode_with<ReedSolomon<10, 4>, ReedSolomon<12, 3>, ReedSolomon<128, 7>>(
+            rs, data_blocks, fec_blocks, block_size);
+}
+
+} // namespace rscode
+
+#undef RS_HPP_INLINE
+#endif
@@ -0,0 +1,451 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "rs16.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define GF16_X86 1
+#include <immintrin.h>
+#endif
+
+#define GF16_BITS  16
+#define GF16_SIZE ((1 << GF16_BITS) - 1)
+#define GF16_POLY (0x1002D)
+
+typedef uint16_t gf16;
+
+/* gf16 shards are xored a word at a time, through a type that may alias them */
+typedef uint64_t gf16_word __attribute__((may_alias));
+
+/*
+ * gf16_log, gf16_exp and the subspace polynomial tables, generated by
+ * gf_gen.c.  W_i is the subspace polynomial vanishing on 0..2^i-1,
+ * what_i = W_i scaled so that what_i(2^i) = 1.  Both are GF(2)-linear,
+ * so gf16_what[i][b] = what_i(2^b) is enough to evaluate them anywhere,
+ * and gf16_dwhat[i] is their coefficient of x, i.e. their derivative.
+ */
+#include "gf16_tables.h"
+
+static inline gf16 gf16_mul(gf16 a, gf16 b) {
+    if(0 == a || 0 == b) {
+        return 0;
+    }
+    return gf16_exp[gf16_log[a] + gf16_log[b]];
+}
+
+static inline gf16 gf16_div(gf16 a, gf16 b) {
+    if(0 == a) {
+        return 0;
+    }
+    return gf16_exp[gf16_log[a] + GF16_SIZE - gf16_log[b]];
+}
+
+static inline gf16 what_at(int i, unsigned x) {
+    gf16 r = 0;
+    int b;
+    for(b = i; b < GF16_BITS; b++) {
+        if(x & (1u << b)) {
+            r ^= gf16_what[i][b];
+        }
+    }
+    return r;
+}
+
+static inline int log2_of(int n) {
+    int l = 0;
+    while((1 << l) < n) {
+        l++;
+    }
+    return l;
+}
+
+/* t[k][v] = c * (v << 4k): the product is one lookup per nibble */
+static void gf16_nibble_tables(gf16 c, gf16 t[4][16]) {
+    int k, v;
+
+    for(k = 0; k < 4; k++) {
+        t[k][0] = 0;
+        for(v = 1; v < 16; v <<= 1) {
+            t[k][v] = gf16_mul(c, (gf16)(v << (4*k)));
+        }
+        for(v = 3; v < 16; v++) {
+            t[k][v] = t[k][v & (v - 1)] ^ t[k][v & -v];
+        }
+    }
+}
+
+#ifdef GF16_X86
+/*
+ * Every nibble of a 16-bit lane is moved into its low byte and looked
+ * up with PSHUFB in the low and the high product byte tables; the high
+ * byte of the index is zero and entry 0 is 0, so lanes do not mix.
+ */
+__attribute__((target("avx2")))
+static int gf16_code_avx2(gf16* dst, const gf16* src, gf16 t[4][16], int count, int add) {
+    unsigned char tl[4][16], th[4][16];
+    __m256i lo[4], hi[4], mask, x, n, pl, ph;
+    int i, k, v;
+
+    for(k = 0; k < 4; k++) {
+        for(v = 0; v < 16; v++) {
+            tl[k][v] = (unsigned char)t[k][v];
+            th[k][v] = (unsigned char)(t[k][v] >> 8);
+        }
+        lo[k] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)tl[k]));
+        hi[k] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)th[k]));
+    }
+    mask = _mm256_set1_epi16(0x000f);
+    for(i = 0; i + 16 <= count; i += 16) {
+        x = _mm256_loadu_si256((const __m256i*)(src + i));
+        n = _mm256_and_si256(x, mask);
+        pl = _mm256_shuffle_epi8(lo[0], n);
+        ph = _mm256_shuffle_epi8(hi[0], n);
+        n = _mm256_and_si256(_mm256_srli_epi16(x, 4), mask);
+        pl = _mm256_xor_si256(pl, _mm256_shuffle_epi8(lo[1], n));
+        ph = _mm256_xor_si256(ph, _mm256_shuffle_epi8(hi[1], n));
+        n = _mm256_and_si256(_mm256_srli_epi16(x, 8), mask);
+        pl = _mm256_xor_si256(pl, _mm256_shuffle_epi8(lo[2], n));
+        ph = _mm256_xor_si256(ph, _mm256_shuffle_epi8(hi[2], n));
+        n = _mm256_srli_epi16(x, 12);
+        pl = _mm256_xor_si256(pl, _mm256_shuffle_epi8(lo[3], n));
+        ph = _mm256_xor_si256(ph, _mm256_shuffle_epi8(hi[3], n));
+        x = _mm256_or_si256(pl, _mm256_slli_epi16(ph, 8));
+        if(add) {
+            x = _mm256_xor_si256(x, _mm256_loadu_si256((const __m256i*)(dst + i)));
+        }
+        _mm256_storeu_si256((__m256i*)(dst + i), x);
+    }
+    return i;
+}
+#endif
+
+#ifdef GF16_X86
+/* checked on first use, racing callers store the same answer */
+static int gf16_avx2 = -1;
+
+static inline int gf16_use_avx2(void) {
+    int avx2 = __atomic_load_n(&gf16_avx2, __ATOMIC_RELAXED);
+    if(avx2 < 0) {
+        avx2 = __builtin_cpu_supports("avx2");
+        __atomic_store_n(&gf16_avx2, avx2, __ATOMIC_RELAXED);
+    }
+    return avx2;
+}
+#endif
+
+/* dst ^= c * src (add) or dst = c * src */
+static void gf16_code(gf16* dst, const gf16* src, gf16 c, int count, int add) {
+    gf16 t[4][16];
+    gf16 x;
+    int i = 0;
+
+    gf16_nibble_tables(c, t);
+#ifdef GF16_X86
+    if(gf16_use_avx2()) {
+        i = gf16_code_avx2(dst, src, t, count, add);
+    }
+#endif
+    for(; i < count; i++) {
+        x = src[i];
+        x = t[0][x & 15] ^ t[1][(x >> 4) & 15] ^ t[2][(x >> 8) & 15] ^ t[3][x >> 12];
+        dst[i] = add ? dst[i] ^ x : x;
+    }
+}
+
+static void gf16_xor(gf16* dst, const gf16* src, int count) {
+    gf16_word* d = (gf16_word*)dst;
+    const gf16_word* s = (const gf16_word*)src;
+    int i;
+
+    for(i = 0; i < count / 4; i++) {
+        d[i] ^= s[i];
+    }
+    for(i *= 4; i < count; i++) {
+        dst[i] ^= src[i];
+    }
+}
+
+/*
+ * Evaluate the polynomial with coefficients d[0..n-1] in the LCH basis
+ * X_j = prod_{bit i of j} what_i at the points shift + 0..n-1 (shift a
+ * multiple of n), in place.  The butterfly for bit i of a block starting
+ * at r is g0 = lo + s * hi, g1 = g0 + hi with s = what_i(shift + r).
+ */
+static void fft16(gf16** d, int n, unsigned shift, int count) {
+    int i, r, j, h;
+    gf16 s;
+
+    for(i = log2_of(n) - 1; i >= 0; i--) {
+        h = 1 << i;
+        for(r = 0; r < n; r += 2*h) {
+            s = what_at(i, shift ^ r);
+            for(j = r; j < r + h; j++) {
+                if(0 != s) {
+                    gf16_code(d[j], d[j + h], s, count, 1);
+                }
+                gf16_xor(d[j + h], d[j], count);
+            }
+        }
+    }
+}
+
+/* inverse of fft16: values at shift + 0..n-1 back to coefficients */
+static void ifft16(gf16** d, int n, unsigned shift, int count) {
+    int i, r, j, h, bits = log2_of(n);
+    gf16 s;
+
+    for(i = 0; i < bits; i++) {
+        h = 1 << i;
+        for(r = 0; r < n; r += 2*h) {
+            s = what_at(i, shift ^ r);
+            for(j = r; j < r + h; j++) {
+                gf16_xor(d[j + h], d[j], count);
+                if(0 != s) {
+                    gf16_code(d[j], d[j + h], s, count, 1);
+                }
+            }
+        }
+    }
+}
+
+/*
+ * Formal derivative in the LCH basis: X_j' is the sum over the bits i
+ * of j of what_i' * X_{j - 2^i}.  Coefficient t only draws on larger
+ * ones, so ascending order can overwrite in place.
+ */
+static void derivative16(gf16** d, int n, int count) {
+    int t, i, bits = log2_of(n);
+
+    for(t = 0; t < n; t++) {
+        memset(d[t], 0, count * sizeof(gf16));
+        for(i = 0; i < bits; i++) {
+            if(0 == (t & (1 << i))) {
+                gf16_code(d[t], d[t | (1 << i)], gf16_dwhat[i], count, 1);
+            }
+        }
+    }
+}
+
+/* Walsh-Hadamard transform modulo GF16_SIZE, for log domain convolutions */
+static void fwht16(uint32_t* a, int n) {
+    int h, r, j;
+    uint32_t x, y;
+
+    for(h = 1; h < n; h <<= 1) {
+        for(r = 0; r < n; r += 2*h) {
+            for(j = r; j < r + h; j++) {
+                x = a[j];
+                y = a[j + h];
+                a[j] = (x + y) % GF16_SIZE;
+                a[j + h] = (x + GF16_SIZE - y) % GF16_SIZE;
+            }
+        }
+    }
+}
+
+reed_solomon16* reed_solomon16_new(int data_shards, int parity_shards) {
+    reed_solomon16* rs;
+    int m, n;
+
+    if(data_shards <= 0 || parity_shards <= 0
+            || data_shards + parity_shards > RS16_SHARDS_MAX) {
+        return NULL;
+    }
+    for(m = 1; m < parity_shards; m <<= 1)
+        ;
+    for(n = 1; n < m + data_shards; n <<= 1)
+        ;
+    if(n > RS16_SHARDS_MAX) {
+        return NULL;
+    }
+
+    rs = (reed_solomon16*)RS_MALLOC(sizeof(reed_solomon16));
+    if(NULL == rs) {
+        return NULL;
+    }
+    rs->data_shards = data_shards;
+    rs->parity_shards = parity_shards;
+    rs->shards = data_shards + parity_shards;
+    rs->m = m;
+    rs->n = n;
+    return rs;
+}
+
+void reed_solomon16_release(reed_solomon16* rs) {
+    if(NULL != rs) {
+        RS_FREE(rs);
+    }
+}
+
+/* count pointers to RS16_SLICE byte buffers carved out of one allocation */
+static gf16** alloc_slices(int count) {
+    gf16** p;
+    unsigned char* base;
+    int i;
+
+    p = (gf16**)RS_MALLOC(count * sizeof(gf16*) + (size_t)count * RS16_SLICE + 64);
+    if(NULL == p) {
+        return NULL;
+    }
+    base = (unsigned char*)(((uintptr_t)(p + count) + 63) & ~(uintptr_t)63);
+    for(i = 0; i < count; i++) {
+        p[i] = (gf16*)(base + (size_t)i * RS16_SLICE);
+    }
+    return p;
+}
+
+/*
+ * Positions of the codeword, i.e. FFT points: parity 0..m-1 (the ones
+ * past parity_shards are never stored), data m..m+k-1, then zeros up to
+ * n.  Every data chunk of m is interpolated on its own coset and the
+ * interpolants summed, which makes the top m coefficients of the whole
+ * codeword vanish: the parity is that sum evaluated on the first coset.
+ */
+int reed_solomon16_encode(reed_solomon16* rs,
+        unsigned char** data_blocks,
+        unsigned char** fec_blocks,
+        int block_size) {
+    gf16 **acc, **tmp, **dst;
+    int c, j, idx, off, len, count, m = rs->m;
+
+    if(0 != block_size % 2) {
+        return -1;
+    }
+    acc = alloc_slices(2*m);
+    if(NULL == acc) {
+        return -1;
+    }
+    tmp = acc + m;
+
+    for(off = 0; off < block_size; off += RS16_SLICE) {
+        len = block_size - off;
+        if(len > RS16_SLICE) {
+            len = RS16_SLICE;
+        }
+        count = len / 2;
+        for(c = 0; c*m < rs->data_shards; c++) {
+            dst = 0 == c ? acc : tmp;
+            for(j = 0; j < m; j++) {
+                idx = c*m + j;
+                if(idx < rs->data_shards) {
+                    memcpy(dst[j], data_blocks[idx] + off, len);
+                } else {
+                    memset(dst[j], 0, len);
+                }
+            }
+            ifft16(dst, m, m*(c + 1), count);
+            if(0 != c) {
+                for(j = 0; j < m; j++) {
+                    gf16_xor(acc[j], tmp[j], count);
+                }
+            }
+        }
+        fft16(acc, m, 0, count);
+        for(j = 0; j < rs->parity_shards; j++) {
+            memcpy(fec_blocks[j] + off, acc[j], len);
+        }
+    }
+    RS_FREE(acc);
+    return 0;
+}
+
+/*
+ * With the erasure locator L(x) = prod_{e erased} (x - e), L * C has
+ * degree < n for every codeword polynomial C, so its coefficients are
+ * the inverse FFT of L(i) * c_i, which only needs the survivors.  At an
+ * erased e, (L * C)'(e) = L'(e) * c_e.  log L(i) for i not erased, and
+ * log L'(e), are one XOR convolution of the erasures with the log table.
+ */
+int reed_solomon16_reconstruct(reed_solomon16* rs,
+        unsigned char** shards,
+        unsigned char* marks,
+        int block_size) {
+    gf16** work = NULL;
+    uint32_t* loglam = NULL;
+    uint32_t* logs = NULL;
+    unsigned char* erased = NULL;
+    int i, pos, off, len, count, nr_erased = 0, ret = -1;
+    int k = rs->data_shards, p = rs->parity_shards, m = rs->m, n = rs->n;
+    uint32_t scale;
+
+    if(0 != block_size % 2) {
+        return -1;
+    }
+    for(i = 0; i < rs->shards; i++) {
+        nr_erased += 0 != marks[i];
+    }
+    if(0 == nr_erased) {
+        return 0;
+    }
+    if(nr_erased + m - p > m) {
+        return -1;
+    }
+
+    do {
+        work = alloc_slices(n);
+        loglam = (uint32_t*)RS_MALLOC(n * sizeof(uint32_t));
+        logs = (uint32_t*)RS_MALLOC(n * sizeof(uint32_t));
+        erased = (unsigned char*)RS_CALLOC(n, 1);
+        if(NULL == work || NULL == loglam || NULL == logs || NULL == erased) {
+            break;
+        }
+        for(i = 0; i < k; i++) {
+            erased[m + i] = 0 != marks[i];
+        }
+        for(i = 0; i < m; i++) {
+            erased[i] = i >= p || 0 != marks[k + i];
+        }
+
+        for(i = 0; i < n; i++) {
+            loglam[i] = erased[i];
+            logs[i] = 0 == i ? 0 : gf16_log[i];
+        }
+        fwht16(loglam, n);
+        fwht16(logs, n);
+        for(i = 0; i < n; i++) {
+            loglam[i] = (uint32_t)((uint64_t)loglam[i] * logs[i] % GF16_SIZE);
+        }
+        fwht16(loglam, n);
+        /* 1/n is 2^(16 - log n) since 2^16 = 1 */
+        scale = (uint32_t)(1 << (GF16_BITS - log2_of(n))) % GF16_SIZE;
+        for(i = 0; i < n; i++) {
+            loglam[i] = (uint32_t)((uint64_t)loglam[i] * scale % GF16_SIZE);
+        }
+
+        for(off = 0; off < block_size; off += RS16_SLICE) {
+            len = block_size - off;
+            if(len > RS16_SLICE) {
+                len = RS16_SLICE;
+            }
+            count = len / 2;
+            for(pos = 0; pos < n; pos++) {
+                if(erased[pos] || pos >= m + k) {
+                    memset(work[pos], 0, len);
+                    continue;
+                }
+                memcpy(work[pos], (pos < m ? shards[k + pos] : shards[pos - m]) + off, len);
+                gf16_code(work[pos], work[pos], gf16_exp[loglam[pos]], count, 0);
+            }
+            ifft16(work, n, 0, count);
+            derivative16(work, n, count);
+            fft16(work, n, 0, count);
+            for(i = 0; i < rs->shards; i++) {
+                if(0 == marks[i]) {
+                    continue;
+                }
+                pos = i < k ? m + i : i - k;
+                gf16_code(work[pos], work[pos], gf16_exp[GF16_SIZE - loglam[pos]], count, 0);
+                memcpy(shards[i] + off, work[pos], len);
+            }
+        }
+        ret = 0;
+    } while(0);
+
+    RS_FREE(work);
+    RS_FREE(loglam);
+    RS_FREE(logs);
+    RS_FREE(erased);
+    return ret;
+}
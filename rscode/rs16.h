@@ -0,0 +1,47 @@
+#ifndef __RS16_H_
+#define __RS16_H_
+
+/*
+ * Wide-stripe Reed-Solomon over GF(2^16) for more than DATA_SHARDS_MAX
+ * shards.  Coding uses the additive FFT of Lin, Chung and Han, so a
+ * stripe costs O(n log n) instead of O(k * m) per symbol.  Shards are
+ * not compatible with reed_solomon; blocks are arrays of little endian
+ * 16-bit symbols, so block_size must be even.
+ */
+
+#ifndef RS16_SHARDS_MAX
+#define RS16_SHARDS_MAX (65536)
+#endif
+
+/* bytes of every shard transformed at once, multiple of 64 */
+#ifndef RS16_SLICE
+#define RS16_SLICE (2 * 1024)
+#endif
+
+typedef struct _reed_solomon16 {
+    int data_shards;
+    int parity_shards;
+    int shards;
+    /* parity_shards rounded up to a power of two */
+    int m;
+    /* m + data_shards rounded up to a power of two, the FFT size */
+    int n;
+} reed_solomon16;
+
+reed_solomon16* reed_solomon16_new(int data_shards, int parity_shards);
+void reed_solomon16_release(reed_solomon16* rs);
+
+int reed_solomon16_encode(reed_solomon16* rs,
+        unsigned char** data_blocks,
+        unsigned char** fec_blocks,
+        int block_size);
+
+/*
+ * shards holds data then parity blocks, marks[i] != 0 for the erased
+ * ones; rebuilds every erased shard from any data_shards survivors
+ */
+int reed_solomon16_reconstruct(reed_solomon16* rs,
+        unsigned char** shards,
+        unsigned char* marks,
+        int block_size);
+#endif
@@ -0,0 +1,341 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rs_fec.h"
+
+struct _rs_fec_encoder {
+    reed_solomon* rs;
+    unsigned int seq;
+    unsigned int groups;    /* seq wraps after this many groups */
+    int next;               /* data packets of the current group sent */
+    int max_len;            /* longest shard of the current group */
+    int lens[DATA_SHARDS_MAX];
+    /* packets as sent, header included, RS_FEC_MTU apart */
+    unsigned char* buf;
+    unsigned char* data_blocks[DATA_SHARDS_MAX];
+    unsigned char* fec_blocks[DATA_SHARDS_MAX];
+};
+
+typedef struct {
+    unsigned int group;
+    int used;
+    int count;              /* shards in */
+    int data;               /* data shards in */
+    int done;               /* every payload of the group delivered */
+    int max_len;            /* parity length, 0 until a parity packet is in */
+    int lens[DATA_SHARDS_MAX];
+    unsigned char present[DATA_SHARDS_MAX];
+    unsigned char* buf;     /* shards RS_FEC_MTU apart, headers stripped */
+} rs_fec_group;
+
+struct _rs_fec_decoder {
+    reed_solomon* rs;
+    int window;
+    unsigned int groups;
+    unsigned int newest;
+    int started;
+    rs_fec_group* slots;
+    unsigned char* buf;
+    rs_fec_stats stats;
+};
+
+static void put_u16(unsigned char* p, unsigned int v) {
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+}
+
+static void put_u32(unsigned char* p, unsigned int v) {
+    put_u16(p, v & 0xffff);
+    put_u16(p + 2, v >> 16);
+}
+
+static unsigned int get_u16(const unsigned char* p) {
+    return p[0] | (p[1] << 8);
+}
+
+static unsigned int get_u32(const unsigned char* p) {
+    return get_u16(p) | (get_u16(p + 2) << 16);
+}
+
+/* seq wraps at a whole number of groups so the group of a packet never straddles it */
+static unsigned int seq_groups(int shards) {
+    return 0xffffffffu / (unsigned int)shards;
+}
+
+rs_fec_encoder* rs_fec_encoder_new(int data_shards, int parity_shards) {
+    rs_fec_encoder* enc;
+    int i;
+
+    enc = (rs_fec_encoder*)RS_CALLOC(1, sizeof(rs_fec_encoder));
+    if(NULL == enc) {
+        return NULL;
+    }
+    enc->rs = reed_solomon_acquire(data_shards, parity_shards, RS_MATRIX_VANDERMONDE);
+    if(NULL == enc->rs) {
+        RS_FREE(enc);
+        return NULL;
+    }
+    enc->buf = (unsigned char*)RS_MALLOC((size_t)enc->rs->shards * RS_FEC_MTU);
+    if(NULL == enc->buf) {
+        reed_solomon_release(enc->rs);
+        RS_FREE(enc);
+        return NULL;
+    }
+    enc->groups = seq_groups(enc->rs->shards);
+    for(i = 0; i < data_shards; i++) {
+        enc->data_blocks[i] = enc->buf + i * RS_FEC_MTU + RS_FEC_HEADER;
+    }
+    for(i = 0; i < parity_shards; i++) {
+        enc->fec_blocks[i] = enc->buf + (data_shards + i) * RS_FEC_MTU + RS_FEC_HEADER;
+    }
+    return enc;
+}
+
+void rs_fec_encoder_release(rs_fec_encoder* enc) {
+    if(NULL != enc) {
+        reed_solomon_release(enc->rs);
+        RS_FREE(enc->buf);
+        RS_FREE(enc);
+    }
+}
+
+int rs_fec_encode(rs_fec_encoder* enc, const unsigned char* payload, int len,
+        rs_fec_output send, void* arg) {
+    reed_solomon* rs = enc->rs;
+    unsigned char* pkt;
+    int i, shard_len;
+
+    if(len < 0 || len > RS_FEC_PAYLOAD_MAX) {
+        return -1;
+    }
+    shard_len = RS_FEC_SIZE + len;
+    pkt = enc->buf + enc->next * RS_FEC_MTU;
+    put_u32(pkt, enc->seq++);
+    put_u16(pkt + 4, RS_FEC_TYPE_DATA);
+    put_u16(pkt + RS_FEC_HEADER, shard_len);
+    memcpy(pkt + RS_FEC_HEADER + RS_FEC_SIZE, payload, len);
+    send(arg, pkt, RS_FEC_HEADER + shard_len);
+
+    enc->lens[enc->next++] = shard_len;
+    if(shard_len > enc->max_len) {
+        enc->max_len = shard_len;
+    }
+    if(enc->next < rs->data_shards) {
+        return 0;
+    }
+
+    for(i = 0; i < rs->data_shards; i++) {
+        memset(enc->data_blocks[i] + enc->lens[i], 0, enc->max_len - enc->lens[i]);
+    }
+    reed_solomon_encode(rs, enc->data_blocks, enc->fec_blocks, enc->max_len);
+    for(i = 0; i < rs->parity_shards; i++) {
+        pkt = enc->fec_blocks[i] - RS_FEC_HEADER;
+        put_u32(pkt, enc->seq++);
+        put_u16(pkt + 4, RS_FEC_TYPE_PARITY);
+        send(arg, pkt, RS_FEC_HEADER + enc->max_len);
+    }
+    if(enc->seq == enc->groups * (unsigned int)rs->shards) {
+        enc->seq = 0;
+    }
+    enc->next = 0;
+    enc->max_len = 0;
+    return 0;
+}
+
+rs_fec_decoder* rs_fec_decoder_new(int data_shards, int parity_shards, int window) {
+    rs_fec_decoder* dec;
+    size_t group_bytes;
+    int i;
+
+    if(0 == window) {
+        window = RS_FEC_WINDOW;
+    }
+    if(window < 0) {
+        return NULL;
+    }
+    dec = (rs_fec_decoder*)RS_CALLOC(1, sizeof(rs_fec_decoder));
+    if(NULL == dec) {
+        return NULL;
+    }
+    dec->rs = reed_solomon_acquire(data_shards, parity_shards, RS_MATRIX_VANDERMONDE);
+    if(NULL == dec->rs) {
+        RS_FREE(dec);
+        return NULL;
+    }
+    group_bytes = (size_t)dec->rs->shards * RS_FEC_MTU;
+    dec->window = window;
+    dec->groups = seq_groups(dec->rs->shards);
+    dec->slots = (rs_fec_group*)RS_CALLOC(window, sizeof(rs_fec_group));
+    dec->buf = (unsigned char*)RS_MALLOC(window * group_bytes);
+    if(NULL == dec->slots || NULL == dec->buf) {
+        rs_fec_decoder_release(dec);
+        return NULL;
+    }
+    for(i = 0; i < window; i++) {
+        dec->slots[i].buf = dec->buf + i * group_bytes;
+    }
+    return dec;
+}
+
+void rs_fec_decoder_release(rs_fec_decoder* dec) {
+    if(NULL != dec) {
+        reed_solomon_release(dec->rs);
+        RS_FREE(dec->slots);
+        RS_FREE(dec->buf);
+        RS_FREE(dec);
+    }
+}
+
+void rs_fec_decoder_stats(rs_fec_decoder* dec, rs_fec_stats* stats) {
+    *stats = dec->stats;
+}
+
+/* a - b in groups, taking the wrap of seq into account */
+static int group_diff(rs_fec_decoder* dec, unsigned int a, unsigned int b) {
+    unsigned int d = (a + dec->groups - b) % dec->groups;
+    return d < dec->groups / 2 ? (int)d : -(int)(dec->groups - d);
+}
+
+/* the slot for group, NULL when the group is already out of the window */
+static rs_fec_group* group_slot(rs_fec_decoder* dec, unsigned int group) {
+    rs_fec_group* g;
+
+    if(!dec->started) {
+        dec->newest = group;
+        dec->started = 1;
+    } else if(group_diff(dec, group, dec->newest) > 0) {
+        dec->newest = group;
+    } else if(group_diff(dec, group, dec->newest) <= -dec->window) {
+        return NULL;
+    }
+
+    g = &dec->slots[group % dec->window];
+    if(g->used && g->group != group) {
+        if(group_diff(dec, g->group, group) > 0) {
+            return NULL;
+        }
+        if(!g->done) {
+            dec->stats.expired++;
+        }
+        g->used = 0;
+    }
+    if(!g->used) {
+        g->used = 1;
+        g->group = group;
+        g->count = 0;
+        g->data = 0;
+        g->done = 0;
+        g->max_len = 0;
+        memset(g->present, 0, dec->rs->shards);
+    }
+    return g;
+}
+
+static int recover_group(rs_fec_decoder* dec, rs_fec_group* g, rs_fec_output deliver, void* arg) {
+    reed_solomon* rs = dec->rs;
+    unsigned char* data_blocks[DATA_SHARDS_MAX];
+    unsigned char* dec_fec_blocks[DATA_SHARDS_MAX];
+    unsigned int fec_block_nos[DATA_SHARDS_MAX];
+    unsigned int erased_blocks[DATA_SHARDS_MAX];
+    unsigned char* shard;
+    int i, size, nr_erased = 0, nr_fec = 0, n = 0;
+    int ds = rs->data_shards;
+
+    for(i = 0; i < ds; i++) {
+        data_blocks[i] = g->buf + i * RS_FEC_MTU;
+        if(!g->present[i]) {
+            erased_blocks[nr_erased++] = i;
+        } else if(g->lens[i] > g->max_len) {
+            return -1;
+        } else {
+            memset(data_blocks[i] + g->lens[i], 0, g->max_len - g->lens[i]);
+        }
+    }
+    for(i = ds; i < rs->shards && nr_fec < nr_erased; i++) {
+        if(g->present[i]) {
+            fec_block_nos[nr_fec] = i - ds;
+            dec_fec_blocks[nr_fec] = g->buf + i * RS_FEC_MTU;
+            nr_fec++;
+        }
+    }
+    if(0 != reed_solomon_decode(rs, data_blocks, g->max_len,
+            dec_fec_blocks, fec_block_nos, erased_blocks, nr_erased)) {
+        return -1;
+    }
+
+    for(i = 0; i < nr_erased; i++) {
+        shard = data_blocks[erased_blocks[i]];
+        size = get_u16(shard);
+        if(size < RS_FEC_SIZE || size > g->max_len) {
+            continue;
+        }
+        deliver(arg, shard + RS_FEC_SIZE, size - RS_FEC_SIZE);
+        n++;
+    }
+    dec->stats.recovered += n;
+    return n;
+}
+
+int rs_fec_decode(rs_fec_decoder* dec, const unsigned char* pkt, int len,
+        rs_fec_output deliver, void* arg) {
+    reed_solomon* rs = dec->rs;
+    rs_fec_group* g;
+    unsigned int seq, type;
+    int idx, n = 0;
+
+    dec->stats.packets++;
+    if(len < RS_FEC_HEADER + RS_FEC_SIZE || len > RS_FEC_MTU) {
+        dec->stats.bad++;
+        return -1;
+    }
+    seq = get_u32(pkt);
+    type = get_u16(pkt + 4);
+    idx = seq % rs->shards;
+    if(seq >= dec->groups * (unsigned int)rs->shards
+            || (RS_FEC_TYPE_DATA == type) != (idx < rs->data_shards)
+            || (RS_FEC_TYPE_DATA != type && RS_FEC_TYPE_PARITY != type)
+            || (RS_FEC_TYPE_DATA == type && get_u16(pkt + RS_FEC_HEADER) != (unsigned int)(len - RS_FEC_HEADER))) {
+        dec->stats.bad++;
+        return -1;
+    }
+
+    g = group_slot(dec, seq / rs->shards);
+    if(NULL == g) {
+        dec->stats.late++;
+        return 0;
+    }
+    if(g->done || g->present[idx]) {
+        return 0;
+    }
+    if(RS_FEC_TYPE_PARITY == type) {
+        if(0 != g->max_len && g->max_len != len - RS_FEC_HEADER) {
+            dec->stats.bad++;
+            return -1;
+        }
+        g->max_len = len - RS_FEC_HEADER;
+    }
+
+    memcpy(g->buf + idx * RS_FEC_MTU, pkt + RS_FEC_HEADER, len - RS_FEC_HEADER);
+    g->lens[idx] = len - RS_FEC_HEADER;
+    g->present[idx] = 1;
+    g->count++;
+
+    if(RS_FEC_TYPE_DATA == type) {
+        deliver(arg, pkt + RS_FEC_HEADER + RS_FEC_SIZE, len - RS_FEC_HEADER - RS_FEC_SIZE);
+        n++;
+        g->done = (++g->data == rs->data_shards);
+    }
+    if(!g->done && g->count >= rs->data_shards) {
+        /* k shards with some data missing means a parity packet is in */
+        int r = recover_group(dec, g, deliver, arg);
+        if(r < 0) {
+            dec->stats.bad++;
+        } else {
+            n += r;
+        }
+        g->done = 1;
+    }
+    dec->stats.delivered += n;
+    return n;
+}
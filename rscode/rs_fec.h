@@ -0,0 +1,77 @@
+#ifndef __RS_FEC_H_
+#define __RS_FEC_H_
+
+#include "rs.h"
+
+/*
+ * Packet FEC for datagram streams, in the style of KCP's FEC layer.
+ * Every data_shards packets form a group followed by parity_shards
+ * parity packets.  Every packet starts with a header:
+ *
+ *   seq   4 bytes, little endian, counts data and parity packets
+ *   type  2 bytes, RS_FEC_TYPE_DATA or RS_FEC_TYPE_PARITY
+ *
+ * The shard of a data packet is a 2 byte length (itself included)
+ * followed by the payload.  Parity covers the shards zero padded to
+ * the longest one in the group, so a rebuilt shard carries its own
+ * length.  seq / shards is the group, seq % shards the shard.
+ */
+
+#define RS_FEC_HEADER       (6)
+#define RS_FEC_SIZE         (2)
+#define RS_FEC_TYPE_DATA    (0xf1)
+#define RS_FEC_TYPE_PARITY  (0xf2)
+
+/* largest packet on the wire, header included */
+#ifndef RS_FEC_MTU
+#define RS_FEC_MTU (1500)
+#endif
+
+#define RS_FEC_PAYLOAD_MAX (RS_FEC_MTU - RS_FEC_HEADER - RS_FEC_SIZE)
+
+/* groups a decoder keeps open by default */
+#ifndef RS_FEC_WINDOW
+#define RS_FEC_WINDOW (16)
+#endif
+
+/* a packet to send, or a payload delivered to the application */
+typedef void (*rs_fec_output)(void* arg, const unsigned char* buf, int len);
+
+typedef struct _rs_fec_stats {
+    unsigned long long packets;     /* packets handled */
+    unsigned long long delivered;   /* payloads handed out, recovered ones included */
+    unsigned long long recovered;   /* payloads rebuilt from parity */
+    unsigned long long expired;     /* groups pushed out of the window with data missing */
+    unsigned long long late;        /* packets for groups already out of the window */
+    unsigned long long bad;         /* malformed packets */
+} rs_fec_stats;
+
+typedef struct _rs_fec_encoder rs_fec_encoder;
+typedef struct _rs_fec_decoder rs_fec_decoder;
+
+rs_fec_encoder* rs_fec_encoder_new(int data_shards, int parity_shards);
+void rs_fec_encoder_release(rs_fec_encoder* enc);
+
+/*
+ * frames payload as the next data packet and sends it; after the last
+ * packet of a group the parity packets follow.  Returns -1 when len is
+ * above RS_FEC_PAYLOAD_MAX.
+ */
+int rs_fec_encode(rs_fec_encoder* enc, const unsigned char* payload, int len,
+        rs_fec_output send, void* arg);
+
+/* window is in groups, 0 for RS_FEC_WINDOW */
+rs_fec_decoder* rs_fec_decoder_new(int data_shards, int parity_shards, int window);
+void rs_fec_decoder_release(rs_fec_decoder* dec);
+
+/*
+ * handles one received packet.  Data payloads are delivered right
+ * away; missing ones of the group are delivered as soon as any
+ * data_shards packets of it are in.  Returns the number of payloads
+ * delivered, -1 for a malformed packet.
+ */
+int rs_fec_decode(rs_fec_decoder* dec, const unsigned char* pkt, int len,
+        rs_fec_output deliver, void* arg);
+
+void rs_fec_decoder_stats(rs_fec_decoder* dec, rs_fec_stats* stats);
+#endif
@@ -0,0 +1,232 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rs_lrc.h"
+
+typedef unsigned long long lrc_vec __attribute__((vector_size (16), aligned (1), may_alias));
+
+/* dst = XOR of the nsrc sources, 64 bytes of every source at a time */
+static void lrc_xor(unsigned char* dst, unsigned char** srcs, int nsrc, int n) {
+    lrc_vec a0, a1, a2, a3;
+    unsigned char* p;
+    unsigned char x;
+    int i = 0, k;
+
+    if(0 == nsrc) {
+        memset(dst, 0, n);
+        return;
+    }
+    for(; i + 64 <= n; i += 64) {
+        p = srcs[0] + i;
+        a0 = *(lrc_vec*)(p);
+        a1 = *(lrc_vec*)(p + 16);
+        a2 = *(lrc_vec*)(p + 32);
+        a3 = *(lrc_vec*)(p + 48);
+        for(k = 1; k < nsrc; k++) {
+            p = srcs[k] + i;
+            a0 ^= *(lrc_vec*)(p);
+            a1 ^= *(lrc_vec*)(p + 16);
+            a2 ^= *(lrc_vec*)(p + 32);
+            a3 ^= *(lrc_vec*)(p + 48);
+        }
+        p = dst + i;
+        *(lrc_vec*)(p) = a0;
+        *(lrc_vec*)(p + 16) = a1;
+        *(lrc_vec*)(p + 32) = a2;
+        *(lrc_vec*)(p + 48) = a3;
+    }
+    for(; i < n; i++) {
+        x = 0;
+        for(k = 0; k < nsrc; k++) {
+            x ^= srcs[k][i];
+        }
+        dst[i] = x;
+    }
+}
+
+reed_solomon_lrc* reed_solomon_lrc_new(int data_shards, int local_groups, int global_parities) {
+    reed_solomon_lrc* lrc;
+
+    if(data_shards <= 0 || local_groups <= 0 || local_groups > data_shards || global_parities <= 0 ||
+            data_shards + local_groups + global_parities > DATA_SHARDS_MAX) {
+        return NULL;
+    }
+    lrc = (reed_solomon_lrc*)RS_MALLOC(sizeof(reed_solomon_lrc));
+    if(NULL == lrc) {
+        return NULL;
+    }
+    lrc->data_shards = data_shards;
+    lrc->local_groups = local_groups;
+    lrc->global_parities = global_parities;
+    lrc->shards = data_shards + local_groups + global_parities;
+    lrc->rs = reed_solomon_acquire(data_shards, global_parities, RS_MATRIX_VANDERMONDE);
+    if(NULL == lrc->rs) {
+        RS_FREE(lrc);
+        return NULL;
+    }
+    return lrc;
+}
+
+void reed_solomon_lrc_release(reed_solomon_lrc* lrc) {
+    if(NULL != lrc) {
+        reed_solomon_release(lrc->rs);
+        RS_FREE(lrc);
+    }
+}
+
+void reed_solomon_lrc_group(reed_solomon_lrc* lrc, int g, int* first, int* last) {
+    *first = g * lrc->data_shards / lrc->local_groups;
+    *last = (g + 1) * lrc->data_shards / lrc->local_groups;
+}
+
+static void xor_group(reed_solomon_lrc* lrc, unsigned char** shards, int g, int skip,
+        unsigned char* dst, int block_size) {
+    unsigned char* srcs[DATA_SHARDS_MAX];
+    int i, first, last, n = 0;
+
+    reed_solomon_lrc_group(lrc, g, &first, &last);
+    for(i = first; i < last; i++) {
+        if(i != skip) {
+            srcs[n++] = shards[i];
+        }
+    }
+    if(skip != lrc->data_shards + g) {
+        srcs[n++] = shards[lrc->data_shards + g];
+    }
+    lrc_xor(dst, srcs, n, block_size);
+}
+
+int reed_solomon_lrc_encode(reed_solomon_lrc* lrc, unsigned char** shards, int block_size) {
+    int g, ds = lrc->data_shards;
+
+    if(block_size < 0) {
+        return -1;
+    }
+    for(g = 0; g < lrc->local_groups; g++) {
+        /* skipping the local parity itself leaves just the data */
+        xor_group(lrc, shards, g, ds + g, shards[ds + g], block_size);
+    }
+    return reed_solomon_encode(lrc->rs, shards, shards + ds + lrc->local_groups, block_size);
+}
+
+/*
+ * local[g] is the only erased member of group g that the group rebuilds
+ * by itself, -1 when there is none; returns whether the global
+ * parities are needed for what is left
+ */
+static int lrc_plan(reed_solomon_lrc* lrc, unsigned char* marks, int* local) {
+    int g, i, first, last, lost;
+    int ds = lrc->data_shards;
+    int global = 0;
+
+    for(g = 0; g < lrc->local_groups; g++) {
+        reed_solomon_lrc_group(lrc, g, &first, &last);
+        local[g] = marks[ds + g] ? ds + g : -1;
+        lost = 0 != marks[ds + g];
+        for(i = first; i < last; i++) {
+            if(marks[i]) {
+                local[g] = i;
+                lost++;
+            }
+        }
+        if(lost > 1) {
+            local[g] = -1;
+            global = 1;
+        }
+    }
+    for(i = 0; i < lrc->global_parities; i++) {
+        global |= 0 != marks[ds + lrc->local_groups + i];
+    }
+    return global;
+}
+
+int reed_solomon_lrc_repair_reads(reed_solomon_lrc* lrc, unsigned char* marks, unsigned char* reads) {
+    int local[DATA_SHARDS_MAX];
+    int g, i, first, last, lost, n = 0;
+    int ds = lrc->data_shards;
+    int gp = ds + lrc->local_groups;
+
+    memset(reads, 0, lrc->shards);
+    if(lrc_plan(lrc, marks, local)) {
+        /* every data shard, then parities for the data nothing else rebuilds */
+        lost = 0;
+        for(g = 0; g < lrc->local_groups; g++) {
+            reed_solomon_lrc_group(lrc, g, &first, &last);
+            for(i = first; i < last; i++) {
+                if(!marks[i]) {
+                    reads[i] = 1;
+                } else if(local[g] != i) {
+                    lost++;
+                }
+            }
+        }
+        for(i = gp; i < lrc->shards && lost > 0; i++) {
+            if(!marks[i]) {
+                reads[i] = 1;
+                lost--;
+            }
+        }
+        if(lost > 0) {
+            return -1;
+        }
+    }
+    for(g = 0; g < lrc->local_groups; g++) {
+        if(local[g] >= 0) {
+            reed_solomon_lrc_group(lrc, g, &first, &last);
+            for(i = first; i < last; i++) {
+                reads[i] |= !marks[i];
+            }
+            reads[ds + g] |= !marks[ds + g];
+        }
+    }
+    for(i = 0; i < lrc->shards; i++) {
+        n += reads[i];
+    }
+    return n;
+}
+
+int reed_solomon_lrc_reconstruct(reed_solomon_lrc* lrc, unsigned char** shards,
+        unsigned char* marks, int block_size) {
+    unsigned char* gshards[DATA_SHARDS_MAX];
+    unsigned char gmarks[DATA_SHARDS_MAX];
+    int local[DATA_SHARDS_MAX];
+    int g, i, global;
+    int ds = lrc->data_shards;
+    int gp = ds + lrc->local_groups;
+
+    global = lrc_plan(lrc, marks, local);
+    for(g = 0; g < lrc->local_groups; g++) {
+        if(local[g] >= 0) {
+            xor_group(lrc, shards, g, local[g], shards[local[g]], block_size);
+        }
+    }
+    if(!global) {
+        return 0;
+    }
+
+    /* data rebuilt locally is a survivor as far as the global code goes */
+    for(i = 0; i < ds; i++) {
+        gshards[i] = shards[i];
+        gmarks[i] = marks[i];
+    }
+    for(g = 0; g < lrc->local_groups; g++) {
+        if(local[g] >= 0 && local[g] < ds) {
+            gmarks[local[g]] = 0;
+        }
+    }
+    for(i = 0; i < lrc->global_parities; i++) {
+        gshards[ds + i] = shards[gp + i];
+        gmarks[ds + i] = marks[gp + i];
+    }
+    if(0 != reed_solomon_reconstruct_some(lrc->rs, gshards, gmarks, gmarks, lrc->rs->shards, block_size)) {
+        return -1;
+    }
+
+    for(g = 0; g < lrc->local_groups; g++) {
+        if(local[g] < 0 && marks[ds + g]) {
+            xor_group(lrc, shards, g, ds + g, shards[ds + g], block_size);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,45 @@
+#ifndef __RS_LRC_H_
+#define __RS_LRC_H_
+
+#include "rs.h"
+
+/*
+ * Locally repairable code: the data shards are cut into local_groups
+ * groups of about equal size, each with an XOR parity, next to
+ * global_parities Reed-Solomon parities over all data shards.  A stripe
+ * is laid out as data, then local parities, then global parities.
+ *
+ * A group missing one shard is rebuilt from that group alone; anything
+ * else goes through the global parities and the local parities are
+ * recomputed afterwards.  The global parities are those of a shared
+ * reed_solomon codec, so they match reed_solomon_encode.
+ */
+
+typedef struct _reed_solomon_lrc {
+    int data_shards;
+    int local_groups;
+    int global_parities;
+    int shards;         /* data_shards + local_groups + global_parities */
+    reed_solomon* rs;   /* data_shards + global_parities */
+} reed_solomon_lrc;
+
+reed_solomon_lrc* reed_solomon_lrc_new(int data_shards, int local_groups, int global_parities);
+void reed_solomon_lrc_release(reed_solomon_lrc* lrc);
+
+/* data shards [first, last) of local group g */
+void reed_solomon_lrc_group(reed_solomon_lrc* lrc, int g, int* first, int* last);
+
+/* fills the local and global parities of one stripe of lrc->shards blocks */
+int reed_solomon_lrc_encode(reed_solomon_lrc* lrc, unsigned char** shards, int block_size);
+
+/*
+ * flags in reads (lrc->shards entries) the surviving shards that
+ * reed_solomon_lrc_reconstruct reads to rebuild the erased ones in
+ * marks; returns how many, or -1 when the stripe cannot be rebuilt
+ */
+int reed_solomon_lrc_repair_reads(reed_solomon_lrc* lrc, unsigned char* marks, unsigned char* reads);
+
+/* rebuilds every shard flagged in marks */
+int reed_solomon_lrc_reconstruct(reed_solomon_lrc* lrc, unsigned char** shards,
+        unsigned char* marks, int block_size);
+#endif
@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rs_object.h"
+
+int reed_solomon_object_open(rs_object* obj, reed_solomon* rs, unsigned char* data,
+        long long size, int block_size) {
+    long long stripes, off;
+    int i, k, ds = rs->data_shards, ps = rs->parity_shards;
+    int nr_data, zero = 0;
+    unsigned char* p;
+
+    memset(obj, 0, sizeof(rs_object));
+    if(size < 0 || block_size < 0) {
+        return -1;
+    }
+    if(0 == block_size) {
+        off = (size + ds - 1) / ds;
+        off = (off + RS_OBJECT_ALIGN - 1) / RS_OBJECT_ALIGN * RS_OBJECT_ALIGN;
+        if(off > 0x7fffffff - RS_OBJECT_ALIGN) {
+            return -1;
+        }
+        block_size = off > 0 ? (int)off : RS_OBJECT_ALIGN;
+    }
+    stripes = (size + (long long)ds * block_size - 1) / ((long long)ds * block_size);
+    if(0 == stripes) {
+        stripes = 1;
+    }
+    if(stripes * rs->shards > 0x7fffffff) {
+        return -1;
+    }
+
+    obj->rs = rs;
+    obj->data = data;
+    obj->size = size;
+    obj->block_size = block_size;
+    obj->stripes = (int)stripes;
+    obj->nr_shards = obj->stripes * rs->shards;
+    obj->tail = -1;
+    nr_data = obj->stripes * ds;
+
+    for(k = 0; k < nr_data; k++) {
+        off = (long long)k * block_size;
+        if(off < size && off + block_size > size) {
+            obj->tail = k;
+        } else if(off >= size) {
+            zero = 1;
+        }
+    }
+
+    obj->shards = (unsigned char**)RS_MALLOC(obj->nr_shards * sizeof(unsigned char*));
+    obj->buf = (unsigned char*)RS_MALLOC((size_t)(obj->stripes * ps + 2) * block_size);
+    if(NULL == obj->shards || NULL == obj->buf) {
+        reed_solomon_object_release(obj);
+        return -1;
+    }
+
+    /* padded block, then the zero block, then the parity */
+    p = obj->buf + (size_t)2 * block_size;
+    if(zero) {
+        memset(obj->buf + block_size, 0, block_size);
+    }
+    for(k = 0; k < nr_data; k++) {
+        off = (long long)k * block_size;
+        if(k == obj->tail) {
+            obj->shards[k] = obj->buf;
+        } else if(off >= size) {
+            obj->shards[k] = obj->buf + block_size;
+        } else {
+            obj->shards[k] = data + off;
+        }
+    }
+    for(i = 0; i < obj->stripes * ps; i++) {
+        obj->shards[nr_data + i] = p + (size_t)i * block_size;
+    }
+    return 0;
+}
+
+int reed_solomon_object_encode(rs_object* obj, reed_solomon* rs, unsigned char* data,
+        long long size, int block_size) {
+    long long off;
+    int s, ds = rs->data_shards, ps = rs->parity_shards;
+
+    if(0 != reed_solomon_object_open(obj, rs, data, size, block_size)) {
+        return -1;
+    }
+    if(obj->tail >= 0) {
+        off = (long long)obj->tail * obj->block_size;
+        memcpy(obj->buf, data + off, size - off);
+        memset(obj->buf + (size - off), 0, obj->block_size - (size - off));
+    }
+    for(s = 0; s < obj->stripes; s++) {
+        if(0 != reed_solomon_encode(rs, obj->shards + s * ds,
+                    obj->shards + obj->stripes * ds + s * ps, obj->block_size)) {
+            reed_solomon_object_release(obj);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int reed_solomon_object_join(rs_object* obj, unsigned char* marks) {
+    long long off;
+    int k;
+
+    /* the zero block is shared, rebuilding into it would clobber it as an input */
+    for(k = 0; NULL != marks && k < obj->stripes * obj->rs->data_shards; k++) {
+        if((long long)k * obj->block_size >= obj->size) {
+            marks[k] = 0;
+        }
+    }
+    if(NULL != marks && 0 != reed_solomon_reconstruct(obj->rs, obj->shards, marks,
+                obj->nr_shards, obj->block_size)) {
+        return -1;
+    }
+    if(obj->tail >= 0) {
+        off = (long long)obj->tail * obj->block_size;
+        memcpy(obj->data + off, obj->buf, obj->size - off);
+    }
+    return 0;
+}
+
+void reed_solomon_object_release(rs_object* obj) {
+    RS_FREE(obj->shards);
+    RS_FREE(obj->buf);
+    obj->shards = NULL;
+    obj->buf = NULL;
+}
@@ -0,0 +1,57 @@
+#ifndef __RS_OBJECT_H_
+#define __RS_OBJECT_H_
+
+#include "rs.h"
+
+/*
+ * Objects of any length coded in place.  The object is cut into
+ * stripes of data_shards shards of block_size bytes and the data
+ * shards are views into the object itself.  Only the shard holding
+ * its last bytes is copied into a padded block of its own, and shards
+ * entirely past the end share a zero block; those and the parity are
+ * the only memory allocated.  Shards past the end are zero by
+ * definition, they never have to be read back or rebuilt.
+ *
+ * shards follows the reed_solomon_reconstruct layout: the data shards
+ * of every stripe, then the parity shards of every stripe.
+ */
+
+/* block sizes picked for an object are rounded up to this */
+#ifndef RS_OBJECT_ALIGN
+#define RS_OBJECT_ALIGN (64)
+#endif
+
+typedef struct _rs_object {
+    reed_solomon* rs;
+    unsigned char* data;        /* the object */
+    long long size;
+    int block_size;
+    int stripes;
+    int nr_shards;              /* stripes * rs->shards */
+    int tail;                   /* data shard in the padded block, -1 when size fills its shards */
+    unsigned char** shards;
+    unsigned char* buf;         /* padded block, zero block and parity */
+} rs_object;
+
+/*
+ * views over data[0..size) without encoding, for reading stored
+ * shards straight into place.  block_size 0 puts the object in a
+ * single stripe.  Returns -1 for a bad size or an allocation failure.
+ */
+int reed_solomon_object_open(rs_object* obj, reed_solomon* rs, unsigned char* data,
+        long long size, int block_size);
+
+/* reed_solomon_object_open, then the tail is copied and every stripe encoded */
+int reed_solomon_object_encode(rs_object* obj, reed_solomon* rs, unsigned char* data,
+        long long size, int block_size);
+
+/*
+ * rebuilds the shards flagged in marks (obj->nr_shards entries, may be
+ * NULL) and copies the tail back, leaving the whole object in
+ * obj->data.  Marks of shards past the end are cleared.  Returns -1
+ * when some stripe lost more than parity_shards.
+ */
+int reed_solomon_object_join(rs_object* obj, unsigned char* marks);
+
+void reed_solomon_object_release(rs_object* obj);
+#endif
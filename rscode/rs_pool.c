@@ -0,0 +1,408 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "rs_pool.h"
+
+/*
+ * Every participant owns a range [lo, hi) of task numbers.  The owner
+ * takes tasks from the front, an idle participant steals the back half
+ * of someone else's range, so stripes that turn out to be expensive
+ * (degraded ones) do not hold up a whole thread's share.
+ */
+typedef struct {
+    pthread_mutex_t lock;
+    int lo;
+    int hi;
+    int tasks;
+    int steals;
+    double busy_us;
+} rs_deque;
+
+typedef struct {
+    rs_pool* pool;
+    int self;
+} rs_worker;
+
+struct _rs_pool {
+    int nr_threads;
+    pthread_t* threads;
+    rs_worker* workers;
+    rs_deque* deques;           /* nr_threads + 1, the last one is the caller's */
+    pthread_mutex_t run_lock;   /* one job at a time */
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t done;
+    unsigned long generation;
+    int running;
+    int quit;
+    void (*fn)(void* arg, int task);
+    void* arg;
+};
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int pool_pop(rs_deque* d) {
+    int task = -1;
+    pthread_mutex_lock(&d->lock);
+    if(d->lo < d->hi) {
+        task = d->lo++;
+    }
+    pthread_mutex_unlock(&d->lock);
+    return task;
+}
+
+static int pool_steal(rs_pool* pool, int self) {
+    int i, n, lo, hi, nr = pool->nr_threads + 1;
+    rs_deque* victim;
+    rs_deque* mine = &pool->deques[self];
+
+    for(i = 1; i < nr; i++) {
+        victim = &pool->deques[(self + i) % nr];
+        pthread_mutex_lock(&victim->lock);
+        n = victim->hi - victim->lo;
+        if(n > 0) {
+            hi = victim->hi;
+            lo = hi - (n + 1) / 2;
+            victim->hi = lo;
+            pthread_mutex_unlock(&victim->lock);
+
+            pthread_mutex_lock(&mine->lock);
+            mine->lo = lo + 1;
+            mine->hi = hi;
+            mine->steals++;
+            pthread_mutex_unlock(&mine->lock);
+            return lo;
+        }
+        pthread_mutex_unlock(&victim->lock);
+    }
+    return -1;
+}
+
+static void pool_participate(rs_pool* pool, int self) {
+    rs_deque* mine = &pool->deques[self];
+    double start;
+    int task;
+
+    for(;;) {
+        task = pool_pop(mine);
+        if(task < 0) {
+            task = pool_steal(pool, self);
+            if(task < 0) {
+                break;
+            }
+        }
+        start = now_us();
+        pool->fn(pool->arg, task);
+        mine->busy_us += now_us() - start;
+        mine->tasks++;
+    }
+}
+
+static void* pool_main(void* arg) {
+    rs_worker* w = (rs_worker*)arg;
+    rs_pool* pool = w->pool;
+    unsigned long seen = 0;
+
+    for(;;) {
+        pthread_mutex_lock(&pool->lock);
+        while(!pool->quit && pool->generation == seen) {
+            pthread_cond_wait(&pool->wake, &pool->lock);
+        }
+        if(pool->quit) {
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        pool_participate(pool, w->self);
+
+        pthread_mutex_lock(&pool->lock);
+        if(0 == --pool->running) {
+            pthread_cond_signal(&pool->done);
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+    return NULL;
+}
+
+rs_pool* rs_pool_new(int nr_threads) {
+    rs_pool* pool;
+    int i;
+
+    if(nr_threads < 0) {
+        return NULL;
+    }
+    pool = (rs_pool*)RS_CALLOC(1, sizeof(rs_pool));
+    if(NULL == pool) {
+        return NULL;
+    }
+    pool->threads = (pthread_t*)RS_CALLOC(nr_threads + 1, sizeof(pthread_t));
+    pool->workers = (rs_worker*)RS_CALLOC(nr_threads + 1, sizeof(rs_worker));
+    pool->deques = (rs_deque*)RS_CALLOC(nr_threads + 1, sizeof(rs_deque));
+    if(NULL == pool->threads || NULL == pool->workers || NULL == pool->deques) {
+        RS_FREE(pool->threads);
+        RS_FREE(pool->workers);
+        RS_FREE(pool->deques);
+        RS_FREE(pool);
+        return NULL;
+    }
+    pthread_mutex_init(&pool->run_lock, NULL);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    for(i = 0; i < nr_threads + 1; i++) {
+        pthread_mutex_init(&pool->deques[i].lock, NULL);
+        pool->workers[i].pool = pool;
+        pool->workers[i].self = i;
+    }
+    for(i = 0; i < nr_threads; i++) {
+        if(0 != pthread_create(&pool->threads[i], NULL, pool_main, &pool->workers[i])) {
+            break;
+        }
+        pool->nr_threads++;
+    }
+    return pool;
+}
+
+void rs_pool_release(rs_pool* pool) {
+    int i;
+    if(NULL != pool) {
+        pthread_mutex_lock(&pool->lock);
+        pool->quit = 1;
+        pthread_cond_broadcast(&pool->wake);
+        pthread_mutex_unlock(&pool->lock);
+        for(i = 0; i < pool->nr_threads; i++) {
+            pthread_join(pool->threads[i], NULL);
+        }
+        for(i = 0; i < pool->nr_threads + 1; i++) {
+            pthread_mutex_destroy(&pool->deques[i].lock);
+        }
+        pthread_mutex_destroy(&pool->run_lock);
+        pthread_mutex_destroy(&pool->lock);
+        pthread_cond_destroy(&pool->wake);
+        pthread_cond_destroy(&pool->done);
+        RS_FREE(pool->threads);
+        RS_FREE(pool->workers);
+        RS_FREE(pool->deques);
+        RS_FREE(pool);
+    }
+}
+
+int rs_pool_threads(rs_pool* pool) {
+    return pool->nr_threads;
+}
+
+int rs_pool_run(rs_pool* pool, int nr_tasks,
+        void (*fn)(void* arg, int task), void* arg,
+        rs_pool_stats* stats) {
+    int i, nr = pool->nr_threads + 1;
+    double start;
+    rs_deque* d;
+
+    if(nr_tasks < 0) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&pool->run_lock);
+    start = now_us();
+    for(i = 0; i < nr; i++) {
+        d = &pool->deques[i];
+        d->lo = (int)((long long)nr_tasks * i / nr);
+        d->hi = (int)((long long)nr_tasks * (i + 1) / nr);
+        d->tasks = 0;
+        d->steals = 0;
+        d->busy_us = 0;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->fn = fn;
+    pool->arg = arg;
+    pool->running = pool->nr_threads;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    pool_participate(pool, pool->nr_threads);
+
+    pthread_mutex_lock(&pool->lock);
+    while(pool->running > 0) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    if(NULL != stats) {
+        memset(stats, 0, sizeof(rs_pool_stats));
+        stats->wall_us = now_us() - start;
+        for(i = 0; i < nr; i++) {
+            d = &pool->deques[i];
+            stats->threads += d->tasks > 0;
+            stats->tasks += d->tasks;
+            stats->steals += d->steals;
+            stats->busy_us += d->busy_us;
+        }
+        stats->speedup = stats->wall_us > 0 ? stats->busy_us / stats->wall_us : 0;
+    }
+    pthread_mutex_unlock(&pool->run_lock);
+    return 0;
+}
+
+typedef struct {
+    reed_solomon* rs;
+    unsigned char** shards;
+    unsigned char* marks;
+    int stripes;
+    int splits;
+    int block_size;
+    int err;
+} rs_mt_job;
+
+static void mt_job_init(rs_mt_job* job, reed_solomon* rs, unsigned char** shards,
+        unsigned char* marks, int nr_shards, int block_size) {
+    job->rs = rs;
+    job->shards = shards;
+    job->marks = marks;
+    job->stripes = nr_shards / rs->shards;
+    job->splits = 1;
+    /* Cauchy blocks are 8 packets, a byte range would cut across them */
+    if(block_size >= RS_POOL_SPLIT_MIN && RS_MATRIX_CAUCHY != rs->matrix) {
+        job->splits = (block_size + RS_POOL_SPLIT_SIZE - 1) / RS_POOL_SPLIT_SIZE;
+    }
+    job->block_size = block_size;
+    job->err = 0;
+}
+
+/* stripe number and byte range of a task */
+static void mt_job_range(rs_mt_job* job, int task, int* stripe, int* off, int* len) {
+    *stripe = task / job->splits;
+    *off = (task % job->splits) * RS_POOL_SPLIT_SIZE;
+    *len = job->block_size - *off;
+    if(job->splits > 1 && *len > RS_POOL_SPLIT_SIZE) {
+        *len = RS_POOL_SPLIT_SIZE;
+    }
+}
+
+static void encode_task(void* arg, int task) {
+    rs_mt_job* job = (rs_mt_job*)arg;
+    reed_solomon* rs = job->rs;
+    unsigned char* data_blocks[DATA_SHARDS_MAX];
+    unsigned char* fec_blocks[DATA_SHARDS_MAX];
+    unsigned char** fec = job->shards + job->stripes * rs->data_shards;
+    int i, s, off, len;
+
+    mt_job_range(job, task, &s, &off, &len);
+    for(i = 0; i < rs->data_shards; i++) {
+        data_blocks[i] = job->shards[s*rs->data_shards + i] + off;
+    }
+    for(i = 0; i < rs->parity_shards; i++) {
+        fec_blocks[i] = fec[s*rs->parity_shards + i] + off;
+    }
+    /* a split stripe is counted once, by the task of its first range */
+    reed_solomon_stats_mute(off > 0);
+    reed_solomon_encode(rs, data_blocks, fec_blocks, len);
+    reed_solomon_stats_mute(0);
+}
+
+static void reconstruct_task(void* arg, int task) {
+    rs_mt_job* job = (rs_mt_job*)arg;
+    reed_solomon* rs = job->rs;
+    unsigned char* shards[DATA_SHARDS_MAX];
+    unsigned char marks[DATA_SHARDS_MAX];
+    unsigned char** fec = job->shards + job->stripes * rs->data_shards;
+    unsigned char* fec_marks = job->marks + job->stripes * rs->data_shards;
+    int i, s, off, len, ds = rs->data_shards, ps = rs->parity_shards;
+
+    mt_job_range(job, task, &s, &off, &len);
+    for(i = 0; i < ds; i++) {
+        shards[i] = job->shards[s*ds + i] + off;
+        marks[i] = job->marks[s*ds + i];
+    }
+    for(i = 0; i < ps; i++) {
+        shards[ds + i] = fec[s*ps + i] + off;
+        marks[ds + i] = fec_marks[s*ps + i];
+    }
+    reed_solomon_stats_mute(off > 0);
+    if(0 != reed_solomon_reconstruct(rs, shards, marks, rs->shards, len)) {
+        __atomic_store_n(&job->err, -1, __ATOMIC_RELAXED);
+    }
+    reed_solomon_stats_mute(0);
+}
+
+int reed_solomon_encode2_mt(reed_solomon* rs, rs_pool* pool,
+        unsigned char** shards, int nr_shards, int block_size,
+        rs_pool_stats* stats) {
+    rs_mt_job job;
+
+    mt_job_init(&job, rs, shards, NULL, nr_shards, block_size);
+    if(0 != rs_pool_run(pool, job.stripes * job.splits, encode_task, &job, stats)) {
+        return -1;
+    }
+    return job.err;
+}
+
+int reed_solomon_reconstruct_mt(reed_solomon* rs, rs_pool* pool,
+        unsigned char** shards, unsigned char* marks, int nr_shards, int block_size,
+        rs_pool_stats* stats) {
+    rs_mt_job job;
+
+    mt_job_init(&job, rs, shards, marks, nr_shards, block_size);
+    if(0 != rs_pool_run(pool, job.stripes * job.splits, reconstruct_task, &job, stats)) {
+        return -1;
+    }
+    return job.err;
+}
+
+typedef struct {
+    reed_solomon* rs;
+    rs_stripe* stripes;
+    int* first;         /* task t codes stripes first[t] .. first[t+1]-1 */
+    int err;
+} rs_batch_job;
+
+static void batch_task(void* arg, int task) {
+    rs_batch_job* job = (rs_batch_job*)arg;
+    int lo = job->first[task], hi = job->first[task + 1];
+
+    if(0 != reed_solomon_encode_batch(job->rs, job->stripes + lo, hi - lo)) {
+        __atomic_store_n(&job->err, -1, __ATOMIC_RELAXED);
+    }
+}
+
+int reed_solomon_encode_batch_mt(reed_solomon* rs, rs_pool* pool,
+        rs_stripe* stripes, int nr_stripes, rs_pool_stats* stats) {
+    rs_batch_job job;
+    long long bytes = 0;
+    int i, tasks = 0;
+
+    job.first = (int*)RS_MALLOC((nr_stripes + 1) * sizeof(int));
+    if(NULL == job.first) {
+        return -1;
+    }
+    /* small objects share a task so the stealing cost stays amortised */
+    for(i = 0; i < nr_stripes; i++) {
+        if(0 == bytes) {
+            job.first[tasks++] = i;
+        }
+        bytes += (long long)rs->data_shards * stripes[i].block_size;
+        if(bytes >= RS_POOL_BATCH_BYTES) {
+            bytes = 0;
+        }
+    }
+    job.first[tasks] = nr_stripes;
+    job.rs = rs;
+    job.stripes = stripes;
+    job.err = 0;
+
+    if(0 != rs_pool_run(pool, tasks, batch_task, &job, stats)) {
+        job.err = -1;
+    }
+    RS_FREE(job.first);
+    return job.err;
+}
@@ -0,0 +1,53 @@
+#ifndef __RS_POOL_H_
+#define __RS_POOL_H_
+
+#include "rs.h"
+
+/* blocks at least this large are also split into byte ranges */
+#ifndef RS_POOL_SPLIT_MIN
+#define RS_POOL_SPLIT_MIN (256 * 1024)
+#endif
+
+/* byte range of one task when a block is split, multiple of 64 */
+#ifndef RS_POOL_SPLIT_SIZE
+#define RS_POOL_SPLIT_SIZE (128 * 1024)
+#endif
+
+/* stripes of a batch are grouped into tasks of at least this many data bytes */
+#ifndef RS_POOL_BATCH_BYTES
+#define RS_POOL_BATCH_BYTES (64 * 1024)
+#endif
+
+typedef struct _rs_pool rs_pool;
+
+typedef struct _rs_pool_stats {
+    int threads;        /* participants that ran at least one task */
+    int tasks;
+    int steals;
+    double wall_us;     /* duration of the call */
+    double busy_us;     /* task time summed over all participants */
+    double speedup;     /* busy_us / wall_us */
+} rs_pool_stats;
+
+/* the calling thread joins the nr_threads workers while a job runs */
+rs_pool* rs_pool_new(int nr_threads);
+void rs_pool_release(rs_pool* pool);
+int rs_pool_threads(rs_pool* pool);
+
+/* run fn(arg, 0..nr_tasks-1) across the pool, stats may be NULL */
+int rs_pool_run(rs_pool* pool, int nr_tasks,
+        void (*fn)(void* arg, int task), void* arg,
+        rs_pool_stats* stats);
+
+int reed_solomon_encode2_mt(reed_solomon* rs, rs_pool* pool,
+        unsigned char** shards, int nr_shards, int block_size,
+        rs_pool_stats* stats);
+
+/* reed_solomon_encode_batch as one pool job */
+int reed_solomon_encode_batch_mt(reed_solomon* rs, rs_pool* pool,
+        rs_stripe* stripes, int nr_stripes, rs_pool_stats* stats);
+
+int reed_solomon_reconstruct_mt(reed_solomon* rs, rs_pool* pool,
+        unsigned char** shards, unsigned char* marks, int nr_shards, int block_size,
+        rs_pool_stats* stats);
+#endif
@@ -0,0 +1,373 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "rs_slab.h"
+
+/* numaif.h is libnuma's, the mode is all mbind needs from it */
+#define RS_MPOL_PREFERRED (1)
+
+/* in front of every rs_slab_malloc block, both paths align it to 64 bytes */
+#define RS_SLAB_HDR (64)
+
+typedef struct _rs_slab_hdr {
+    size_t len;                     /* mapping length, 0 for posix_memalign */
+    struct _rs_slab_hdr* next;      /* in hook_free while cached */
+    int node;
+} rs_slab_hdr;
+
+#define RS_SLAB_BUCKETS (64)
+
+typedef struct _rs_slab_rec {
+    struct _rs_slab_rec* hash_next;     /* every slab of the pool, by address */
+    struct _rs_slab_rec* free_next;     /* free list of its node */
+    unsigned char* mem;
+    int node;
+} rs_slab_rec;
+
+struct _rs_slab_pool {
+    size_t slab_size;
+    pthread_mutex_t lock;
+    rs_slab_rec* free[RS_SLAB_NODES_MAX];
+    rs_slab_rec* buckets[RS_SLAB_BUCKETS];
+    rs_slab_stats stats;
+};
+
+int rs_slab_node(void) {
+#ifdef SYS_getcpu
+    unsigned int cpu, node;
+    if(0 == syscall(SYS_getcpu, &cpu, &node, NULL) && node < RS_SLAB_NODES_MAX) {
+        return (int)node;
+    }
+#endif
+    return 0;
+}
+
+int rs_slab_nodes(void) {
+    char line[256];
+    char* p;
+    FILE* f;
+    long n, last = 0;
+
+    /* a list of ranges, "0" or "0-1" or "0,2-3" */
+    f = fopen("/sys/devices/system/node/online", "r");
+    if(NULL == f) {
+        return 1;
+    }
+    if(NULL == fgets(line, sizeof(line), f)) {
+        line[0] = 0;
+    }
+    fclose(f);
+    for(p = line; *p; ) {
+        n = strtol(p, &p, 10);
+        last = n > last ? n : last;
+        if('-' != *p && ',' != *p) {
+            break;
+        }
+        p++;
+    }
+    return last < RS_SLAB_NODES_MAX ? (int)last + 1 : RS_SLAB_NODES_MAX;
+}
+
+/* prefers node for the pages of [p, p + len) not faulted in yet, 0 on success */
+static int bind_node(void* p, size_t len, int node) {
+#ifdef SYS_mbind
+    unsigned long mask[RS_SLAB_NODES_MAX / (8 * sizeof(unsigned long)) + 1];
+    memset(mask, 0, sizeof(mask));
+    mask[node / (8 * sizeof(unsigned long))] = 1UL << (node % (8 * sizeof(unsigned long)));
+    return 0 == syscall(SYS_mbind, p, len, RS_MPOL_PREFERRED, mask,
+            (unsigned long)RS_SLAB_NODES_MAX + 1, 0) ? 0 : -1;
+#else
+    (void)p;
+    (void)len;
+    (void)node;
+    return -1;
+#endif
+}
+
+/* len bytes aligned to RS_SLAB_HUGE, len a multiple of it */
+static unsigned char* map_slab(size_t len, int node, int* huge, int* bound) {
+    unsigned char* base;
+    unsigned char* p;
+    size_t lead;
+
+    *huge = 0;
+#ifdef MAP_HUGETLB
+    p = (unsigned char*)mmap(NULL, len, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if(MAP_FAILED != p) {
+        *huge = 1;
+        *bound = 0 == bind_node(p, len, node);
+        return p;
+    }
+#endif
+    /* no hugetlbfs pages, map a huge page more and trim it to alignment for THP */
+    base = (unsigned char*)mmap(NULL, len + RS_SLAB_HUGE, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(MAP_FAILED == base) {
+        return NULL;
+    }
+    lead = (RS_SLAB_HUGE - ((uintptr_t)base & (RS_SLAB_HUGE - 1))) & (RS_SLAB_HUGE - 1);
+    if(lead > 0) {
+        munmap(base, lead);
+    }
+    munmap(base + lead + len, RS_SLAB_HUGE - lead);
+    p = base + lead;
+#ifdef MADV_HUGEPAGE
+    madvise(p, len, MADV_HUGEPAGE);
+#endif
+    *bound = 0 == bind_node(p, len, node);
+    return p;
+}
+
+static int bucket_of(rs_slab_pool* pool, unsigned char* mem) {
+    return (int)((uintptr_t)mem / pool->slab_size % RS_SLAB_BUCKETS);
+}
+
+rs_slab_pool* rs_slab_pool_new(size_t slab_size) {
+    rs_slab_pool* pool;
+
+    if(0 == slab_size || slab_size > SIZE_MAX - 2 * RS_SLAB_HUGE) {
+        return NULL;
+    }
+    pool = (rs_slab_pool*)RS_CALLOC(1, sizeof(rs_slab_pool));
+    if(NULL == pool) {
+        return NULL;
+    }
+    pool->slab_size = (slab_size + RS_SLAB_HUGE - 1) / RS_SLAB_HUGE * RS_SLAB_HUGE;
+    pthread_mutex_init(&pool->lock, NULL);
+    return pool;
+}
+
+void rs_slab_pool_release(rs_slab_pool* pool) {
+    rs_slab_rec* rec;
+    int b;
+
+    if(NULL == pool) {
+        return;
+    }
+    for(b = 0; b < RS_SLAB_BUCKETS; b++) {
+        while(NULL != (rec = pool->buckets[b])) {
+            pool->buckets[b] = rec->hash_next;
+            munmap(rec->mem, pool->slab_size);
+            RS_FREE(rec);
+        }
+    }
+    pthread_mutex_destroy(&pool->lock);
+    RS_FREE(pool);
+}
+
+size_t rs_slab_size(rs_slab_pool* pool) {
+    return pool->slab_size;
+}
+
+void rs_slab_pool_stats(rs_slab_pool* pool, rs_slab_stats* stats) {
+    pthread_mutex_lock(&pool->lock);
+    *stats = pool->stats;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+unsigned char* rs_slab_get(rs_slab_pool* pool, int node) {
+    rs_slab_rec* rec;
+    int b, huge, bound;
+
+    if(RS_SLAB_LOCAL == node) {
+        node = rs_slab_node();
+    }
+    if(node < 0 || node >= RS_SLAB_NODES_MAX) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    rec = pool->free[node];
+    if(NULL != rec) {
+        pool->free[node] = rec->free_next;
+        pool->stats.reused++;
+        pool->stats.out++;
+        pthread_mutex_unlock(&pool->lock);
+        return rec->mem;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    /* mapping and binding stay outside the lock, they are syscalls */
+    rec = (rs_slab_rec*)RS_CALLOC(1, sizeof(rs_slab_rec));
+    if(NULL == rec) {
+        return NULL;
+    }
+    rec->mem = map_slab(pool->slab_size, node, &huge, &bound);
+    if(NULL == rec->mem) {
+        RS_FREE(rec);
+        return NULL;
+    }
+    rec->node = node;
+
+    pthread_mutex_lock(&pool->lock);
+    b = bucket_of(pool, rec->mem);
+    rec->hash_next = pool->buckets[b];
+    pool->buckets[b] = rec;
+    pool->stats.mapped++;
+    pool->stats.huge += huge;
+    pool->stats.bound += bound;
+    pool->stats.out++;
+    pthread_mutex_unlock(&pool->lock);
+    return rec->mem;
+}
+
+void rs_slab_put(rs_slab_pool* pool, unsigned char* slab) {
+    rs_slab_rec* rec;
+
+    if(NULL == slab) {
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    for(rec = pool->buckets[bucket_of(pool, slab)]; NULL != rec; rec = rec->hash_next) {
+        if(rec->mem == slab) {
+            rec->free_next = pool->free[rec->node];
+            pool->free[rec->node] = rec;
+            pool->stats.out--;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+int rs_slab_shards(rs_slab_pool* pool, unsigned char* slab,
+        unsigned char** shards, int nr_shards, int block_size) {
+    size_t stride = ((size_t)block_size + 63) & ~(size_t)63;
+    int i;
+
+    if(nr_shards < 0 || block_size < 0 || (size_t)nr_shards * stride > pool->slab_size) {
+        return -1;
+    }
+    for(i = 0; i < nr_shards; i++) {
+        shards[i] = slab + (size_t)i * stride;
+    }
+    return 0;
+}
+
+/*
+ * Hooked mappings freed by rs_slab_free are kept per node, up to
+ * RS_SLAB_HOOK_CACHE bytes, so the large buffers taken and dropped per
+ * call (a store read, an object's parity) skip mmap, mbind and the page
+ * faults after the first time.
+ */
+static pthread_mutex_t hook_lock = PTHREAD_MUTEX_INITIALIZER;
+static rs_slab_hdr* hook_free[RS_SLAB_NODES_MAX];
+static size_t hook_cached = 0;
+
+/* a cached mapping on node of at least len bytes, wasting at most half of it */
+static rs_slab_hdr* hook_take(int node, size_t len) {
+    rs_slab_hdr** pp;
+    rs_slab_hdr* h = NULL;
+
+    pthread_mutex_lock(&hook_lock);
+    for(pp = &hook_free[node]; NULL != *pp; pp = &(*pp)->next) {
+        if((*pp)->len >= len && (*pp)->len / 2 < len) {
+            h = *pp;
+            *pp = h->next;
+            hook_cached -= h->len;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&hook_lock);
+    return h;
+}
+
+static void* hook_map(size_t size, int zero) {
+    rs_slab_hdr* h;
+    size_t len = (size + RS_SLAB_HDR + RS_SLAB_HUGE - 1) / RS_SLAB_HUGE * RS_SLAB_HUGE;
+    int node = rs_slab_node(), huge, bound;
+
+    h = hook_take(node, len);
+    if(NULL != h) {
+        if(zero) {
+            memset((unsigned char*)h + RS_SLAB_HDR, 0, size);
+        }
+    } else {
+        /* fresh anonymous pages are zero */
+        h = (rs_slab_hdr*)map_slab(len, node, &huge, &bound);
+        if(NULL == h) {
+            return NULL;
+        }
+        h->len = len;
+        h->node = node;
+    }
+    return (unsigned char*)h + RS_SLAB_HDR;
+}
+
+void* rs_slab_malloc(size_t size) {
+    void* p;
+
+    if(size > SIZE_MAX - RS_SLAB_HDR - RS_SLAB_HUGE) {
+        return NULL;
+    }
+    if(size >= RS_SLAB_HOOK_MIN) {
+        return hook_map(size, 0);
+    }
+    if(0 != posix_memalign(&p, RS_SLAB_HDR, size + RS_SLAB_HDR)) {
+        return NULL;
+    }
+    ((rs_slab_hdr*)p)->len = 0;
+    return (unsigned char*)p + RS_SLAB_HDR;
+}
+
+void* rs_slab_calloc(size_t n, size_t size) {
+    unsigned char* p;
+
+    if(0 != n && size > (SIZE_MAX - RS_SLAB_HDR - RS_SLAB_HUGE) / n) {
+        return NULL;
+    }
+    size *= n;
+    if(size >= RS_SLAB_HOOK_MIN) {
+        return hook_map(size, 1);
+    }
+    p = (unsigned char*)rs_slab_malloc(size);
+    if(NULL != p) {
+        memset(p, 0, size);
+    }
+    return p;
+}
+
+void rs_slab_free(void* ptr) {
+    rs_slab_hdr* h;
+
+    if(NULL == ptr) {
+        return;
+    }
+    h = (rs_slab_hdr*)((unsigned char*)ptr - RS_SLAB_HDR);
+    if(0 == h->len) {
+        free(h);
+        return;
+    }
+    pthread_mutex_lock(&hook_lock);
+    if(hook_cached + h->len <= RS_SLAB_HOOK_CACHE) {
+        h->next = hook_free[h->node];
+        hook_free[h->node] = h;
+        hook_cached += h->len;
+        h = NULL;
+    }
+    pthread_mutex_unlock(&hook_lock);
+    if(NULL != h) {
+        munmap(h, h->len);
+    }
+}
+
+void rs_slab_trim(void) {
+    rs_slab_hdr* h;
+    int node;
+
+    pthread_mutex_lock(&hook_lock);
+    for(node = 0; node < RS_SLAB_NODES_MAX; node++) {
+        while(NULL != (h = hook_free[node])) {
+            hook_free[node] = h->next;
+            munmap(h, h->len);
+        }
+    }
+    hook_cached = 0;
+    pthread_mutex_unlock(&hook_lock);
+}
@@ -0,0 +1,93 @@
+#ifndef __RS_SLAB_H_
+#define __RS_SLAB_H_
+
+#include <stddef.h>
+
+#include "rs.h"
+
+/*
+ * Shard slabs: one mapping holding every shard of a stripe (or of a
+ * run of stripes), backed by huge pages and placed on one NUMA node.
+ * The encoder streams through all the shards of a stripe at once, so
+ * with scattered 4K-page allocations each of them costs its own TLB
+ * entries, and memory first touched by another thread may well sit on
+ * the other socket.  A slab is taken on the node of the thread that
+ * asks for it; take it from the pool worker that will encode it.
+ *
+ * Slabs put back go to a free list of their node and are handed out
+ * again without touching the kernel.  Huge pages come from hugetlbfs
+ * when some are reserved (vm.nr_hugepages), otherwise the slab is
+ * aligned for transparent huge pages and advised to use them.  Where
+ * mbind is missing or refused, slabs are left to the kernel's first
+ * touch placement.
+ */
+
+/* huge page size, slabs are multiples of it and aligned to it */
+#ifndef RS_SLAB_HUGE
+#define RS_SLAB_HUGE (2 * 1024 * 1024)
+#endif
+
+#ifndef RS_SLAB_NODES_MAX
+#define RS_SLAB_NODES_MAX (64)
+#endif
+
+/* rs_slab_malloc requests at least this large are mapped, smaller go to posix_memalign */
+#ifndef RS_SLAB_HOOK_MIN
+#define RS_SLAB_HOOK_MIN (1024 * 1024)
+#endif
+
+/* bytes of freed rs_slab_malloc mappings kept for reuse */
+#ifndef RS_SLAB_HOOK_CACHE
+#define RS_SLAB_HOOK_CACHE (64 * 1024 * 1024)
+#endif
+
+/* node argument of rs_slab_get: the node of the calling thread */
+#define RS_SLAB_LOCAL (-1)
+
+typedef struct _rs_slab_pool rs_slab_pool;
+
+typedef struct _rs_slab_stats {
+    int mapped;         /* slabs mapped so far */
+    int huge;           /* of those, on hugetlbfs pages */
+    int bound;          /* of those, bound to their node */
+    int reused;         /* rs_slab_get served from a free list */
+    int out;            /* handed out and not put back */
+} rs_slab_stats;
+
+/* slab_size is rounded up to RS_SLAB_HUGE */
+rs_slab_pool* rs_slab_pool_new(size_t slab_size);
+
+/* unmaps the free slabs, every slab has to be put back first */
+void rs_slab_pool_release(rs_slab_pool* pool);
+size_t rs_slab_size(rs_slab_pool* pool);
+void rs_slab_pool_stats(rs_slab_pool* pool, rs_slab_stats* stats);
+
+/* a slab on node, or RS_SLAB_LOCAL.  NULL when mapping fails */
+unsigned char* rs_slab_get(rs_slab_pool* pool, int node);
+void rs_slab_put(rs_slab_pool* pool, unsigned char* slab);
+
+/*
+ * points shards at nr_shards blocks of block_size bytes in slab, 64
+ * byte aligned.  Returns -1 when they do not fit.
+ */
+int rs_slab_shards(rs_slab_pool* pool, unsigned char* slab,
+        unsigned char** shards, int nr_shards, int block_size);
+
+/* node of the calling thread and number of nodes, 0 and 1 without NUMA */
+int rs_slab_node(void);
+int rs_slab_nodes(void);
+
+/*
+ * RS_MALLOC, RS_CALLOC and RS_FREE for -DRS_SLAB_HOOKS: large internal
+ * buffers (parity of objects, FEC windows, store reads) are mapped on
+ * huge pages on the node of the calling thread, the rest is malloc.
+ * Blocks are 64 byte aligned.  Freed mappings are cached per node and
+ * reused by later requests of about the same size.
+ */
+void* rs_slab_malloc(size_t size);
+void* rs_slab_calloc(size_t n, size_t size);
+void rs_slab_free(void* p);
+
+/* unmaps the mappings rs_slab_free kept for reuse */
+void rs_slab_trim(void);
+#endif
@@ -0,0 +1,662 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+#ifdef RS_STORE_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+/* linux/fs.h, pulled in for io_uring, takes the name for itself */
+#undef BLOCK_SIZE
+#endif
+
+#include "rs_store.h"
+
+/*
+ * A get is a request holding a buffer for every shard.  Each queued
+ * read holds a reference to it, so reads still running on a slow disk
+ * when the caller has already decoded and returned land in memory that
+ * is freed by the last of them.  Reads that have not started by then
+ * are skipped.
+ */
+typedef struct {
+    int refs;           /* the caller plus every read in flight */
+    int issued;
+    int arrived;
+    int failed;
+    int done;           /* decoding started, later reads are not wanted */
+    int block_size;
+    pthread_cond_t cond;
+    char name[RS_STORE_NAME_MAX];
+    unsigned char present[DATA_SHARDS_MAX];
+    unsigned char* bufs[DATA_SHARDS_MAX];
+} rs_read_req;
+
+typedef struct _rs_read_op {
+    struct _rs_read_op* next;
+    rs_read_req* req;
+    int shard;
+    int fd;
+#ifdef RS_STORE_URING
+    struct iovec iov;
+#endif
+} rs_read_op;
+
+typedef struct {
+    rs_store* store;
+    char* path;
+    int delay_us;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    rs_read_op* head;
+    rs_read_op* tail;
+    int quit;
+} rs_store_dir;
+
+#ifdef RS_STORE_URING
+typedef struct {
+    int fd;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    struct io_uring_sqe* sqes;
+    struct io_uring_cqe* cqes;
+    void* sq_ring;
+    size_t sq_len;
+    void* cq_ring;
+    size_t cq_len;
+    size_t sqes_len;
+    pthread_mutex_t lock;   /* submission side */
+    pthread_t reaper;
+    int inflight;           /* reads the reaper still has to complete */
+} rs_uring;
+#endif
+
+struct _rs_store {
+    reed_solomon* rs;
+    int nr_dirs;
+    rs_store_dir* dirs;
+    pthread_mutex_t lock;   /* state of every request */
+#ifdef RS_STORE_URING
+    rs_uring* ring;
+#endif
+};
+
+static double store_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/* FNV-1a, only used to rotate the placement */
+static unsigned int name_hash(const char* name) {
+    unsigned int h = 2166136261u;
+    while(*name) {
+        h = (h ^ (unsigned char)*name++) * 16777619u;
+    }
+    return h;
+}
+
+/* strdup through the allocation hooks, the store frees it with RS_FREE */
+static char* store_strdup(const char* s) {
+    size_t n = strlen(s) + 1;
+    char* p = (char*)RS_MALLOC(n);
+    if(NULL != p) {
+        memcpy(p, s, n);
+    }
+    return p;
+}
+
+static int shard_dir(rs_store* store, const char* name, int shard) {
+    return (int)((name_hash(name) + (unsigned int)shard) % (unsigned int)store->nr_dirs);
+}
+
+static void shard_path(rs_store* store, char* path, size_t n, const char* name, int shard) {
+    snprintf(path, n, "%s/%s.%d", store->dirs[shard_dir(store, name, shard)].path, name, shard);
+}
+
+static void put_req(rs_store* store, rs_read_req* req) {
+    int last;
+    pthread_mutex_lock(&store->lock);
+    last = (0 == --req->refs);
+    pthread_mutex_unlock(&store->lock);
+    if(last) {
+        pthread_cond_destroy(&req->cond);
+        RS_FREE(req);
+    }
+}
+
+static void read_done(rs_store* store, rs_read_op* op, int ok) {
+    rs_read_req* req = op->req;
+
+    pthread_mutex_lock(&store->lock);
+    if(ok) {
+        req->present[op->shard] = 1;
+        req->arrived++;
+    } else {
+        req->failed++;
+    }
+    if(!req->done) {
+        pthread_cond_signal(&req->cond);
+    }
+    pthread_mutex_unlock(&store->lock);
+
+    RS_FREE(op);
+    put_req(store, req);
+}
+
+static int read_full(int fd, unsigned char* p, int len) {
+    int done = 0;
+    ssize_t r;
+    while(done < len) {
+        r = pread(fd, p + done, len - done, done);
+        if(r < 0 && EINTR == errno) {
+            continue;
+        }
+        if(r <= 0) {
+            return -1;
+        }
+        done += r;
+    }
+    return 0;
+}
+
+static int write_full(int fd, const unsigned char* p, int len) {
+    int done = 0;
+    ssize_t r;
+    while(done < len) {
+        r = write(fd, p + done, len - done);
+        if(r < 0 && EINTR == errno) {
+            continue;
+        }
+        if(r <= 0) {
+            return -1;
+        }
+        done += r;
+    }
+    return 0;
+}
+
+static void* reader_main(void* arg) {
+    rs_store_dir* d = (rs_store_dir*)arg;
+    rs_store* store = d->store;
+    rs_read_req* req;
+    rs_read_op* op;
+    char path[4096];
+    int ok, fd, delay_us;
+
+    for(;;) {
+        pthread_mutex_lock(&d->lock);
+        while(NULL == d->head && !d->quit) {
+            pthread_cond_wait(&d->wake, &d->lock);
+        }
+        op = d->head;
+        if(NULL == op) {
+            pthread_mutex_unlock(&d->lock);
+            break;
+        }
+        d->head = op->next;
+        if(NULL == d->head) {
+            d->tail = NULL;
+        }
+        pthread_mutex_unlock(&d->lock);
+
+        req = op->req;
+        ok = 0;
+        if(!__atomic_load_n(&req->done, __ATOMIC_RELAXED)) {
+            delay_us = __atomic_load_n(&d->delay_us, __ATOMIC_RELAXED);
+            if(delay_us > 0) {
+                usleep(delay_us);
+            }
+            shard_path(store, path, sizeof(path), req->name, op->shard);
+            fd = open(path, O_RDONLY);
+            if(fd >= 0) {
+                ok = (0 == read_full(fd, req->bufs[op->shard], req->block_size));
+                close(fd);
+            }
+        }
+        read_done(store, op, ok);
+    }
+    return NULL;
+}
+
+static void queue_read(rs_store_dir* d, rs_read_op* op) {
+    pthread_mutex_lock(&d->lock);
+    op->next = NULL;
+    if(NULL == d->tail) {
+        d->head = op;
+    } else {
+        d->tail->next = op;
+    }
+    d->tail = op;
+    pthread_cond_signal(&d->wake);
+    pthread_mutex_unlock(&d->lock);
+}
+
+#ifdef RS_STORE_URING
+static int uring_enter(int fd, unsigned int to_submit, unsigned int min_complete, unsigned int flags) {
+    int r;
+    do {
+        r = (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+    } while(r < 0 && EINTR == errno);
+    return r;
+}
+
+/* user_data 0 is the NOP rs_store_release sends to stop the reaper */
+static void uring_push(rs_uring* ring, unsigned char opcode, rs_read_op* op) {
+    struct io_uring_sqe* sqe;
+    unsigned int tail, idx;
+
+    pthread_mutex_lock(&ring->lock);
+    tail = *ring->sq_tail;
+    idx = tail & *ring->sq_mask;
+    sqe = &ring->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    if(NULL != op) {
+        __atomic_add_fetch(&ring->inflight, 1, __ATOMIC_RELAXED);
+        sqe->fd = op->fd;
+        sqe->addr = (unsigned long long)(uintptr_t)&op->iov;
+        sqe->len = 1;
+        sqe->user_data = (unsigned long long)(uintptr_t)op;
+    }
+    ring->sq_array[idx] = idx;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    uring_enter(ring->fd, 1, 0, 0);
+    pthread_mutex_unlock(&ring->lock);
+}
+
+static void* reaper_main(void* arg) {
+    rs_store* store = (rs_store*)arg;
+    rs_uring* ring = store->ring;
+    struct io_uring_cqe* cqe;
+    rs_read_op* op;
+    unsigned int head;
+    int quit = 0;
+
+    /* reads still in flight at the NOP are waited for, they hold requests */
+    while(!quit || __atomic_load_n(&ring->inflight, __ATOMIC_RELAXED) > 0) {
+        uring_enter(ring->fd, 0, 1, IORING_ENTER_GETEVENTS);
+        head = *ring->cq_head;
+        while(head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+            cqe = &ring->cqes[head & *ring->cq_mask];
+            op = (rs_read_op*)(uintptr_t)cqe->user_data;
+            if(NULL == op) {
+                quit = 1;
+            } else {
+                close(op->fd);
+                read_done(store, op, cqe->res == op->req->block_size);
+                __atomic_sub_fetch(&ring->inflight, 1, __ATOMIC_RELAXED);
+            }
+            head++;
+            __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+        }
+    }
+    return NULL;
+}
+
+static void uring_free(rs_uring* ring) {
+    if(NULL != ring->sqes && MAP_FAILED != (void*)ring->sqes) {
+        munmap(ring->sqes, ring->sqes_len);
+    }
+    if(NULL != ring->cq_ring && MAP_FAILED != ring->cq_ring && ring->cq_ring != ring->sq_ring) {
+        munmap(ring->cq_ring, ring->cq_len);
+    }
+    if(NULL != ring->sq_ring && MAP_FAILED != ring->sq_ring) {
+        munmap(ring->sq_ring, ring->sq_len);
+    }
+    if(ring->fd >= 0) {
+        close(ring->fd);
+    }
+    RS_FREE(ring);
+}
+
+/* NULL when the kernel has no io_uring or refuses it, reads then use the threads */
+static rs_uring* uring_new(rs_store* store) {
+    struct io_uring_params p;
+    rs_uring* ring;
+
+    ring = (rs_uring*)RS_CALLOC(1, sizeof(rs_uring));
+    if(NULL == ring) {
+        return NULL;
+    }
+    memset(&p, 0, sizeof(p));
+    ring->fd = (int)syscall(__NR_io_uring_setup, RS_STORE_URING_ENTRIES, &p);
+    if(ring->fd < 0) {
+        RS_FREE(ring);
+        return NULL;
+    }
+
+    ring->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+    ring->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if(p.features & IORING_FEAT_SINGLE_MMAP) {
+        if(ring->cq_len > ring->sq_len) {
+            ring->sq_len = ring->cq_len;
+        }
+        ring->cq_len = ring->sq_len;
+    }
+    ring->sq_ring = mmap(NULL, ring->sq_len, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if(MAP_FAILED == ring->sq_ring) {
+        uring_free(ring);
+        return NULL;
+    }
+    if(p.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_ring = ring->sq_ring;
+    } else {
+        ring->cq_ring = mmap(NULL, ring->cq_len, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if(MAP_FAILED == ring->cq_ring) {
+            uring_free(ring);
+            return NULL;
+        }
+    }
+    ring->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = (struct io_uring_sqe*)mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if(MAP_FAILED == (void*)ring->sqes) {
+        uring_free(ring);
+        return NULL;
+    }
+
+    ring->sq_tail = (unsigned int*)((char*)ring->sq_ring + p.sq_off.tail);
+    ring->sq_mask = (unsigned int*)((char*)ring->sq_ring + p.sq_off.ring_mask);
+    ring->sq_array = (unsigned int*)((char*)ring->sq_ring + p.sq_off.array);
+    ring->cq_head = (unsigned int*)((char*)ring->cq_ring + p.cq_off.head);
+    ring->cq_tail = (unsigned int*)((char*)ring->cq_ring + p.cq_off.tail);
+    ring->cq_mask = (unsigned int*)((char*)ring->cq_ring + p.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)((char*)ring->cq_ring + p.cq_off.cqes);
+
+    pthread_mutex_init(&ring->lock, NULL);
+    store->ring = ring;
+    if(0 != pthread_create(&ring->reaper, NULL, reaper_main, store)) {
+        store->ring = NULL;
+        pthread_mutex_destroy(&ring->lock);
+        uring_free(ring);
+        return NULL;
+    }
+    return ring;
+}
+#endif
+
+static int submit_read(rs_store* store, rs_read_req* req, int shard) {
+    rs_store_dir* d = &store->dirs[shard_dir(store, req->name, shard)];
+    rs_read_op* op;
+
+    op = (rs_read_op*)RS_CALLOC(1, sizeof(rs_read_op));
+    if(NULL == op) {
+        return -1;
+    }
+    op->req = req;
+    op->shard = shard;
+    op->fd = -1;
+
+    pthread_mutex_lock(&store->lock);
+    req->refs++;
+    req->issued++;
+    pthread_mutex_unlock(&store->lock);
+
+#ifdef RS_STORE_URING
+    /* a throttled directory stays on its thread, that is where the delay is */
+    if(NULL != store->ring && 0 == __atomic_load_n(&d->delay_us, __ATOMIC_RELAXED)) {
+        char path[4096];
+        shard_path(store, path, sizeof(path), req->name, shard);
+        op->fd = open(path, O_RDONLY);
+        if(op->fd < 0) {
+            read_done(store, op, 0);
+            return 0;
+        }
+        op->iov.iov_base = req->bufs[shard];
+        op->iov.iov_len = req->block_size;
+        uring_push(store->ring, IORING_OP_READV, op);
+        return 0;
+    }
+#endif
+    queue_read(d, op);
+    return 0;
+}
+
+rs_store* rs_store_new(reed_solomon* rs, const char** dirs, int nr_dirs) {
+    rs_store* store;
+    int i;
+
+    if(NULL == rs || nr_dirs <= 0) {
+        return NULL;
+    }
+    store = (rs_store*)RS_CALLOC(1, sizeof(rs_store));
+    if(NULL == store) {
+        return NULL;
+    }
+    store->dirs = (rs_store_dir*)RS_CALLOC(nr_dirs, sizeof(rs_store_dir));
+    if(NULL == store->dirs) {
+        RS_FREE(store);
+        return NULL;
+    }
+    store->rs = rs;
+    pthread_mutex_init(&store->lock, NULL);
+
+    for(i = 0; i < nr_dirs; i++) {
+        rs_store_dir* d = &store->dirs[i];
+        d->store = store;
+        d->path = store_strdup(dirs[i]);
+        pthread_mutex_init(&d->lock, NULL);
+        pthread_cond_init(&d->wake, NULL);
+        if(NULL == d->path || 0 != pthread_create(&d->thread, NULL, reader_main, d)) {
+            RS_FREE(d->path);
+            pthread_mutex_destroy(&d->lock);
+            pthread_cond_destroy(&d->wake);
+            break;
+        }
+        store->nr_dirs++;
+    }
+    if(store->nr_dirs < nr_dirs) {
+        rs_store_release(store);
+        return NULL;
+    }
+#ifdef RS_STORE_URING
+    uring_new(store);
+#endif
+    return store;
+}
+
+void rs_store_release(rs_store* store) {
+    int i;
+    if(NULL == store) {
+        return;
+    }
+#ifdef RS_STORE_URING
+    if(NULL != store->ring) {
+        uring_push(store->ring, IORING_OP_NOP, NULL);
+        pthread_join(store->ring->reaper, NULL);
+        pthread_mutex_destroy(&store->ring->lock);
+        uring_free(store->ring);
+    }
+#endif
+    for(i = 0; i < store->nr_dirs; i++) {
+        rs_store_dir* d = &store->dirs[i];
+        pthread_mutex_lock(&d->lock);
+        d->quit = 1;
+        pthread_cond_signal(&d->wake);
+        pthread_mutex_unlock(&d->lock);
+        pthread_join(d->thread, NULL);
+        pthread_mutex_destroy(&d->lock);
+        pthread_cond_destroy(&d->wake);
+        RS_FREE(d->path);
+    }
+    pthread_mutex_destroy(&store->lock);
+    RS_FREE(store->dirs);
+    RS_FREE(store);
+}
+
+int rs_store_throttle(rs_store* store, int dir, int delay_us) {
+    if(dir < 0 || dir >= store->nr_dirs || delay_us < 0) {
+        return -1;
+    }
+    /* read by the reader threads and submit_read without a lock */
+    __atomic_store_n(&store->dirs[dir].delay_us, delay_us, __ATOMIC_RELAXED);
+    return 0;
+}
+
+int rs_store_put(rs_store* store, const char* name,
+        unsigned char** data_blocks, int block_size) {
+    reed_solomon* rs = store->rs;
+    unsigned char* fec_blocks[DATA_SHARDS_MAX];
+    unsigned char* buf;
+    char path[4096];
+    int i, fd, err = 0;
+
+    if(strlen(name) >= RS_STORE_NAME_MAX || block_size <= 0) {
+        return -1;
+    }
+    buf = (unsigned char*)RS_MALLOC((size_t)rs->parity_shards * block_size);
+    if(NULL == buf) {
+        return -1;
+    }
+    for(i = 0; i < rs->parity_shards; i++) {
+        fec_blocks[i] = buf + (size_t)i * block_size;
+    }
+
+    do {
+        if(0 != reed_solomon_encode(rs, data_blocks, fec_blocks, block_size)) {
+            err = -1;
+            break;
+        }
+        for(i = 0; i < rs->shards && 0 == err; i++) {
+            shard_path(store, path, sizeof(path), name, i);
+            fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if(fd < 0) {
+                err = -2;
+                break;
+            }
+            if(0 != write_full(fd, i < rs->data_shards ? data_blocks[i] : fec_blocks[i - rs->data_shards], block_size)) {
+                err = -3;
+            }
+            close(fd);
+        }
+    } while(0);
+
+    RS_FREE(buf);
+    return err;
+}
+
+int rs_store_get(rs_store* store, const char* name,
+        unsigned char** data_blocks, int block_size, int flags,
+        rs_store_stats* stats) {
+    reed_solomon* rs = store->rs;
+    int ds = rs->data_shards;
+    int n = rs->shards;
+    unsigned char present[DATA_SHARDS_MAX];
+    unsigned char* dec_fec_blocks[DATA_SHARDS_MAX];
+    unsigned int fec_block_nos[DATA_SHARDS_MAX];
+    unsigned int erased_blocks[DATA_SHARDS_MAX];
+    int nr_erased, nr_fec, i, issue, arrived, err = 0;
+    rs_read_req* req;
+    double start;
+
+    if(strlen(name) >= RS_STORE_NAME_MAX || block_size <= 0) {
+        return -1;
+    }
+    req = (rs_read_req*)RS_CALLOC(1, sizeof(rs_read_req) + (size_t)n * block_size);
+    if(NULL == req) {
+        return -1;
+    }
+    req->refs = 1;
+    req->block_size = block_size;
+    pthread_cond_init(&req->cond, NULL);
+    strcpy(req->name, name);
+    for(i = 0; i < n; i++) {
+        req->bufs[i] = (unsigned char*)(req + 1) + (size_t)i * block_size;
+    }
+
+    start = store_now_us();
+    issue = (flags & RS_STORE_DATA_FIRST) ? ds : n;
+    for(i = 0; i < issue; i++) {
+        submit_read(store, req, i);
+    }
+
+    pthread_mutex_lock(&store->lock);
+    for(;;) {
+        if(req->arrived >= ds) {
+            break;
+        }
+        if(req->arrived + req->failed == req->issued) {
+            if(issue == n) {
+                break;
+            }
+            /* a data shard is missing, now the parity is needed too */
+            pthread_mutex_unlock(&store->lock);
+            for(i = issue; i < n; i++) {
+                submit_read(store, req, i);
+            }
+            issue = n;
+            pthread_mutex_lock(&store->lock);
+            continue;
+        }
+        pthread_cond_wait(&req->cond, &store->lock);
+    }
+    __atomic_store_n(&req->done, 1, __ATOMIC_RELAXED);
+    arrived = req->arrived;
+    memcpy(present, req->present, n);
+    if(NULL != stats) {
+        stats->issued = req->issued;
+        stats->arrived = arrived;
+        stats->wait_us = store_now_us() - start;
+    }
+    pthread_mutex_unlock(&store->lock);
+
+    do {
+        if(arrived < ds) {
+            err = -1;
+            break;
+        }
+        nr_erased = 0;
+        for(i = 0; i < ds; i++) {
+            if(present[i]) {
+                memcpy(data_blocks[i], req->bufs[i], block_size);
+            } else {
+                erased_blocks[nr_erased++] = i;
+            }
+        }
+        nr_fec = 0;
+        for(i = ds; i < n && nr_fec < nr_erased; i++) {
+            if(present[i]) {
+                fec_block_nos[nr_fec] = i - ds;
+                dec_fec_blocks[nr_fec] = req->bufs[i];
+                nr_fec++;
+            }
+        }
+        if(NULL != stats) {
+            stats->parity_used = nr_fec;
+        }
+        if(nr_erased > 0 && 0 != reed_solomon_decode(rs, data_blocks, block_size,
+                dec_fec_blocks, fec_block_nos, erased_blocks, nr_erased)) {
+            err = -2;
+        }
+    } while(0);
+
+    put_req(store, req);
+    return err;
+}
+
+int rs_store_remove(rs_store* store, const char* name) {
+    char path[4096];
+    int i, err = 0;
+    for(i = 0; i < store->rs->shards; i++) {
+        shard_path(store, path, sizeof(path), name, i);
+        if(0 != unlink(path) && ENOENT != errno) {
+            err = -1;
+        }
+    }
+    return err;
+}
@@ -0,0 +1,55 @@
+#ifndef __RS_STORE_H_
+#define __RS_STORE_H_
+
+#include "rs.h"
+
+/*
+ * Shards of fixed size objects spread over local directories, one per
+ * disk.  Shard i of an object lives in dirs[(hash(name) + i) % nr_dirs]
+ * as <name>.<i>.  A read asks every directory at once and decodes from
+ * the first data_shards shards to arrive, so one slow disk does not set
+ * the latency.
+ *
+ * Every directory has a reader thread.  Built with -DRS_STORE_URING the
+ * reads of unthrottled directories go through one io_uring per store
+ * instead, when the kernel allows it.
+ */
+
+#ifndef RS_STORE_NAME_MAX
+#define RS_STORE_NAME_MAX (256)
+#endif
+
+#ifndef RS_STORE_URING_ENTRIES
+#define RS_STORE_URING_ENTRIES (256)
+#endif
+
+/* rs_store_get flags: read the data shards only, parity after a failure */
+#define RS_STORE_DATA_FIRST (1)
+
+typedef struct _rs_store rs_store;
+
+typedef struct _rs_store_stats {
+    int issued;         /* shard reads queued */
+    int arrived;        /* shards complete when decoding started */
+    int parity_used;    /* parity shards the decode needed */
+    double wait_us;     /* time until data_shards shards were in */
+} rs_store_stats;
+
+/* rs must outlive the store */
+rs_store* rs_store_new(reed_solomon* rs, const char** dirs, int nr_dirs);
+void rs_store_release(rs_store* store);
+
+/* slow disk stand-in for tests: every read of dir first sleeps delay_us */
+int rs_store_throttle(rs_store* store, int dir, int delay_us);
+
+/* encodes the parity and writes all shards of name */
+int rs_store_put(rs_store* store, const char* name,
+        unsigned char** data_blocks, int block_size);
+
+/* fills data_blocks, stats may be NULL */
+int rs_store_get(rs_store* store, const char* name,
+        unsigned char** data_blocks, int block_size, int flags,
+        rs_store_stats* stats);
+
+int rs_store_remove(rs_store* store, const char* name);
+#endif
@@ -0,0 +1,413 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "rs.h"
+#include "rs.c"
+#include "rs_slab.h"
+#include "rs_slab.c"
+#include "rs_fec.h"
+#include "rs_fec.c"
+
+/*
+ * rsfec [-k data] [-m parity] [-n packets] [-s payload] [-l loss_pct]
+ *       [-i interval_us] [-d delay_us] [-w window] [-u]
+ *
+ * Sends n payloads through an rs_fec session over a lossy link and
+ * reports how many came through, the latency of the ones whose packet
+ * was dropped, and goodput as payload bytes over bytes on the wire.
+ *
+ * By default the link is simulated in virtual time: a packet leaves
+ * every interval_us and arrives delay_us later unless dropped.  The
+ * same link is then used for selective-repeat retransmission, where a
+ * gap is noticed when the next packet arrives and NACKed, and the
+ * resend costs a round trip; a lost resend is NACKed again after a
+ * round trip.  -u runs the FEC session over UDP on 127.0.0.1 instead,
+ * with drops at the sender, and reports wall clock latency and goodput.
+ */
+
+#define FEC_ID   (12)   /* payload prefix: packet id (4) and send time in ns (8) */
+
+typedef struct {
+    int data_shards;
+    int parity_shards;
+    int packets;
+    int payload;
+    double loss;
+    double interval_us;
+    double delay_us;
+    int window;
+    int udp;
+} fec_config;
+
+typedef struct {
+    const char* name;
+    int sent;               /* payloads */
+    int lost;               /* payloads whose own packet was dropped */
+    int delivered;
+    int late_delivered;     /* lost ones that still arrived */
+    long long wire_bytes;
+    long long payload_bytes;
+    double wall_us;
+    double* lat;            /* latency of the late_delivered ones */
+} fec_result;
+
+typedef struct {
+    fec_config* cfg;
+    fec_result* res;
+    rs_fec_decoder* dec;
+    unsigned char* seen;
+    unsigned char* dropped;
+    double now_us;          /* virtual link: arrival time of the packet being decoded */
+    int slot;               /* virtual link: packets sent so far */
+    int fd;
+    struct sockaddr_in peer;
+} fec_ctx;
+
+static double mono_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int cmp_double(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+static int drop(fec_config* cfg) {
+    return rand() < cfg->loss * ((double)RAND_MAX + 1);
+}
+
+static void fill_payload(unsigned char* p, int len, int id, double sent_us) {
+    long long ns = (long long)(sent_us * 1000);
+    int i;
+    memcpy(p, &id, 4);
+    memcpy(p + 4, &ns, 8);
+    for(i = FEC_ID; i < len; i++) {
+        p[i] = (unsigned char)(id + i);
+    }
+}
+
+/* id of the payload in a data packet, -1 for parity */
+static int packet_id(const unsigned char* pkt) {
+    int id;
+    if(RS_FEC_TYPE_DATA != get_u16(pkt + 4)) {
+        return -1;
+    }
+    memcpy(&id, pkt + RS_FEC_HEADER + RS_FEC_SIZE, 4);
+    return id;
+}
+
+static void on_deliver(void* arg, const unsigned char* buf, int len) {
+    fec_ctx* ctx = (fec_ctx*)arg;
+    fec_result* res = ctx->res;
+    long long ns;
+    int id, i;
+
+    if(len != ctx->cfg->payload) {
+        return;
+    }
+    memcpy(&id, buf, 4);
+    memcpy(&ns, buf + 4, 8);
+    if(id < 0 || id >= ctx->cfg->packets || ctx->seen[id]) {
+        return;
+    }
+    for(i = FEC_ID; i < len; i++) {
+        if(buf[i] != (unsigned char)(id + i)) {
+            return;
+        }
+    }
+    ctx->seen[id] = 1;
+    res->delivered++;
+    res->payload_bytes += len;
+    if(ctx->dropped[id]) {
+        res->lat[res->late_delivered++] = (ctx->cfg->udp ? mono_us() : ctx->now_us) - ns / 1000.0;
+    }
+}
+
+/* virtual link: a packet leaves every interval_us and is decoded delay_us later */
+static void sim_send(void* arg, const unsigned char* pkt, int len) {
+    fec_ctx* ctx = (fec_ctx*)arg;
+    int id = packet_id(pkt);
+
+    ctx->now_us = ctx->slot++ * ctx->cfg->interval_us + ctx->cfg->delay_us;
+    ctx->res->wire_bytes += len;
+    if(drop(ctx->cfg)) {
+        if(id >= 0) {
+            ctx->dropped[id] = 1;
+            ctx->res->lost++;
+        }
+        return;
+    }
+    rs_fec_decode(ctx->dec, pkt, len, on_deliver, ctx);
+}
+
+static void run_fec_sim(fec_config* cfg, fec_ctx* ctx, unsigned char* payload) {
+    rs_fec_encoder* enc = rs_fec_encoder_new(cfg->data_shards, cfg->parity_shards);
+    int id;
+
+    ctx->dec = rs_fec_decoder_new(cfg->data_shards, cfg->parity_shards, cfg->window);
+    ctx->slot = 0;
+    for(id = 0; id < cfg->packets; id++) {
+        fill_payload(payload, cfg->payload, id, ctx->slot * cfg->interval_us);
+        rs_fec_encode(enc, payload, cfg->payload, sim_send, ctx);
+        ctx->res->sent++;
+    }
+    ctx->res->wall_us = ctx->slot * cfg->interval_us + cfg->delay_us;
+    rs_fec_encoder_release(enc);
+    rs_fec_decoder_release(ctx->dec);
+}
+
+/*
+ * selective repeat over the same link: a gap is NACKed when the next
+ * packet arrives, a lost resend is NACKed again one round trip later
+ */
+static void run_arq_sim(fec_config* cfg, fec_ctx* ctx) {
+    fec_result* res = ctx->res;
+    double rtt = 2 * cfg->delay_us;
+    double t, sent, next_arrival = -1;
+    int id, pkt_len = RS_FEC_HEADER + cfg->payload;
+
+    /* backwards, so the arrival of the next original packet is known */
+    for(id = cfg->packets - 1; id >= 0; id--) {
+        ctx->dropped[id] = drop(cfg);
+    }
+    for(id = cfg->packets - 1; id >= 0; id--) {
+        sent = id * cfg->interval_us;
+        res->sent++;
+        res->wire_bytes += pkt_len;
+        if(!ctx->dropped[id]) {
+            next_arrival = sent + cfg->delay_us;
+            continue;
+        }
+        res->lost++;
+        /* the last packets have nothing after them and wait for a timeout */
+        t = next_arrival >= 0 ? next_arrival : sent + cfg->delay_us + rtt;
+        for(;;) {
+            res->wire_bytes += RS_FEC_HEADER + pkt_len;
+            t += rtt;
+            if(!drop(cfg)) {
+                break;
+            }
+        }
+        res->lat[res->late_delivered++] = t - sent;
+    }
+    res->delivered = cfg->packets;
+    res->payload_bytes = (long long)cfg->packets * cfg->payload;
+    res->wall_us = cfg->packets * cfg->interval_us + cfg->delay_us;
+}
+
+static void udp_send(void* arg, const unsigned char* pkt, int len) {
+    fec_ctx* ctx = (fec_ctx*)arg;
+    int id = packet_id(pkt);
+
+    ctx->res->wire_bytes += len;
+    if(drop(ctx->cfg)) {
+        if(id >= 0) {
+            ctx->dropped[id] = 1;
+            ctx->res->lost++;
+        }
+        return;
+    }
+    sendto(ctx->fd, pkt, len, 0, (struct sockaddr*)&ctx->peer, sizeof(ctx->peer));
+}
+
+typedef struct {
+    fec_ctx* ctx;
+    volatile int done;
+} udp_sender;
+
+static void* udp_sender_main(void* arg) {
+    udp_sender* s = (udp_sender*)arg;
+    fec_config* cfg = s->ctx->cfg;
+    rs_fec_encoder* enc = rs_fec_encoder_new(cfg->data_shards, cfg->parity_shards);
+    unsigned char payload[RS_FEC_PAYLOAD_MAX];
+    struct timespec ts;
+    int id;
+
+    for(id = 0; id < cfg->packets; id++) {
+        fill_payload(payload, cfg->payload, id, mono_us());
+        rs_fec_encode(enc, payload, cfg->payload, udp_send, s->ctx);
+        s->ctx->res->sent++;
+        if(cfg->interval_us > 0) {
+            ts.tv_sec = 0;
+            ts.tv_nsec = (long)(cfg->interval_us * 1000);
+            nanosleep(&ts, NULL);
+        }
+    }
+    rs_fec_encoder_release(enc);
+    __atomic_store_n(&s->done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+static int run_fec_udp(fec_config* cfg, fec_ctx* ctx) {
+    unsigned char pkt[RS_FEC_MTU];
+    struct sockaddr_in addr;
+    socklen_t alen = sizeof(addr);
+    struct timeval tv = { 0, 200 * 1000 };
+    int rfd, rcvbuf = 4 << 20;
+    udp_sender sender;
+    pthread_t thread;
+    double start;
+    ssize_t len;
+
+    rfd = socket(AF_INET, SOCK_DGRAM, 0);
+    ctx->fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if(rfd < 0 || ctx->fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    setsockopt(rfd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    setsockopt(rfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    if(0 != bind(rfd, (struct sockaddr*)&addr, sizeof(addr))
+            || 0 != getsockname(rfd, (struct sockaddr*)&ctx->peer, &alen)) {
+        perror("bind");
+        close(rfd);
+        close(ctx->fd);
+        return -1;
+    }
+
+    ctx->dec = rs_fec_decoder_new(cfg->data_shards, cfg->parity_shards, cfg->window);
+    sender.ctx = ctx;
+    sender.done = 0;
+    start = mono_us();
+    pthread_create(&thread, NULL, udp_sender_main, &sender);
+    for(;;) {
+        len = recv(rfd, pkt, sizeof(pkt), 0);
+        if(len > 0) {
+            rs_fec_decode(ctx->dec, pkt, (int)len, on_deliver, ctx);
+        } else if(__atomic_load_n(&sender.done, __ATOMIC_ACQUIRE)
+                && (len < 0 && (EAGAIN == errno || EWOULDBLOCK == errno))) {
+            break;
+        }
+    }
+    ctx->res->wall_us = mono_us() - start - tv.tv_usec;
+    pthread_join(thread, NULL);
+    rs_fec_decoder_release(ctx->dec);
+    close(rfd);
+    close(ctx->fd);
+    return 0;
+}
+
+static void report(fec_config* cfg, fec_result* res) {
+    qsort(res->lat, res->late_delivered, sizeof(double), cmp_double);
+    printf("%-12s sent %d, dropped %d, delivered %d (%.2f%%)", res->name, res->sent, res->lost,
+            res->delivered, 100.0 * res->delivered / res->sent);
+    if(res->late_delivered > 0) {
+        printf(", dropped ones after p50 %.0f us p99 %.0f us",
+                res->lat[res->late_delivered / 2], res->lat[res->late_delivered * 99 / 100]);
+    }
+    printf(", goodput %.1f%% of the wire", 100.0 * res->payload_bytes / res->wire_bytes);
+    if(cfg->udp) {
+        printf(", %.1f MB/s", res->payload_bytes / res->wall_us);
+    }
+    printf("\n");
+}
+
+static void usage(void) {
+    fprintf(stderr,
+            "usage: rsfec [-k data] [-m parity] [-n packets] [-s payload] [-l loss_pct]\n"
+            "             [-i interval_us] [-d delay_us] [-w window] [-u]\n");
+}
+
+int main(int argc, char** argv) {
+    fec_config cfg;
+    fec_result res;
+    fec_ctx ctx;
+    unsigned char* payload;
+    int i, run, err = 0;
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.data_shards = 10;
+    cfg.parity_shards = 3;
+    cfg.packets = 100000;
+    cfg.payload = 1024;
+    cfg.loss = 0.02;
+    cfg.interval_us = 10;
+    cfg.delay_us = 5000;
+
+    for(i = 1; i < argc; i++) {
+        if(0 == strcmp(argv[i], "-u")) {
+            cfg.udp = 1;
+        } else if(i + 1 < argc && 0 == strcmp(argv[i], "-k")) {
+            cfg.data_shards = atoi(argv[++i]);
+        } else if(i + 1 < argc && 0 == strcmp(argv[i], "-m")) {
+            cfg.parity_shards = atoi(argv[++i]);
+        } else if(i + 1 < argc && 0 == strcmp(argv[i], "-n")) {
+            cfg.packets = atoi(argv[++i]);
+        } else if(i + 1 < argc && 0 == strcmp(argv[i], "-s")) {
+            cfg.payload = atoi(argv[++i]);
+        } else if(i + 1 < argc && 0 == strcmp(argv[i], "-l")) {
+            cfg.loss = atof(argv[++i]) / 100;
+        } else if(i + 1 < argc && 0 == strcmp(argv[i], "-i")) {
+            cfg.interval_us = atof(argv[++i]);
+        } else if(i + 1 < argc && 0 == strcmp(argv[i], "-d")) {
+            cfg.delay_us = atof(argv[++i]);
+        } else if(i + 1 < argc && 0 == strcmp(argv[i], "-w")) {
+            cfg.window = atoi(argv[++i]);
+        } else {
+            usage();
+            return 2;
+        }
+    }
+    if(cfg.data_shards <= 0 || cfg.parity_shards <= 0 || cfg.packets <= 0
+            || cfg.payload < FEC_ID || cfg.payload > RS_FEC_PAYLOAD_MAX
+            || cfg.loss < 0 || cfg.loss >= 1 || cfg.interval_us < 0 || cfg.delay_us < 0 || cfg.window < 0) {
+        usage();
+        return 2;
+    }
+
+    payload = (unsigned char*)malloc(RS_FEC_PAYLOAD_MAX);
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.cfg = &cfg;
+    ctx.seen = (unsigned char*)malloc(cfg.packets);
+    ctx.dropped = (unsigned char*)malloc(cfg.packets);
+    memset(&res, 0, sizeof(res));
+    res.lat = (double*)malloc(cfg.packets * sizeof(double));
+    if(NULL == payload || NULL == ctx.seen || NULL == ctx.dropped || NULL == res.lat) {
+        return 1;
+    }
+
+    printf("%d+%d, %d payloads of %d bytes, %.1f%% loss, one every %.0f us, %.0f us one way\n",
+            cfg.data_shards, cfg.parity_shards, cfg.packets, cfg.payload, cfg.loss * 100,
+            cfg.interval_us, cfg.delay_us);
+    for(run = 0; run < (cfg.udp ? 1 : 2); run++) {
+        double* lat = res.lat;
+        memset(&res, 0, sizeof(res));
+        res.lat = lat;
+        memset(ctx.seen, 0, cfg.packets);
+        memset(ctx.dropped, 0, cfg.packets);
+        ctx.res = &res;
+        srand(1);
+        if(cfg.udp) {
+            res.name = "fec/udp";
+            err = run_fec_udp(&cfg, &ctx);
+        } else if(0 == run) {
+            res.name = "fec";
+            run_fec_sim(&cfg, &ctx, payload);
+        } else {
+            res.name = "retransmit";
+            run_arq_sim(&cfg, &ctx);
+        }
+        if(0 == err) {
+            report(&cfg, &res);
+        }
+    }
+
+    free(payload);
+    free(ctx.seen);
+    free(ctx.dropped);
+    free(res.lat);
+    return 0 == err ? 0 : 1;
+}
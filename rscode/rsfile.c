@@ -0,0 +1,506 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "rs.h"
+#include "rs.c"
+#include "rs_slab.h"
+#include "rs_slab.c"
+
+/*
+ * rsfile encode [-k data] [-m parity] [-b block_size] [-d depth] <input> <dir>
+ * rsfile rebuild [-d depth] <dir>
+ *
+ * encode cuts <input> into stripes of k blocks and writes block i of
+ * every stripe to <dir>/shard.<i>, parity included, plus a manifest.
+ * rebuild recreates missing or truncated shard files, data or parity,
+ * from the others in one pass.
+ *
+ * Inputs are memory mapped.  Each stripe moves through a ring of depth
+ * slots in three stages, each on its own thread: fault the input pages
+ * in, encode/reconstruct, write.  Pages are dropped again once written,
+ * so memory use is bounded by the ring whatever the file size.
+ */
+
+#define STAGE_READ   0
+#define STAGE_CODE   1
+#define STAGE_WRITE  2
+#define STAGE_COUNT  3
+
+typedef struct {
+    int state;
+    unsigned char* buf;
+    unsigned char* shards[DATA_SHARDS_MAX];
+    unsigned char marks[DATA_SHARDS_MAX];
+} rsf_slot;
+
+typedef struct _rsf_job rsf_job;
+
+struct _rsf_job {
+    reed_solomon* rs;
+    int data_shards;
+    int parity_shards;
+    int block_size;
+    long long size;
+    long long stripes;
+
+    /* encode: one mapped input; rebuild: one mapping per surviving shard */
+    unsigned char* input;
+    unsigned char* maps[DATA_SHARDS_MAX];
+    int present[DATA_SHARDS_MAX];
+    int fds[DATA_SHARDS_MAX];
+
+    int depth;
+    rsf_slot* slots;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int err;
+
+    int (*stage[STAGE_COUNT])(rsf_job* job, rsf_slot* slot, long long s);
+};
+
+static long page_size;
+
+static void touch_pages(const unsigned char* p, long long len) {
+    volatile unsigned char sink = 0;
+    long long i;
+    for(i = 0; i < len; i += page_size) {
+        sink ^= p[i];
+    }
+    (void)sink;
+}
+
+static void drop_pages(unsigned char* base, long long off, long long len) {
+    long long start = off & ~(long long)(page_size - 1);
+    long long end = (off + len) & ~(long long)(page_size - 1);
+    if(end > start) {
+        madvise(base + start, end - start, MADV_DONTNEED);
+    }
+}
+
+static int write_full(int fd, const unsigned char* p, long long len, long long off) {
+    ssize_t n;
+    while(len > 0) {
+        n = pwrite(fd, p, len, off);
+        if(n < 0) {
+            if(EINTR == errno) {
+                continue;
+            }
+            return -1;
+        }
+        p += n;
+        len -= n;
+        off += n;
+    }
+    return 0;
+}
+
+static int write_blocks(rsf_job* job, rsf_slot* slot, long long s, int only_missing) {
+    int i;
+    for(i = 0; i < job->rs->shards; i++) {
+        if(only_missing && job->present[i]) {
+            continue;
+        }
+        if(0 != write_full(job->fds[i], slot->shards[i], job->block_size, s * job->block_size)) {
+            perror("pwrite");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* run stage for every stripe in order, waiting for the previous stage */
+static void run_stage(rsf_job* job, int stage) {
+    long long s;
+    rsf_slot* slot;
+    int err;
+
+    for(s = 0; s < job->stripes; s++) {
+        slot = &job->slots[s % job->depth];
+        pthread_mutex_lock(&job->lock);
+        while(!job->err && slot->state != stage) {
+            pthread_cond_wait(&job->cond, &job->lock);
+        }
+        err = job->err;
+        pthread_mutex_unlock(&job->lock);
+        if(err) {
+            return;
+        }
+
+        err = job->stage[stage](job, slot, s);
+
+        pthread_mutex_lock(&job->lock);
+        if(err) {
+            job->err = err;
+        }
+        slot->state = (stage + 1) % STAGE_COUNT;
+        pthread_cond_broadcast(&job->cond);
+        pthread_mutex_unlock(&job->lock);
+    }
+}
+
+typedef struct {
+    rsf_job* job;
+    int stage;
+} rsf_stage_arg;
+
+static void* stage_main(void* arg) {
+    rsf_stage_arg* a = (rsf_stage_arg*)arg;
+    run_stage(a->job, a->stage);
+    return NULL;
+}
+
+static int run_pipeline(rsf_job* job) {
+    pthread_t threads[STAGE_COUNT];
+    rsf_stage_arg args[STAGE_COUNT];
+    size_t slot_bytes = (size_t)job->rs->shards * job->block_size;
+    int i, j;
+
+    job->slots = (rsf_slot*)calloc(job->depth, sizeof(rsf_slot));
+    if(NULL == job->slots) {
+        return -1;
+    }
+    for(i = 0; i < job->depth; i++) {
+        job->slots[i].buf = (unsigned char*)malloc(slot_bytes);
+        if(NULL == job->slots[i].buf) {
+            for(j = 0; j < i; j++) {
+                free(job->slots[j].buf);
+            }
+            free(job->slots);
+            return -1;
+        }
+    }
+    pthread_mutex_init(&job->lock, NULL);
+    pthread_cond_init(&job->cond, NULL);
+    job->err = 0;
+
+    for(i = 0; i < STAGE_COUNT; i++) {
+        args[i].job = job;
+        args[i].stage = i;
+        if(0 != pthread_create(&threads[i], NULL, stage_main, &args[i])) {
+            pthread_mutex_lock(&job->lock);
+            job->err = -1;
+            pthread_cond_broadcast(&job->cond);
+            pthread_mutex_unlock(&job->lock);
+            break;
+        }
+    }
+    for(j = 0; j < i; j++) {
+        pthread_join(threads[j], NULL);
+    }
+
+    pthread_mutex_destroy(&job->lock);
+    pthread_cond_destroy(&job->cond);
+    for(i = 0; i < job->depth; i++) {
+        free(job->slots[i].buf);
+    }
+    free(job->slots);
+    return job->err;
+}
+
+static int encode_read(rsf_job* job, rsf_slot* slot, long long s) {
+    long long stripe_bytes = (long long)job->data_shards * job->block_size;
+    long long off = s * stripe_bytes;
+    long long len = job->size - off;
+    int i;
+
+    if(len >= stripe_bytes) {
+        touch_pages(job->input + off, stripe_bytes);
+        for(i = 0; i < job->data_shards; i++) {
+            slot->shards[i] = job->input + off + (long long)i * job->block_size;
+        }
+    } else {
+        /* the last stripe is zero padded in the slot */
+        memcpy(slot->buf, job->input + off, len);
+        memset(slot->buf + len, 0, stripe_bytes - len);
+        for(i = 0; i < job->data_shards; i++) {
+            slot->shards[i] = slot->buf + (long long)i * job->block_size;
+        }
+    }
+    for(i = 0; i < job->parity_shards; i++) {
+        slot->shards[job->data_shards + i] = slot->buf + (long long)(job->data_shards + i) * job->block_size;
+    }
+    return 0;
+}
+
+static int encode_code(rsf_job* job, rsf_slot* slot, long long s) {
+    (void)s;
+    return reed_solomon_encode(job->rs, slot->shards, slot->shards + job->data_shards, job->block_size);
+}
+
+static int encode_write(rsf_job* job, rsf_slot* slot, long long s) {
+    long long stripe_bytes = (long long)job->data_shards * job->block_size;
+    long long len = job->size - s * stripe_bytes;
+
+    if(0 != write_blocks(job, slot, s, 0)) {
+        return -1;
+    }
+    drop_pages(job->input, s * stripe_bytes, len < stripe_bytes ? len : stripe_bytes);
+    return 0;
+}
+
+static int rebuild_read(rsf_job* job, rsf_slot* slot, long long s) {
+    long long off = s * job->block_size;
+    int i;
+
+    for(i = 0; i < job->rs->shards; i++) {
+        if(job->present[i]) {
+            slot->shards[i] = job->maps[i] + off;
+            slot->marks[i] = 0;
+            touch_pages(slot->shards[i], job->block_size);
+        } else {
+            slot->shards[i] = slot->buf + (long long)i * job->block_size;
+            slot->marks[i] = 1;
+        }
+    }
+    return 0;
+}
+
+static int rebuild_code(rsf_job* job, rsf_slot* slot, long long s) {
+    (void)s;
+    /* every missing shard is wanted, parity included */
+    if(0 != reed_solomon_reconstruct_some(job->rs, slot->shards, slot->marks, slot->marks,
+                job->rs->shards, job->block_size)) {
+        fprintf(stderr, "too many missing shards\n");
+        return -1;
+    }
+    return 0;
+}
+
+static int rebuild_write(rsf_job* job, rsf_slot* slot, long long s) {
+    int i;
+    if(0 != write_blocks(job, slot, s, 1)) {
+        return -1;
+    }
+    for(i = 0; i < job->rs->shards; i++) {
+        if(job->present[i]) {
+            drop_pages(job->maps[i], s * job->block_size, job->block_size);
+        }
+    }
+    return 0;
+}
+
+static void shard_path(char* path, size_t n, const char* dir, int i) {
+    snprintf(path, n, "%s/shard.%03d", dir, i);
+}
+
+static int write_manifest(const char* dir, rsf_job* job) {
+    char path[4096];
+    FILE* f;
+
+    snprintf(path, sizeof(path), "%s/manifest", dir);
+    f = fopen(path, "w");
+    if(NULL == f) {
+        perror(path);
+        return -1;
+    }
+    fprintf(f, "rsfile 1\n%d %d %d %lld\n",
+            job->data_shards, job->parity_shards, job->block_size, job->size);
+    return fclose(f);
+}
+
+static int read_manifest(const char* dir, rsf_job* job) {
+    char path[4096];
+    int version = 0;
+    FILE* f;
+
+    snprintf(path, sizeof(path), "%s/manifest", dir);
+    f = fopen(path, "r");
+    if(NULL == f) {
+        perror(path);
+        return -1;
+    }
+    if(5 != fscanf(f, "rsfile %d %d %d %d %lld", &version,
+            &job->data_shards, &job->parity_shards, &job->block_size, &job->size) || 1 != version) {
+        fprintf(stderr, "%s: bad manifest\n", path);
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+    return 0;
+}
+
+static int do_encode(rsf_job* job, const char* input, const char* dir) {
+    char path[4096];
+    struct stat st;
+    int i, fd, err = 0;
+
+    fd = open(input, O_RDONLY);
+    if(fd < 0 || 0 != fstat(fd, &st)) {
+        perror(input);
+        return 1;
+    }
+    job->size = st.st_size;
+    job->stripes = (job->size + (long long)job->data_shards * job->block_size - 1)
+            / ((long long)job->data_shards * job->block_size);
+    job->input = NULL;
+    if(job->size > 0) {
+        job->input = (unsigned char*)mmap(NULL, job->size, PROT_READ, MAP_SHARED, fd, 0);
+        if(MAP_FAILED == job->input) {
+            perror("mmap");
+            close(fd);
+            return 1;
+        }
+        madvise(job->input, job->size, MADV_SEQUENTIAL);
+    }
+    close(fd);
+
+    mkdir(dir, 0755);
+    for(i = 0; i < job->rs->shards; i++) {
+        shard_path(path, sizeof(path), dir, i);
+        job->fds[i] = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if(job->fds[i] < 0) {
+            perror(path);
+            err = 1;
+        }
+    }
+
+    if(!err) {
+        job->stage[STAGE_READ] = encode_read;
+        job->stage[STAGE_CODE] = encode_code;
+        job->stage[STAGE_WRITE] = encode_write;
+        err = 0 != run_pipeline(job) || 0 != write_manifest(dir, job);
+    }
+
+    for(i = 0; i < job->rs->shards; i++) {
+        if(job->fds[i] >= 0) {
+            close(job->fds[i]);
+        }
+    }
+    if(NULL != job->input) {
+        munmap(job->input, job->size);
+    }
+    return err;
+}
+
+static int do_rebuild(rsf_job* job, const char* dir) {
+    char path[4096];
+    struct stat st;
+    long long shard_bytes = job->stripes * job->block_size;
+    int i, fd, missing = 0, err = 0;
+
+    for(i = 0; i < job->rs->shards; i++) {
+        job->maps[i] = NULL;
+        job->fds[i] = -1;
+        job->present[i] = 0;
+        shard_path(path, sizeof(path), dir, i);
+        fd = open(path, O_RDONLY);
+        if(fd >= 0 && 0 == fstat(fd, &st) && st.st_size == shard_bytes) {
+            job->present[i] = 1;
+            if(shard_bytes > 0) {
+                job->maps[i] = (unsigned char*)mmap(NULL, shard_bytes, PROT_READ, MAP_SHARED, fd, 0);
+                if(MAP_FAILED == job->maps[i]) {
+                    job->maps[i] = NULL;
+                    job->present[i] = 0;
+                } else {
+                    madvise(job->maps[i], shard_bytes, MADV_SEQUENTIAL);
+                }
+            }
+        }
+        if(fd >= 0) {
+            close(fd);
+        }
+        if(!job->present[i]) {
+            printf("rebuilding %s\n", path);
+            missing++;
+            job->fds[i] = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if(job->fds[i] < 0) {
+                perror(path);
+                err = 1;
+            }
+        }
+    }
+    if(missing > job->parity_shards) {
+        fprintf(stderr, "%d shards missing, at most %d can be rebuilt\n", missing, job->parity_shards);
+        err = 1;
+    }
+
+    if(!err && missing > 0) {
+        job->stage[STAGE_READ] = rebuild_read;
+        job->stage[STAGE_CODE] = rebuild_code;
+        job->stage[STAGE_WRITE] = rebuild_write;
+        err = 0 != run_pipeline(job);
+    }
+
+    for(i = 0; i < job->rs->shards; i++) {
+        if(job->fds[i] >= 0) {
+            close(job->fds[i]);
+        }
+        if(NULL != job->maps[i]) {
+            munmap(job->maps[i], shard_bytes);
+        }
+    }
+    return err;
+}
+
+static void usage(void) {
+    fprintf(stderr,
+            "usage: rsfile encode [-k data] [-m parity] [-b block_size] [-d depth] <input> <dir>\n"
+            "       rsfile rebuild [-d depth] <dir>\n");
+}
+
+int main(int argc, char** argv) {
+    rsf_job job;
+    int i, err, rebuild;
+
+    memset(&job, 0, sizeof(job));
+    job.data_shards = 10;
+    job.parity_shards = 4;
+    job.block_size = 64 * 1024;
+    job.depth = 4;
+    page_size = sysconf(_SC_PAGESIZE);
+
+    if(argc < 2) {
+        usage();
+        return 2;
+    }
+    rebuild = 0 == strcmp(argv[1], "rebuild");
+    if(!rebuild && 0 != strcmp(argv[1], "encode")) {
+        usage();
+        return 2;
+    }
+    for(i = 2; i + 1 < argc && '-' == argv[i][0]; i += 2) {
+        if(0 == strcmp(argv[i], "-k")) {
+            job.data_shards = atoi(argv[i+1]);
+        } else if(0 == strcmp(argv[i], "-m")) {
+            job.parity_shards = atoi(argv[i+1]);
+        } else if(0 == strcmp(argv[i], "-b")) {
+            job.block_size = atoi(argv[i+1]);
+        } else if(0 == strcmp(argv[i], "-d")) {
+            job.depth = atoi(argv[i+1]);
+        } else {
+            usage();
+            return 2;
+        }
+    }
+    if(argc - i != (rebuild ? 1 : 2) || job.block_size <= 0 || job.depth <= 0) {
+        usage();
+        return 2;
+    }
+
+    if(rebuild && 0 != read_manifest(argv[i], &job)) {
+        return 1;
+    }
+    job.rs = reed_solomon_new(job.data_shards, job.parity_shards);
+    if(NULL == job.rs) {
+        fprintf(stderr, "bad geometry %d+%d\n", job.data_shards, job.parity_shards);
+        return 1;
+    }
+
+    if(rebuild) {
+        job.stripes = (job.size + (long long)job.data_shards * job.block_size - 1)
+                / ((long long)job.data_shards * job.block_size);
+        err = do_rebuild(&job, argv[i]);
+    } else {
+        err = do_encode(&job, argv[i], argv[i+1]);
+    }
+
+    reed_solomon_release(job.rs);
+    return err;
+}
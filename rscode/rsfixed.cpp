@@ -0,0 +1,153 @@
+/*
+ * rsfixed [-M mb] [-k kernel]
+ *
+ * Checks ReedSolomon<K, M> from rs.hpp against the C codec (matrix and
+ * parity, odd block sizes included) and times both encoders on the
+ * fixed geometries, the C codec with its fastest kernel or the
+ * FEC_KERNEL_* number given with -k.  rs.c is C, so it is built on its own:
+ *
+ *   gcc -O2 -c rs.c -o rs.o
+ *   g++ -std=c++17 -O2 -mavx2 rsfixed.cpp rs.o -o rsfixed -pthread
+ *
+ * With -DRS_SLAB_HOOKS, rs_slab.c is compiled and linked next to rs.c.
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+#include "rs.hpp"
+
+static double now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+template <int K, int M>
+static int check(long long budget) {
+    using Codec = rscode::ReedSolomon<K, M>;
+    static const int sizes[] = { 1, 15, 16, 17, 31, 33, 100, 4096, 65536 + 7 };
+    reed_solomon* rs = reed_solomon_new(K, M);
+    unsigned char* data[K];
+    unsigned char* fec[M];
+    unsigned char* expect[M];
+    int errors = 0;
+
+    if(NULL == rs) {
+        return 1;
+    }
+    for(int r = 0; r < M; r++) {
+        errors += 0 != memcmp(Codec::parity[r].data(), rs->parity + r * K, K);
+    }
+
+    int block_size = (int)(budget / (K + 2 * M)) & ~63;
+    std::vector<unsigned char> buf((size_t)(K + 2 * M) * block_size);
+    for(int i = 0; i < K; i++) {
+        data[i] = &buf[(size_t)i * block_size];
+    }
+    for(int r = 0; r < M; r++) {
+        fec[r] = &buf[(size_t)(K + r) * block_size];
+        expect[r] = &buf[(size_t)(K + M + r) * block_size];
+    }
+    for(size_t i = 0; i < (size_t)K * block_size; i++) {
+        buf[i] = (unsigned char)rand();
+    }
+
+    for(int s : sizes) {
+        if(s > block_size) {
+            break;
+        }
+        reed_solomon_encode(rs, data, expect, s);
+        Codec::encode(data, fec, s);
+        for(int r = 0; r < M; r++) {
+            errors += 0 != memcmp(fec[r], expect[r], s);
+        }
+    }
+
+    double start = now_us();
+    int reps = 0;
+    do {
+        reed_solomon_encode(rs, data, expect, block_size);
+        reps++;
+    } while(now_us() - start < 200 * 1000);
+    double c_us = (now_us() - start) / reps;
+
+    start = now_us();
+    reps = 0;
+    do {
+        Codec::encode(data, fec, block_size);
+        reps++;
+    } while(now_us() - start < 200 * 1000);
+    double t_us = (now_us() - start) / reps;
+    for(int r = 0; r < M; r++) {
+        errors += 0 != memcmp(fec[r], expect[r], block_size);
+    }
+
+    printf("%3d+%d, %d byte blocks: C %.2f GB/s, template %.2f GB/s%s\n", K, M, block_size,
+            (double)K * block_size / c_us / 1e3, (double)K * block_size / t_us / 1e3,
+            errors ? ", MISMATCH" : "");
+    reed_solomon_release(rs);
+    return errors;
+}
+
+/* rscode::encode picks the template where it has one and the C codec otherwise */
+static int check_dispatch() {
+    static const int geometries[][2] = { { 10, 4 }, { 12, 3 }, { 128, 7 }, { 6, 3 } };
+    int errors = 0;
+    for(const auto& g : geometries) {
+        int k = g[0], m = g[1], bs = 1000;
+        reed_solomon* rs = reed_solomon_new(k, m);
+        std::vector<unsigned char> buf((size_t)(k + 2 * m) * bs);
+        unsigned char* data[DATA_SHARDS_MAX];
+        unsigned char* fec[DATA_SHARDS_MAX];
+        unsigned char* expect[DATA_SHARDS_MAX];
+        for(int i = 0; i < k; i++) {
+            data[i] = &buf[(size_t)i * bs];
+        }
+        for(int r = 0; r < m; r++) {
+            fec[r] = &buf[(size_t)(k + r) * bs];
+            expect[r] = &buf[(size_t)(k + m + r) * bs];
+        }
+        for(size_t i = 0; i < (size_t)k * bs; i++) {
+            buf[i] = (unsigned char)rand();
+        }
+        reed_solomon_encode(rs, data, expect, bs);
+        errors += 0 != rscode::encode(rs, data, fec, bs);
+        for(int r = 0; r < m; r++) {
+            errors += 0 != memcmp(fec[r], expect[r], bs);
+        }
+        reed_solomon_release(rs);
+    }
+    return errors;
+}
+
+int main(int argc, char** argv) {
+    long long budget = 8LL << 20;
+    int kernel = FEC_KERNEL_AUTO;
+    int errors = 0;
+
+    for(int i = 1; i < argc; i++) {
+        if(i + 1 < argc && 0 == strcmp(argv[i], "-M")) {
+            budget = atoll(argv[++i]) << 20;
+        } else if(i + 1 < argc && 0 == strcmp(argv[i], "-k")) {
+            kernel = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: rsfixed [-M mb] [-k kernel]\n");
+            return 2;
+        }
+    }
+
+    if(FEC_KERNEL_AUTO != kernel && 0 != fec_set_kernel(kernel)) {
+        fprintf(stderr, "kernel %d is not supported here\n", kernel);
+        return 2;
+    }
+    errors += check<10, 4>(budget);
+    errors += check<12, 3>(budget);
+    errors += check<128, 7>(budget);
+    errors += check<4, 2>(budget);
+    errors += check_dispatch();
+    printf(0 == errors ? "Specialised parity matches the C codec\n" : "Found %d errors\n", errors);
+    return 0 == errors ? 0 : 1;
+}